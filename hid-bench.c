@@ -0,0 +1,315 @@
+/* Copyright 2010 Michael Poole.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Benchmarks for the report descriptor parser (hid-desc.h) and the
+ * report layout compiler and decoder (hid-report.h).
+ *
+ * Each workload is a report descriptor: the Magic Mouse's, or one
+ * generated with a given collection nesting depth, number of fields,
+ * Push/Pop use, Report Count and number of report IDs.  For each one
+ * we time parsing, compiling and decoding separately, and print one
+ * JSON object per line so results are easy to compare across runs.
+ */
+
+#include <errno.h>     /* errno */
+#include <inttypes.h>  /* sized integer types *and formatting* */
+#include <stdio.h>     /* fprintf(), stdout */
+#include <stdlib.h>    /* EXIT_SUCCESS, EXIT_FAILURE, strtol() */
+#include <string.h>    /* strcmp(), strerror() */
+#include <time.h>      /* clock_gettime() */
+#include <unistd.h>    /* getopt(), etc. */
+
+#include "hid-desc.h"
+#include "hid-report.h"
+#include "magicmouse-desc.h"
+
+/* Parameters for a generated descriptor. */
+struct workload {
+        const char *name;
+        /* Collections nested inside each report's Application collection. */
+        int depth;
+        /* Input items per report. */
+        int fields;
+        /* Non-zero to wrap each field's globals in Push and Pop. */
+        int push_pop;
+        /* Report Count for each field. */
+        int report_count;
+        /* Number of report IDs. */
+        int report_ids;
+};
+
+static const struct workload workloads[] = {
+        { "magicmouse",  0,  0, 0,    0,  0 },
+        { "flat",        0, 16, 0,    1,  4 },
+        { "nested",     14,  4, 0,    1,  2 },
+        { "push-pop",    2, 32, 1,    2,  4 },
+        { "large-count", 0,  4, 0, 1024,  1 },
+        { "many-reports", 0, 2, 0,    3, 60 },
+};
+
+unsigned char desc[16384];
+unsigned int desc_length;
+struct hid_layout layout;
+unsigned char reports[HID_MAX_REPORTS][8192];
+unsigned int report_length[HID_MAX_REPORTS];
+unsigned int nreports;
+int64_t min_ns = 250000000;
+volatile uint64_t sink;
+
+/* Appends a short item with the smallest encoding for value. */
+void emit(int tag, int32_t value)
+{
+        unsigned char *d = desc + desc_length;
+
+        if (value == 0 && (tag == HID_MAIN_END_COLLECTION || tag == HID_GLOBAL_PUSH
+                           || tag == HID_GLOBAL_POP)) {
+                d[0] = tag;
+                desc_length += 1;
+        } else if (value >= -128 && value <= 127) {
+                d[0] = tag | 1;
+                d[1] = value;
+                desc_length += 2;
+        } else if (value >= -32768 && value <= 32767) {
+                d[0] = tag | 2;
+                d[1] = value;
+                d[2] = value >> 8;
+                desc_length += 3;
+        } else {
+                d[0] = tag | 3;
+                d[1] = value;
+                d[2] = value >> 8;
+                d[3] = value >> 16;
+                d[4] = value >> 24;
+                desc_length += 5;
+        }
+}
+
+void generate(const struct workload *w)
+{
+        static const int sizes[] = { 1, 8, 16, 12 };
+        int report_id;
+        int size;
+        int ii;
+        int jj;
+
+        desc_length = 0;
+        if (w->report_ids == 0) {
+                memcpy(desc, magicmouse_descriptor, sizeof(magicmouse_descriptor));
+                desc_length = sizeof(magicmouse_descriptor);
+                return;
+        }
+
+        for (report_id = 1; report_id <= w->report_ids; report_id++) {
+                emit(HID_GLOBAL_USAGE_PAGE, 0x01);
+                emit(HID_LOCAL_USAGE, 0x02);
+                emit(HID_MAIN_COLLECTION, 0x01);
+                emit(HID_GLOBAL_REPORT_ID, report_id);
+                for (ii = 0; ii < w->depth; ii++) {
+                        emit(HID_LOCAL_USAGE, 0x01);
+                        emit(HID_MAIN_COLLECTION, 0x02);
+                }
+                for (ii = 0; ii < w->fields; ii++) {
+                        size = sizes[ii % 4];
+                        if (w->push_pop) {
+                                emit(HID_GLOBAL_PUSH, 0);
+                        }
+                        if (size == 1) {
+                                emit(HID_GLOBAL_USAGE_PAGE, 0x09);
+                                emit(HID_LOCAL_USAGE_MIN, 1);
+                                emit(HID_LOCAL_USAGE_MAX, w->report_count);
+                                emit(HID_GLOBAL_LOGICAL_MIN, 0);
+                                emit(HID_GLOBAL_LOGICAL_MAX, 1);
+                        } else {
+                                emit(HID_GLOBAL_USAGE_PAGE, 0x01);
+                                for (jj = 0; jj < w->report_count && jj < 2; jj++) {
+                                        emit(HID_LOCAL_USAGE, 0x30 + jj);
+                                }
+                                emit(HID_GLOBAL_LOGICAL_MIN, -(1 << (size - 1)) + 1);
+                                emit(HID_GLOBAL_LOGICAL_MAX, (1 << (size - 1)) - 1);
+                        }
+                        emit(HID_GLOBAL_REPORT_SIZE, size);
+                        emit(HID_GLOBAL_REPORT_COUNT, w->report_count);
+                        emit(HID_MAIN_INPUT, size == 1 ? 0x02 : 0x06);
+                        if (w->push_pop) {
+                                emit(HID_GLOBAL_POP, 0);
+                        }
+                }
+                for (ii = 0; ii < w->depth; ii++) {
+                        emit(HID_MAIN_END_COLLECTION, 0);
+                }
+                emit(HID_MAIN_END_COLLECTION, 0);
+        }
+}
+
+/* Builds one report for each input report in the layout. */
+void make_reports(void)
+{
+        const struct hid_report *r;
+        uint32_t seed = 12345;
+        unsigned int ii;
+        unsigned int jj;
+
+        nreports = 0;
+        for (ii = 0; ii < layout.report_count; ii++) {
+                r = &layout.report[ii];
+                if (r->type != HID_REPORT_INPUT) {
+                        continue;
+                }
+                report_length[nreports] = hid_report_bytes(&layout, r);
+                for (jj = 0; jj < report_length[nreports]; jj++) {
+                        seed = seed * 1103515245 + 12345;
+                        reports[nreports][jj] = seed >> 16;
+                }
+                if (layout.numbered) {
+                        reports[nreports][0] = r->id;
+                }
+                nreports++;
+        }
+}
+
+int64_t now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int count_item(struct hid_parser *p, const struct hid_item *item)
+{
+        (void)item;
+        ++*(uint64_t *)p->ctx;
+        return 0;
+}
+
+void add_value(void *ctx, const struct hid_field *f, uint32_t usage, int32_t value)
+{
+        (void)f;
+        *(uint64_t *)ctx += usage + value;
+}
+
+/* Runs one pass of a phase.  Returns the number of bytes it handled. */
+uint64_t run_parse(void)
+{
+        static const struct hid_parse_ops ops = { .item = count_item };
+        struct hid_parser parser;
+        uint64_t items = 0;
+
+        hid_parser_init(&parser, &ops, &items);
+        hid_parse(&parser, desc, desc_length);
+        sink += items;
+        return desc_length;
+}
+
+uint64_t run_compile(void)
+{
+        hid_compile(&layout, desc, desc_length);
+        sink += layout.field_count;
+        return desc_length;
+}
+
+uint64_t run_decode(void)
+{
+        uint64_t bytes = 0;
+        uint64_t sum = 0;
+        unsigned int ii;
+
+        for (ii = 0; ii < nreports; ii++) {
+                hid_decode_report(&layout, HID_REPORT_INPUT, reports[ii],
+                                  report_length[ii], add_value, &sum);
+                bytes += report_length[ii];
+        }
+        sink += sum;
+        return bytes;
+}
+
+void measure(const char *workload, const char *phase, uint64_t (*run)(void))
+{
+        uint64_t iterations;
+        uint64_t bytes;
+        uint64_t batch;
+        uint64_t ii;
+        int64_t start;
+        int64_t elapsed;
+
+        /* Warm up, then double the batch until it runs long enough. */
+        bytes = run();
+        for (batch = 1; ; batch *= 2) {
+                start = now_ns();
+                for (ii = 0; ii < batch; ii++) {
+                        run();
+                }
+                elapsed = now_ns() - start;
+                if (elapsed >= min_ns) {
+                        break;
+                }
+        }
+        iterations = batch;
+
+        fprintf(stdout, "{\"workload\":\"%s\",\"phase\":\"%s\",\"bytes\":%" PRIu64
+                ",\"iterations\":%" PRIu64 ",\"ns_per_op\":%.1f,\"mb_per_s\":%.2f}\n",
+                workload, phase, bytes, iterations,
+                (double)elapsed / iterations,
+                bytes * iterations * 1e3 / elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+        const char *only = NULL;
+        unsigned int ii;
+        int res;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "t:w:")) != -1) {
+                switch (opt) {
+                case 't':
+                        min_ns = strtol(optarg, NULL, 0) * 1000000LL;
+                        break;
+                case 'w':
+                        only = optarg;
+                        break;
+                default:
+                        fprintf(stderr, "Usage:\n%s [-t min_msec] [-w workload]\n", argv[0]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        for (ii = 0; ii < sizeof(workloads) / sizeof(workloads[0]); ii++) {
+                if (only != NULL && strcmp(only, workloads[ii].name)) {
+                        continue;
+                }
+                generate(&workloads[ii]);
+                res = hid_compile(&layout, desc, desc_length);
+                if (res) {
+                        fprintf(stderr, "%s: cannot compile descriptor: %s\n",
+                                workloads[ii].name, hid_strerror(res));
+                        return EXIT_FAILURE;
+                }
+                make_reports();
+                measure(workloads[ii].name, "parse", run_parse);
+                measure(workloads[ii].name, "compile", run_compile);
+                measure(workloads[ii].name, "decode", run_decode);
+        }
+
+        return EXIT_SUCCESS;
+}
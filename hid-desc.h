@@ -0,0 +1,483 @@
+/* Copyright 2010 Michael Poole.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* HID report descriptor item walker.
+ *
+ * This is a callback-driven parser: the caller supplies a struct
+ * hid_parse_ops, and the parser calls it once per item with the
+ * global and local state already updated.  It never allocates
+ * memory; everything it needs lives in struct hid_parser, including a
+ * fixed-depth Push/Pop stack.  Input can be given all at once or in
+ * arbitrary pieces as it arrives.  Everything here is static inline, so
+ * just include this header in each program that needs it.
+ */
+
+#if !defined(HID_DESC_H)
+#define HID_DESC_H
+
+#include <stddef.h>    /* size_t, offsetof() */
+#include <stdint.h>    /* sized integer types */
+#include <string.h>    /* memset(), memcpy() */
+
+/* Parser limits. */
+#define HID_STACK_DEPTH       8   /* Push (without Pop) nesting */
+#define HID_COLLECTION_DEPTH 16   /* Collection nesting */
+#define HID_MAX_USAGES       64   /* Usages before a main item */
+
+/* Item types, from bits 2-3 of the item prefix. */
+#define HID_ITEM_MAIN     0
+#define HID_ITEM_GLOBAL   1
+#define HID_ITEM_LOCAL    2
+#define HID_ITEM_RESERVED 3
+#define HID_ITEM_LONG     4
+
+/* Item tags, as (prefix & 0xfc). */
+#define HID_MAIN_INPUT            0x80
+#define HID_MAIN_OUTPUT           0x90
+#define HID_MAIN_COLLECTION       0xa0
+#define HID_MAIN_FEATURE          0xb0
+#define HID_MAIN_END_COLLECTION   0xc0
+
+#define HID_GLOBAL_USAGE_PAGE     0x04
+#define HID_GLOBAL_LOGICAL_MIN    0x14
+#define HID_GLOBAL_LOGICAL_MAX    0x24
+#define HID_GLOBAL_PHYSICAL_MIN   0x34
+#define HID_GLOBAL_PHYSICAL_MAX   0x44
+#define HID_GLOBAL_UNIT_EXPONENT  0x54
+#define HID_GLOBAL_UNIT           0x64
+#define HID_GLOBAL_REPORT_SIZE    0x74
+#define HID_GLOBAL_REPORT_ID      0x84
+#define HID_GLOBAL_REPORT_COUNT   0x94
+#define HID_GLOBAL_PUSH           0xa4
+#define HID_GLOBAL_POP            0xb4
+
+#define HID_LOCAL_USAGE           0x08
+#define HID_LOCAL_USAGE_MIN       0x18
+#define HID_LOCAL_USAGE_MAX       0x28
+#define HID_LOCAL_DESIGNATOR_IDX  0x38
+#define HID_LOCAL_DESIGNATOR_MIN  0x48
+#define HID_LOCAL_DESIGNATOR_MAX  0x58
+#define HID_LOCAL_STRING_IDX      0x78
+#define HID_LOCAL_STRING_MIN      0x88
+#define HID_LOCAL_STRING_MAX      0x98
+#define HID_LOCAL_DELIMITER       0xa8
+
+#define HID_LONG_ITEM_PREFIX      0xfe
+
+/* Error codes returned by hid_parse() and passed to
+ * hid_parse_ops::error, then those returned by hid_compile() in
+ * hid-report.h.
+ */
+#define HID_ERR_TRUNCATED        -1  /* Item runs past end of data */
+#define HID_ERR_STACK_OVERFLOW   -2  /* Too many Push items */
+#define HID_ERR_STACK_UNDERFLOW  -3  /* Pop without Push */
+#define HID_ERR_COLLECTION_DEPTH -4  /* Collections nested too deep */
+#define HID_ERR_END_COLLECTION   -5  /* End Collection without Collection */
+#define HID_ERR_TOO_MANY_USAGES  -6  /* More than HID_MAX_USAGES usages */
+#define HID_ERR_LAYOUT_FULL     -16 /* Too many fields, reports or usages */
+#define HID_ERR_FIELD_TOO_LARGE -17 /* Too many values, or report over 2^32 bits */
+
+/** One item from a report descriptor. */
+struct hid_item {
+        /** Byte offset of the item's prefix within the descriptor. */
+        unsigned int offset;
+        /** Raw prefix byte. */
+        unsigned char prefix;
+        /** Item tag: (prefix & 0xfc) for short items, bLongItemTag
+         * for long items.
+         */
+        unsigned char tag;
+        /** One of the HID_ITEM_* types. */
+        unsigned char type;
+        /** Number of data bytes (0, 1, 2 or 4 for short items). */
+        unsigned char size;
+        /** Data, zero-extended. */
+        uint32_t udata;
+        /** Data, sign-extended from its encoded size. */
+        int32_t sdata;
+        /** Data bytes of a long item; NULL for short items.  Only
+         * valid until the callback returns.
+         */
+        const unsigned char *long_data;
+};
+
+/** Global item state, saved and restored by Push and Pop. */
+struct hid_global {
+        uint32_t usage_page;
+        int32_t logical_minimum;
+        int32_t logical_maximum;
+        int32_t physical_minimum;
+        int32_t physical_maximum;
+        int32_t unit_exponent;
+        uint32_t unit;
+        uint32_t report_size;
+        uint32_t report_id;
+        uint32_t report_count;
+};
+
+/** Local item state, cleared after each main item. */
+struct hid_local {
+        /** Usages, with the usage page in the upper 16 bits.  Only the
+         * first hid_local::usage_count entries are meaningful.
+         */
+        uint32_t usage[HID_MAX_USAGES];
+        /* Everything from here on is zeroed after each main item. */
+        unsigned int usage_count;
+        uint32_t usage_minimum;
+        uint32_t usage_maximum;
+        uint32_t designator_index;
+        uint32_t designator_minimum;
+        uint32_t designator_maximum;
+        uint32_t string_index;
+        uint32_t string_minimum;
+        uint32_t string_maximum;
+        uint32_t delimiter;
+};
+
+struct hid_parser;
+
+/** Callbacks from the parser.  Any of them may be NULL.  Returning
+ * non-zero from a callback stops the parse, and hid_parse() returns
+ * that value.
+ */
+struct hid_parse_ops {
+        /** Called for every item, after global and local state have
+         * been updated for it (but before locals are cleared after a
+         * main item).
+         */
+        int (*item)(struct hid_parser *p, const struct hid_item *item);
+        /** Called for each Input, Output, Feature, Collection and End
+         * Collection item, after hid_parse_ops::item, with
+         * hid_parser::global and hid_parser::local describing it.
+         */
+        int (*main)(struct hid_parser *p, const struct hid_item *item);
+        /** Called for a structural error (one of HID_ERR_*).  If
+         * this returns zero, the offending item is ignored and
+         * parsing continues.  If this is NULL, the error ends the
+         * parse.  HID_ERR_TRUNCATED always ends the parse.
+         */
+        int (*error)(struct hid_parser *p, int err, const struct hid_item *item);
+};
+
+/** Parser state.  Callbacks may read anything in here. */
+struct hid_parser {
+        const struct hid_parse_ops *ops;
+        /** Opaque pointer for the caller. */
+        void *ctx;
+        struct hid_global global;
+        struct hid_local local;
+        struct hid_global stack[HID_STACK_DEPTH];
+        unsigned int stack_depth;
+        unsigned int collection_depth;
+        /** Descriptor offset of the next item. */
+        unsigned int offset;
+        /** Sticky result of the parse so far. */
+        int status;
+        /** Start of an item split across hid_parse_feed() calls. */
+        unsigned char partial[3 + 255];
+        size_t partial_length;
+};
+
+static inline void hid_parser_init(struct hid_parser *p, const struct hid_parse_ops *ops, void *ctx)
+{
+        memset(p, 0, sizeof(*p));
+        p->ops = ops;
+        p->ctx = ctx;
+}
+
+static inline const char *hid_strerror(int err)
+{
+        switch (err) {
+        case HID_ERR_TRUNCATED: return "item truncated";
+        case HID_ERR_STACK_OVERFLOW: return "Push stack overflow";
+        case HID_ERR_STACK_UNDERFLOW: return "Pop without Push";
+        case HID_ERR_COLLECTION_DEPTH: return "collections nested too deeply";
+        case HID_ERR_END_COLLECTION: return "End Collection without Collection";
+        case HID_ERR_TOO_MANY_USAGES: return "too many usages";
+        case HID_ERR_LAYOUT_FULL: return "too many fields or reports";
+        case HID_ERR_FIELD_TOO_LARGE: return "field or report too large";
+        }
+        return "unknown error";
+}
+
+static inline int hid_parse_error(struct hid_parser *p, int err, const struct hid_item *item)
+{
+        if (p->ops->error == NULL) {
+                return err;
+        }
+        return p->ops->error(p, err, item);
+}
+
+/* Applies one item to the parser state and runs the callbacks. */
+static inline int hid_parse_item(struct hid_parser *p, const struct hid_item *item)
+{
+        struct hid_local *l = &p->local;
+        struct hid_global *g = &p->global;
+        uint32_t usage;
+        int res;
+
+        switch (item->type == HID_ITEM_LONG ? 0 : item->tag) {
+        case HID_GLOBAL_USAGE_PAGE:   g->usage_page = item->udata; break;
+        case HID_GLOBAL_LOGICAL_MIN:  g->logical_minimum = item->sdata; break;
+        case HID_GLOBAL_LOGICAL_MAX:  g->logical_maximum = item->sdata; break;
+        case HID_GLOBAL_PHYSICAL_MIN: g->physical_minimum = item->sdata; break;
+        case HID_GLOBAL_PHYSICAL_MAX: g->physical_maximum = item->sdata; break;
+        case HID_GLOBAL_UNIT_EXPONENT: g->unit_exponent = item->sdata; break;
+        case HID_GLOBAL_UNIT:         g->unit = item->udata; break;
+        case HID_GLOBAL_REPORT_SIZE:  g->report_size = item->udata; break;
+        case HID_GLOBAL_REPORT_ID:    g->report_id = item->udata; break;
+        case HID_GLOBAL_REPORT_COUNT: g->report_count = item->udata; break;
+        case HID_GLOBAL_PUSH:
+                if (p->stack_depth >= HID_STACK_DEPTH) {
+                        res = hid_parse_error(p, HID_ERR_STACK_OVERFLOW, item);
+                        if (res) return res;
+                        break;
+                }
+                p->stack[p->stack_depth++] = *g;
+                break;
+        case HID_GLOBAL_POP:
+                if (p->stack_depth == 0) {
+                        res = hid_parse_error(p, HID_ERR_STACK_UNDERFLOW, item);
+                        if (res) return res;
+                        break;
+                }
+                *g = p->stack[--p->stack_depth];
+                break;
+
+        case HID_LOCAL_USAGE:
+        case HID_LOCAL_USAGE_MIN:
+        case HID_LOCAL_USAGE_MAX:
+                /* Short usages take the current usage page. */
+                usage = item->udata;
+                if (item->size < 4) {
+                        usage |= g->usage_page << 16;
+                }
+                if (item->tag == HID_LOCAL_USAGE_MIN) {
+                        l->usage_minimum = usage;
+                } else if (item->tag == HID_LOCAL_USAGE_MAX) {
+                        l->usage_maximum = usage;
+                } else if (l->usage_count >= HID_MAX_USAGES) {
+                        res = hid_parse_error(p, HID_ERR_TOO_MANY_USAGES, item);
+                        if (res) return res;
+                } else {
+                        l->usage[l->usage_count++] = usage;
+                }
+                break;
+        case HID_LOCAL_DESIGNATOR_IDX: l->designator_index = item->udata; break;
+        case HID_LOCAL_DESIGNATOR_MIN: l->designator_minimum = item->udata; break;
+        case HID_LOCAL_DESIGNATOR_MAX: l->designator_maximum = item->udata; break;
+        case HID_LOCAL_STRING_IDX:    l->string_index = item->udata; break;
+        case HID_LOCAL_STRING_MIN:    l->string_minimum = item->udata; break;
+        case HID_LOCAL_STRING_MAX:    l->string_maximum = item->udata; break;
+        case HID_LOCAL_DELIMITER:     l->delimiter = item->udata; break;
+
+        case HID_MAIN_COLLECTION:
+                if (p->collection_depth >= HID_COLLECTION_DEPTH) {
+                        res = hid_parse_error(p, HID_ERR_COLLECTION_DEPTH, item);
+                        if (res) return res;
+                } else {
+                        p->collection_depth++;
+                }
+                break;
+        case HID_MAIN_END_COLLECTION:
+                if (p->collection_depth == 0) {
+                        res = hid_parse_error(p, HID_ERR_END_COLLECTION, item);
+                        if (res) return res;
+                } else {
+                        p->collection_depth--;
+                }
+                break;
+        }
+
+        if (p->ops->item != NULL) {
+                res = p->ops->item(p, item);
+                if (res) return res;
+        }
+
+        if (item->type == HID_ITEM_MAIN) {
+                switch (item->tag) {
+                case HID_MAIN_INPUT:
+                case HID_MAIN_OUTPUT:
+                case HID_MAIN_COLLECTION:
+                case HID_MAIN_FEATURE:
+                case HID_MAIN_END_COLLECTION:
+                        if (p->ops->main != NULL) {
+                                res = p->ops->main(p, item);
+                                if (res) return res;
+                        }
+                }
+                /* Clear everything except the usage array itself. */
+                memset(&l->usage_count, 0, sizeof(*l) - offsetof(struct hid_local, usage_count));
+        }
+
+        return 0;
+}
+
+/* Returns the total length of the item that starts with the \a avail
+ * bytes at \a d, or zero if that cannot be told yet.
+ */
+static inline size_t hid_item_length(const unsigned char d[], size_t avail)
+{
+        static const unsigned char sizes[4] = { 0, 1, 2, 4 };
+
+        if (avail < 1) {
+                return 0;
+        } else if (d[0] != HID_LONG_ITEM_PREFIX) {
+                return 1 + sizes[d[0] & 3];
+        } else if (avail < 2) {
+                return 0;
+        }
+        return 3 + d[1];
+}
+
+/* Decodes the complete item that starts at \a d. */
+static inline void hid_decode_item(struct hid_item *item, const unsigned char d[])
+{
+        uint32_t v;
+
+        item->prefix = d[0];
+        item->long_data = NULL;
+
+        if (d[0] == HID_LONG_ITEM_PREFIX) {
+                item->type = HID_ITEM_LONG;
+                item->size = d[1];
+                item->tag = d[2];
+                item->udata = 0;
+                item->sdata = 0;
+                item->long_data = d + 3;
+                return;
+        }
+
+        item->type = (d[0] >> 2) & 3;
+        item->tag = d[0] & 0xfc;
+        switch (d[0] & 3) {
+        case 0:
+                item->size = 0;
+                item->udata = 0;
+                item->sdata = 0;
+                break;
+        case 1:
+                item->size = 1;
+                item->udata = d[1];
+                item->sdata = (int8_t)d[1];
+                break;
+        case 2:
+                item->size = 2;
+                item->udata = d[1] | (d[2] << 8);
+                item->sdata = (int16_t)item->udata;
+                break;
+        default:
+                item->size = 4;
+                v = (uint32_t)d[1] | ((uint32_t)d[2] << 8)
+                        | ((uint32_t)d[3] << 16) | ((uint32_t)d[4] << 24);
+                item->udata = v;
+                item->sdata = (int32_t)v;
+                break;
+        }
+}
+
+/* Decodes and applies the complete item at \a d. */
+static inline int hid_parse_one(struct hid_parser *p, const unsigned char d[], size_t len)
+{
+        struct hid_item item;
+
+        item.offset = p->offset;
+        hid_decode_item(&item, d);
+        p->offset += len;
+        return hid_parse_item(p, &item);
+}
+
+/** Feeds the next \a length bytes of a descriptor to the parser.
+ * Items are parsed as soon as they are complete; an item that is
+ * split across calls is buffered in \a p until the rest of it
+ * arrives.  Returns zero on success, a HID_ERR_* code for an error,
+ * or whatever non-zero value a callback returned.  Once a call fails,
+ * later calls return the same value without parsing anything.
+ */
+static inline int hid_parse_feed(struct hid_parser *p, const unsigned char data[], size_t length)
+{
+        size_t pos;
+        size_t need;
+        size_t take;
+
+        for (pos = 0; pos < length && p->status == 0; ) {
+                if (p->partial_length > 0) {
+                        /* Finish the buffered item first. */
+                        need = hid_item_length(p->partial, p->partial_length);
+                        take = (need == 0) ? 1 : need - p->partial_length;
+                        if (take > length - pos) {
+                                take = length - pos;
+                        }
+                        memcpy(p->partial + p->partial_length, data + pos, take);
+                        p->partial_length += take;
+                        pos += take;
+                        if (need == 0 || p->partial_length < need) {
+                                continue;
+                        }
+                        p->partial_length = 0;
+                        p->status = hid_parse_one(p, p->partial, need);
+                        continue;
+                }
+
+                need = hid_item_length(data + pos, length - pos);
+                if (need == 0 || need > length - pos) {
+                        /* Save the start of the item for later. */
+                        p->partial_length = length - pos;
+                        memcpy(p->partial, data + pos, p->partial_length);
+                        break;
+                }
+                p->status = hid_parse_one(p, data + pos, need);
+                pos += need;
+        }
+
+        return p->status;
+}
+
+/** Tells the parser that the descriptor has ended.  Returns
+ * HID_ERR_TRUNCATED if an item was left incomplete, otherwise the
+ * same as hid_parse_feed().
+ */
+static inline int hid_parse_finish(struct hid_parser *p)
+{
+        struct hid_item item;
+
+        if (p->status == 0 && p->partial_length > 0) {
+                memset(&item, 0, sizeof(item));
+                item.offset = p->offset;
+                item.prefix = p->partial[0];
+                p->status = HID_ERR_TRUNCATED;
+                hid_parse_error(p, HID_ERR_TRUNCATED, &item);
+        }
+        return p->status;
+}
+
+/** Parses a complete report descriptor, calling \a p's callbacks
+ * for each item.  Returns the same as hid_parse_finish().
+ */
+static inline int hid_parse(struct hid_parser *p, const unsigned char data[], size_t length)
+{
+        hid_parse_feed(p, data, length);
+        return hid_parse_finish(p);
+}
+
+#endif /* !defined(HID_DESC_H) */
@@ -17,6 +17,7 @@
 #include <linux/usb.h>
 
 #include "hid-ids.h"
+#include "magicmouse-report.h"
 
 static bool emulate_3button = true;
 module_param(emulate_3button, bool, 0644);
@@ -37,18 +38,6 @@ static bool report_undeciphered;
 module_param(report_undeciphered, bool, 0644);
 MODULE_PARM_DESC(report_undeciphered, "Report undeciphered multi-touch state field using a MSC_RAW event");
 
-#define TOUCH_REPORT_ID   0x29
-/* These definitions are not precise, but they're close enough.  (Bits
- * 0x03 seem to indicate the aspect ratio of the touch, bits 0x70 seem
- * to be some kind of bit mask -- 0x20 may be a near-field reading,
- * and 0x40 is actual contact, and 0x10 may be a start/stop or change
- * indication.)
- */
-#define TOUCH_STATE_MASK  0xf0
-#define TOUCH_STATE_NONE  0x00
-#define TOUCH_STATE_START 0x30
-#define TOUCH_STATE_DRAG  0x40
-
 /**
  * struct magicmouse_sc - Tracks Magic Mouse-specific data.
  * @input: Input device through which we report events.
@@ -80,7 +69,7 @@ struct magicmouse_sc {
 		short scroll_y;
 		u8 size;
 	} touches[16];
-	int tracking_ids[16];
+	int tracking_ids[MAGICMOUSE_MAX_TOUCHES];
 };
 
 static int magicmouse_firm_touch(struct magicmouse_sc *msc)
@@ -143,20 +132,19 @@ static void magicmouse_emit_buttons(struct magicmouse_sc *msc, int state)
 		msc->scroll_accel = 0;
 }
 
-static void magicmouse_emit_touch(struct magicmouse_sc *msc, int raw_id, u8 *tdata)
+static void magicmouse_emit_touch(struct magicmouse_sc *msc, int raw_id,
+		const struct magicmouse_touch *touch)
 {
 	struct input_dev *input = msc->input;
-	__s32 x_y = tdata[0] << 8 | tdata[1] << 16 | tdata[2] << 24;
-	int misc = tdata[5] | tdata[6] << 8;
-	int id = (misc >> 6) & 15;
-	int x = x_y << 12 >> 20;
-	int y = -(x_y >> 20);
+	int id = touch->id;
+	int x = touch->x;
+	int y = touch->y;
 
 	/* Store tracking ID and other fields. */
 	msc->tracking_ids[raw_id] = id;
 	msc->touches[id].x = x;
 	msc->touches[id].y = y;
-	msc->touches[id].size = misc & 63;
+	msc->touches[id].size = touch->size;
 
 	/* If requested, emulate a scroll wheel by detecting small
 	 * vertical touch motions along the middle of the mouse.
@@ -174,13 +162,13 @@ static void magicmouse_emit_touch(struct magicmouse_sc *msc, int raw_id, u8 *tda
 			msc->scroll_accel = 0;
 
 		/* Calculate and apply the scroll motion. */
-		switch (tdata[7] & TOUCH_STATE_MASK) {
-		case TOUCH_STATE_START:
+		switch (touch->state & MAGICMOUSE_TOUCH_STATE_MASK) {
+		case MAGICMOUSE_TOUCH_STATE_START:
 			msc->touches[id].scroll_y = y;
 			msc->scroll_accel = min_t(int, msc->scroll_accel + 1,
 						ARRAY_SIZE(accel_profile) - 1);
 			break;
-		case TOUCH_STATE_DRAG:
+		case MAGICMOUSE_TOUCH_STATE_DRAG:
 			step = step / accel_profile[msc->scroll_accel];
 			if (step != 0) {
 				msc->touches[id].scroll_y = y;
@@ -193,17 +181,15 @@ static void magicmouse_emit_touch(struct magicmouse_sc *msc, int raw_id, u8 *tda
 
 	/* Generate the input events for this touch. */
 	if (report_touches) {
-		int orientation = (misc >> 10) - 32;
-
 		input_report_abs(input, ABS_MT_TRACKING_ID, id);
-		input_report_abs(input, ABS_MT_TOUCH_MAJOR, tdata[3]);
-		input_report_abs(input, ABS_MT_TOUCH_MINOR, tdata[4]);
-		input_report_abs(input, ABS_MT_ORIENTATION, orientation);
+		input_report_abs(input, ABS_MT_TOUCH_MAJOR, touch->major);
+		input_report_abs(input, ABS_MT_TOUCH_MINOR, touch->minor);
+		input_report_abs(input, ABS_MT_ORIENTATION, touch->orientation);
 		input_report_abs(input, ABS_MT_POSITION_X, x);
 		input_report_abs(input, ABS_MT_POSITION_Y, y);
 
 		if (report_undeciphered)
-			input_event(input, EV_MSC, MSC_RAW, tdata[7]);
+			input_event(input, EV_MSC, MSC_RAW, touch->state);
 
 		input_mt_sync(input);
 	}
@@ -214,48 +200,38 @@ static int magicmouse_raw_event(struct hid_device *hdev,
 {
 	struct magicmouse_sc *msc = hid_get_drvdata(hdev);
 	struct input_dev *input = msc->input;
-	int x, y, ts, ii, clicks;
-
-	switch (data[0]) {
-	case 0x10:
-		if (size != 6)
-			return 0;
-		x = (__s16)(data[2] | data[3] << 8);
-		y = (__s16)(data[4] | data[5] << 8);
-		clicks = data[1];
+	struct magicmouse_report r;
+	int ts, ii;
+
+	switch (magicmouse_decode(&r, data, size)) {
+	case MAGICMOUSE_MOTION:
 		break;
-	case TOUCH_REPORT_ID:
-		/* Expect six bytes of prefix, and N*8 bytes of touch data. */
-		if (size < 6 || ((size - 6) % 8) != 0)
-			return 0;
-		ts = data[3] >> 6 | data[4] << 2 | data[5] << 10;
+	case MAGICMOUSE_TOUCH:
+		ts = r.timestamp;
 		msc->delta_time = (ts - msc->last_timestamp) & 0x3ffff;
 		msc->last_timestamp = ts;
-		msc->ntouches = (size - 6) / 8;
-		for (ii = 0; ii < msc->ntouches; ii++)
-			magicmouse_emit_touch(msc, ii, data + ii * 8 + 6);
+		msc->ntouches = r.ntouches;
 		/* When emulating three-button mode, it is important
 		 * to have the current touch information before
 		 * generating a click event.
 		 */
-		x = (signed char)data[1];
-		y = (signed char)data[2];
-		clicks = data[3];
+		for (ii = 0; ii < msc->ntouches; ii++)
+			magicmouse_emit_touch(msc, ii, &r.touch[ii]);
 		break;
-	case 0x20: /* Theoretically battery status (0-100), but I have
-		    * never seen it -- maybe it is only upon request.
-		    */
-	case 0x60: /* Unknown, maybe laser on/off. */
-	case 0x61: /* Laser reflection status change.
-		    * data[1]: 0 = spotted, 1 = lost
-		    */
+	/* Everything else decodes as MAGICMOUSE_NONE, including:
+	 * 0x20: Theoretically battery status (0-100), but I have
+	 *       never seen it -- maybe it is only upon request.
+	 * 0x60: Unknown, maybe laser on/off.
+	 * 0x61: Laser reflection status change.
+	 *       data[1]: 0 = spotted, 1 = lost
+	 */
 	default:
 		return 0;
 	}
 
-	magicmouse_emit_buttons(msc, clicks & 3);
-	input_report_rel(input, REL_X, x);
-	input_report_rel(input, REL_Y, y);
+	magicmouse_emit_buttons(msc, r.buttons);
+	input_report_rel(input, REL_X, r.dx);
+	input_report_rel(input, REL_Y, r.dy);
 	input_sync(input);
 	return 1;
 }
@@ -359,7 +335,7 @@ static int magicmouse_probe(struct hid_device *hdev,
 		goto err_free;
 	}
 
-	report = hid_register_report(hdev, HID_INPUT_REPORT, TOUCH_REPORT_ID);
+	report = hid_register_report(hdev, HID_INPUT_REPORT, MAGICMOUSE_TOUCH_ID);
 	if (!report) {
 		dev_err(&hdev->dev, "unable to register touch report\n");
 		ret = -ENOMEM;
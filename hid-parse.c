@@ -23,18 +23,19 @@
 
 #include <ctype.h>     /* isspace() */
 #include <errno.h>     /* errno, EINPROGRESS */
+#include <getopt.h>    /* getopt_long() */
 #include <inttypes.h>  /* sized integer types *and formatting* */
+#include <stdarg.h>    /* va_list, etc. */
 #include <stdio.h>     /* fprintf(), stdout */
 #include <stdlib.h>    /* EXIT_SUCCESS, EXIT_FAILURE */
 #include <string.h>    /* strerror() */
 #include <unistd.h>    /* getopt(), etc. */
 
-/* Lookup tables. */
-struct indexed_item {
-        const char *name;
-        unsigned int value;
-};
+#include "hid-desc.h"
+#include "hid-report.h"
+#include "hid-usages.h"
 
+/* Lookup tables. */
 static const char *main_input_names[] = {
         "Constant",
         "Variable",
@@ -74,49 +75,49 @@ static const char *main_feature_names[] = {
         NULL
 };
 
-static const struct indexed_item main_collection_names[] = {
-        { "Physical", 0 },
-        { "Application", 1 },
-        { "Logical", 2 },
-        { "Report", 3 },
-        { "Named Array", 4 },
-        { "Usage Switch", 5 },
-        { "Usage Modifier", 6 },
-        { NULL, 0 }
+/* Collection types, indexed by the item's data. */
+static const char *const main_collection_names[] = {
+        "Physical",
+        "Application",
+        "Logical",
+        "Report",
+        "Named Array",
+        "Usage Switch",
+        "Usage Modifier",
 };
 
-static const struct indexed_item tag_formats[] = {
-        { "Usage Page (%#x)",      0x04 },
-        { "Usage (%#x)",           0x08 },
-        { "Logical Minimum (%d)",  0x14 },
-        { "Usage Minimum (%d)",    0x18 },
-        { "Logical Maximum (%d)",  0x24 },
-        { "Usage Maximum (%d)",    0x28 },
-        { "Physical Minimum (%d)", 0x34 },
-        { "Designator Index (%d)", 0x38 },
-        { "Physical Maximum (%d)", 0x44 },
-        { "Designator Minimum (%d)", 0x48 },
-        { "Unit Exponent (%d)",    0x54 },
-        { "Designator Maximum (%d)", 0x58 },
-        { "Unit (%#x)",            0x64 },
-        { "Report Size (%d)",      0x74 },
-        { "String Index (%d)",     0x78 },
-        { "Report ID (%#x)",       0x84 },
-        { "String Minimum (%d)",   0x88 },
-        { "Report Count (%d)",     0x94 },
-        { "String Maximum (%d)",   0x98 },
-        { "Push (%d)",             0xa4 },
-        { "Delimiter (%d)",        0xa8 },
-        { "Pop (%d)",              0xb4 },
-        { "End Collection",        0xc0 },
-        { NULL, 0 }
+/* Formats for the other short items, indexed by (tag >> 2). */
+static const char *const tag_formats[64] = {
+        [0x04 >> 2] = "Usage Page (%#x)",
+        [0x08 >> 2] = "Usage (%#x)",
+        [0x14 >> 2] = "Logical Minimum (%d)",
+        [0x18 >> 2] = "Usage Minimum (%d)",
+        [0x24 >> 2] = "Logical Maximum (%d)",
+        [0x28 >> 2] = "Usage Maximum (%d)",
+        [0x34 >> 2] = "Physical Minimum (%d)",
+        [0x38 >> 2] = "Designator Index (%d)",
+        [0x44 >> 2] = "Physical Maximum (%d)",
+        [0x48 >> 2] = "Designator Minimum (%d)",
+        [0x54 >> 2] = "Unit Exponent (%d)",
+        [0x58 >> 2] = "Designator Maximum (%d)",
+        [0x64 >> 2] = "Unit (%#x)",
+        [0x74 >> 2] = "Report Size (%d)",
+        [0x78 >> 2] = "String Index (%d)",
+        [0x84 >> 2] = "Report ID (%#x)",
+        [0x88 >> 2] = "String Minimum (%d)",
+        [0x94 >> 2] = "Report Count (%d)",
+        [0x98 >> 2] = "String Maximum (%d)",
+        [0xa4 >> 2] = "Push (%d)",
+        [0xa8 >> 2] = "Delimiter (%d)",
+        [0xb4 >> 2] = "Pop (%d)",
+        [0xc0 >> 2] = "End Collection",
 };
 
 /* Formatting and parsing functions. */
 
 unsigned char hextab[256];
-unsigned char data[65536];
-int length;
+int split_blank;
+int length_prefixed;
 
 void init_hex(void)
 {
@@ -134,22 +135,30 @@ unsigned char fromhex(char ch)
         return hextab[(unsigned char)ch];
 }
 
-void parse_line(const char line[])
+/* Converts each pair of hex digits in line to a byte in out[], and
+ * returns the number of bytes, or -1 if the line has nothing but
+ * whitespace.
+ */
+int parse_line(const char line[], unsigned char out[])
 {
+        int blank;
+        int count;
         int jj;
 
-        for (jj = 0; line[jj] != '\0'; jj++) {
-                while (isspace(line[jj])) {
-                        jj++;
-                }
-
+        for (jj = count = 0, blank = 1; line[jj] != '\0'; ) {
                 if (isxdigit(line[jj+0]) && isxdigit(line[jj+1])) {
-                        data[length++] = 0
-                                | (hextab[(unsigned char)line[jj+0]] << 4)
-                                | (hextab[(unsigned char)line[jj+1]] << 0)
+                        out[count++] = 0
+                                | (fromhex(line[jj+0]) << 4)
+                                | (fromhex(line[jj+1]) << 0)
                                 ;
+                        jj += 2;
+                } else {
+                        blank &= isspace(line[jj]) != 0;
+                        jj++;
                 }
         }
+
+        return (count == 0 && blank) ? -1 : count;
 }
 
 void print_bitfield(const char *class, const char *names[], unsigned int data)
@@ -176,140 +185,540 @@ void print_bitfield(const char *class, const char *names[], unsigned int data)
         fputs(")", stdout);
 }
 
-const char *find_indexed(unsigned int data, const struct indexed_item items[])
+void print_collection(unsigned int data)
 {
+        fputs("Collection (", stdout);
+        if (data < ARRAY_SIZE(main_collection_names)) {
+                fputs(main_collection_names[data], stdout);
+        } else if (data >= 0x80 && data <= 0xff) {
+                fprintf(stdout, "Vendor Defined (%#x)", data);
+        } else {
+                fprintf(stdout, "Reserved (%d)", data);
+        }
+        fputs(")", stdout);
+}
+
+/* Prints a Usage, Usage Minimum or Usage Maximum by name, if it has
+ * one.  Returns non-zero if it did.
+ */
+int print_usage(const char *class, const struct hid_parser *p, const struct hid_item *item)
+{
+        const char *name;
+        char buf[32];
+        uint32_t usage;
+
+        usage = item->udata;
+        if (item->size < 4) {
+                usage |= p->global.usage_page << 16;
+        }
+        name = hid_usage_name(usage, buf, sizeof(buf));
+        if (name == NULL) {
+                return 0;
+        }
+        if (item->size < 4) {
+                fprintf(stdout, "%s (%s)", class, name);
+        } else {
+                fprintf(stdout, "%s (%s: %s)", class,
+                        hid_find_usage_page(usage >> 16)->name, name);
+        }
+        return 1;
+}
+
+/* Prints a Usage Page by name, if it has one.  Returns non-zero if
+ * it did.
+ */
+int print_usage_page(const struct hid_item *item)
+{
+        const struct hid_usage_page *page;
+
+        page = hid_find_usage_page(item->udata);
+        if (page == NULL) {
+                return 0;
+        }
+        if (page == &hid_usage_page_vendor) {
+                fprintf(stdout, "Usage Page (Vendor Defined %#x)", item->udata);
+        } else {
+                fprintf(stdout, "Usage Page (%s)", page->name);
+        }
+        return 1;
+}
+
+/* Pretty-printer state, passed as hid_parser::ctx. */
+struct printer {
+        int indent;
+        int items;
+        int pending_nul;
+};
+
+void print_separator(struct printer *pr)
+{
+        if (pr->items++ > 0) {
+                fprintf(stdout, ",\n");
+        }
+}
+
+void print_long_item(const struct hid_item *item)
+{
+        static const char hexdigits[] = "0123456789abcdef";
         int ii;
 
-        for (ii = 0; items[ii].name != NULL; ii++) {
-                if (items[ii].value == data) {
-                        break;
+        fprintf(stdout, "Long Item (tag=%#x, %d bytes", item->tag, item->size);
+        for (ii = 0; ii < item->size; ii++) {
+                fputs(ii ? " " : ": ", stdout);
+                fputc(hexdigits[item->long_data[ii] >> 4], stdout);
+                fputc(hexdigits[item->long_data[ii] & 15], stdout);
+        }
+        fputs(")", stdout);
+}
+
+int print_item(struct hid_parser *p, const struct hid_item *item)
+{
+        struct printer *pr = p->ctx;
+        const char *fmt;
+
+        /* Apple Magic Mouse descriptor ends with null byte, so hold
+         * back a null item until we see what follows it.  Otherwise,
+         * put a comma and newline between items.
+         */
+        if (pr->pending_nul) {
+                pr->pending_nul = 0;
+                print_separator(pr);
+                fprintf(stdout, "%*sReserved tag (0, data=0)", pr->indent, "");
+        }
+        if (item->prefix == 0) {
+                pr->pending_nul = 1;
+                return 0;
+        }
+        print_separator(pr);
+
+        /* Indent appropriately. */
+        if (item->type == HID_ITEM_MAIN && item->tag == HID_MAIN_END_COLLECTION) {
+                pr->indent -= 2;
+        }
+        if (pr->indent > 0) {
+                fprintf(stdout, "%*s", pr->indent, " ");
+        }
+
+        if (item->type == HID_ITEM_LONG) {
+                print_long_item(item);
+                return 0;
+        }
+
+        /* What are we looking at here? */
+        switch (item->tag) {
+        case HID_MAIN_INPUT:
+                print_bitfield("Input", main_input_names, item->udata);
+                break;
+        case HID_MAIN_OUTPUT:
+                print_bitfield("Output", main_output_names, item->udata);
+                break;
+        case HID_MAIN_COLLECTION:
+                print_collection(item->udata);
+                pr->indent += 2;
+                break;
+        case HID_MAIN_FEATURE:
+                print_bitfield("Feature", main_feature_names, item->udata);
+                break;
+        case HID_GLOBAL_USAGE_PAGE:
+                if (!print_usage_page(item)) {
+                        fprintf(stdout, tag_formats[item->tag >> 2], item->udata);
+                }
+                break;
+        case HID_LOCAL_USAGE:
+                if (!print_usage("Usage", p, item)) {
+                        fprintf(stdout, tag_formats[item->tag >> 2], item->udata);
+                }
+                break;
+        case HID_LOCAL_USAGE_MIN:
+                if (!print_usage("Usage Minimum", p, item)) {
+                        fprintf(stdout, tag_formats[item->tag >> 2], item->udata);
+                }
+                break;
+        case HID_LOCAL_USAGE_MAX:
+                if (!print_usage("Usage Maximum", p, item)) {
+                        fprintf(stdout, tag_formats[item->tag >> 2], item->udata);
+                }
+                break;
+        default:
+                fmt = tag_formats[item->tag >> 2];
+                if (fmt != NULL) {
+                        fprintf(stdout, fmt, item->udata);
+                } else {
+                        fprintf(stdout, "Reserved tag (%#x, data=%#x)", item->prefix, item->udata);
                 }
         }
 
-        return items[ii].name;
+        return 0;
 }
 
-void print_indexed(const char *class, const struct indexed_item items[], unsigned int data)
+int print_error(struct hid_parser *p, int err, const struct hid_item *item)
 {
-        const char *name;
+        (void)p;
+        fprintf(stderr, "Error at pos %u: %s\n", item->offset, hid_strerror(err));
+        return 0;
+}
 
-        fputs(class, stdout);
-        fputs(" (", stdout);
-        name = find_indexed(data, items);
-        if (name != NULL) {
-                fputs(name, stdout);
+static const struct hid_parse_ops print_ops = {
+        .item = print_item,
+        .error = print_error,
+};
+
+/* Validator state, passed as hid_parser::ctx. */
+struct validator {
+        struct hid_layout layout;
+        int errors;
+        int warnings;
+        int unnumbered;
+        int usage_min_pos;
+};
+
+static const char *const report_type_names[HID_REPORT_TYPES] = {
+        "Input", "Output", "Feature"
+};
+
+void validate_report(struct validator *v, const char *level, unsigned int pos, const char *fmt, ...)
+        __attribute__((format(printf, 4, 5)));
+
+void validate_report(struct validator *v, const char *level, unsigned int pos, const char *fmt, ...)
+{
+        va_list args;
+
+        if (level[0] == 'e') {
+                v->errors++;
         } else {
-                fprintf(stdout, "Reserved (%d)", data);
+                v->warnings++;
         }
-        fputs(")", stdout);
+        fprintf(stdout, "%s: pos %u: ", level, pos);
+        va_start(args, fmt);
+        vfprintf(stdout, fmt, args);
+        va_end(args);
+        fputc('\n', stdout);
 }
 
-void print_descriptor(void)
+int validate_item(struct hid_parser *p, const struct hid_item *item)
 {
-        const char *fmt;
-        int indent;
-        int ii;
-        int len;
+        struct validator *v = p->ctx;
 
-        for (ii = indent = 0; ii < length; ii += len) {
-                unsigned char tag = data[ii];
-                unsigned int param = 0;
+        if (item->type == HID_ITEM_RESERVED
+            || (item->type == HID_ITEM_MAIN && item->tag != 0 && item->tag > HID_MAIN_END_COLLECTION)) {
+                validate_report(v, "warning", item->offset, "reserved item %#x", item->prefix);
+        }
 
-                /* Apple Magic Mouse descriptor ends with null byte.
-                 * Otherwise, put a comma and newline between items
-                 */
-                if (tag == 0 && ii == length - 1) {
-                        break;
-                } else if (ii > 0) {
-                        fprintf(stdout, ",\n");
+        switch (item->type == HID_ITEM_LONG ? 0 : item->tag) {
+        case HID_GLOBAL_REPORT_ID:
+                if (item->udata == 0 || item->udata > 255) {
+                        validate_report(v, "error", item->offset, "Report ID %u is out of range", item->udata);
+                }
+                break;
+        case HID_GLOBAL_REPORT_SIZE:
+                if (item->udata > 32) {
+                        validate_report(v, "error", item->offset, "Report Size %u is wider than 32 bits", item->udata);
                 }
+                break;
+        case HID_LOCAL_USAGE_MIN:
+                v->usage_min_pos = item->offset + 1;
+                break;
+        case HID_LOCAL_USAGE_MAX:
+                if (v->usage_min_pos == 0) {
+                        validate_report(v, "warning", item->offset, "Usage Maximum without Usage Minimum");
+                } else if (p->local.usage_maximum < p->local.usage_minimum) {
+                        validate_report(v, "error", item->offset, "Usage Maximum is less than Usage Minimum");
+                }
+                v->usage_min_pos = 0;
+                break;
+        }
+
+        return 0;
+}
+
+int validate_main(struct hid_parser *p, const struct hid_item *item)
+{
+        struct validator *v = p->ctx;
+        const struct hid_report *r;
+        const struct hid_global *g = &p->global;
+        uint64_t bits;
+        int type;
+        int res;
+        int ii;
+
+        switch (item->tag) {
+        case HID_MAIN_INPUT: type = HID_REPORT_INPUT; break;
+        case HID_MAIN_OUTPUT: type = HID_REPORT_OUTPUT; break;
+        case HID_MAIN_FEATURE: type = HID_REPORT_FEATURE; break;
+        default: return 0;
+        }
+
+        if (v->usage_min_pos != 0) {
+                validate_report(v, "warning", v->usage_min_pos - 1, "Usage Minimum without Usage Maximum");
+                v->usage_min_pos = 0;
+        }
+        if (g->report_id == 0) {
+                v->unnumbered = 1;
+        }
+        if (v->unnumbered && (v->layout.numbered || g->report_id != 0)) {
+                validate_report(v, "error", item->offset, "%s item without a Report ID in a descriptor that uses them",
+                                report_type_names[type]);
+                v->unnumbered = 0;
+        }
+        if (g->report_count > 0 && g->report_size == 0) {
+                validate_report(v, "warning", item->offset, "%s item with Report Size 0", report_type_names[type]);
+        }
+        if (!(item->udata & HID_FIELD_CONSTANT) && g->logical_minimum > g->logical_maximum
+            && !(g->logical_minimum >= 0 && (uint32_t)g->logical_maximum > (uint32_t)g->logical_minimum)) {
+                validate_report(v, "error", item->offset, "Logical Minimum %d exceeds Logical Maximum %d",
+                                g->logical_minimum, g->logical_maximum);
+        }
+
+        /* Would this overflow the report's 32-bit size? */
+        r = hid_find_report(&v->layout, type, g->report_id);
+        bits = (uint64_t)g->report_size * g->report_count + (r ? r->bits : 0);
+        if (bits > UINT32_MAX) {
+                validate_report(v, "error", item->offset, "%s report %#x is over 2^32 bits long",
+                                report_type_names[type], g->report_id);
+                return 0;
+        }
 
-                /* Indent appropriately. */
-                if (tag == 0xc0) { /* End Collection */
-                        indent -= 2;
+        /* Is this report ID already used by a different type? */
+        if (r == NULL && g->report_id != 0) {
+                for (ii = 0; ii < HID_REPORT_TYPES; ii++) {
+                        if (hid_find_report(&v->layout, ii, g->report_id)) {
+                                validate_report(v, "warning", item->offset, "Report ID %#x is used for both %s and %s reports",
+                                                g->report_id, report_type_names[ii], report_type_names[type]);
+                        }
                 }
-                if (indent > 0) {
-                        fprintf(stdout, "%*s", indent, " ");
+        }
+
+        res = hid_layout_add(&v->layout, p, item);
+        if (res == HID_ERR_FIELD_TOO_LARGE) {
+                validate_report(v, "error", item->offset, "%s item has more than %u values",
+                                report_type_names[type], HID_MAX_REPORT_COUNT);
+        } else if (res) {
+                validate_report(v, "error", item->offset, "too many fields or reports to check");
+        }
+        return 0;
+}
+
+int validate_error(struct hid_parser *p, int err, const struct hid_item *item)
+{
+        validate_report(p->ctx, "error", item->offset, "%s", hid_strerror(err));
+        return 0;
+}
+
+static const struct hid_parse_ops validate_ops = {
+        .item = validate_item,
+        .main = validate_main,
+        .error = validate_error,
+};
+
+/* Prints what we learned about the descriptor.  Returns non-zero if
+ * it had errors.
+ */
+int validate_finish(struct hid_parser *p)
+{
+        struct validator *v = p->ctx;
+        const struct hid_report *r;
+        unsigned int ii;
+
+        if (p->collection_depth > 0) {
+                validate_report(v, "error", p->offset, "%u Collection(s) not closed", p->collection_depth);
+        }
+        if (p->stack_depth > 0) {
+                validate_report(v, "error", p->offset, "%u Push(es) without Pop", p->stack_depth);
+        }
+        if (p->local.usage_count > 0 || v->usage_min_pos != 0) {
+                validate_report(v, "warning", p->offset, "local items after the last main item");
+        }
+
+        for (ii = 0; ii < v->layout.report_count; ii++) {
+                r = &v->layout.report[ii];
+                fprintf(stdout, "%s report %#x: %u bytes\n", report_type_names[r->type],
+                        r->id, hid_report_bytes(&v->layout, r));
+        }
+        if (v->errors || v->warnings) {
+                fprintf(stdout, "%d error(s), %d warning(s)\n", v->errors, v->warnings);
+        } else {
+                fprintf(stdout, "valid\n");
+        }
+
+        return v->errors != 0;
+}
+
+/* The descriptor currently being printed or validated. */
+struct hid_parser parser;
+struct printer printer;
+struct validator validator;
+int in_descriptor;
+int validate;
+int failed;
+
+void begin_descriptor(void)
+{
+        if (!in_descriptor) {
+                if (validate) {
+                        memset(&validator, 0, sizeof(validator));
+                        hid_layout_init(&validator.layout);
+                        hid_parser_init(&parser, &validate_ops, &validator);
+                } else {
+                        memset(&printer, 0, sizeof(printer));
+                        hid_parser_init(&parser, &print_ops, &printer);
                 }
+                in_descriptor = 1;
+        }
+}
 
-                /* Bail if we see a long item. */
-                if (tag == 0xfe) {
-                        fprintf(stderr, "Long items (pos %d) not supported!\n", ii);
-                        len = 2 + data[ii + 1];
-                        continue;
+void feed_descriptor(const unsigned char data[], size_t length)
+{
+        begin_descriptor();
+        hid_parse_feed(&parser, data, length);
+}
+
+void end_descriptor(void)
+{
+        if (in_descriptor) {
+                hid_parse_finish(&parser);
+                if (validate) {
+                        failed |= validate_finish(&parser);
+                } else {
+                        fprintf(stdout, "\n");
                 }
+                fflush(stdout);
+                in_descriptor = 0;
+        }
+}
 
-                /* Get argument data. */
-                len = 1;
-                switch (tag & 3) {
-                case 3:
-                        param |= data[ii+4] << 24;
-                        param |= data[ii+3] << 16;
-                        len += 2;
-                case 2:
-                        param |= data[ii+2] << 8;
-                        len++;
-                case 1:
-                        param |= data[ii+1] << 0;
-                        len++;
+/* Reads hex text, one descriptor per file, or one per run of
+ * non-blank lines if split_blank is set.
+ */
+void read_hex(FILE *str)
+{
+        unsigned char bytes[2048];
+        char line[4096];
+        int count;
+
+        begin_descriptor();
+        while (fgets(line, sizeof(line), str) != NULL) {
+                count = parse_line(line, bytes);
+                if (count >= 0) {
+                        feed_descriptor(bytes, count);
+                } else if (split_blank) {
+                        end_descriptor();
                 }
+        }
+        end_descriptor();
+}
 
-                /* What are we looking at here? */
-                switch (tag & 0xfc) {
-                case 0x80:
-                        print_bitfield("Input", main_input_names, param);
-                        break;
-                case 0x90:
-                        print_bitfield("Output", main_output_names, param);
-                        break;
-                case 0xa0:
-                        print_indexed("Collection", main_collection_names, param);
-                        indent += 2;
-                        break;
-                case 0xb0:
-                        print_bitfield("Feature", main_feature_names, param);
+/* Reads binary descriptors, each preceded by its length as a 16-bit
+ * little-endian number, parsing each one as its bytes arrive.
+ */
+void read_prefixed(int fd, const char fname[])
+{
+        unsigned char buf[4096];
+        unsigned int remaining;
+        unsigned int prefix;
+        int have_prefix;
+        ssize_t res;
+        ssize_t pos;
+        size_t take;
+
+        remaining = prefix = have_prefix = 0;
+        while ((res = read(fd, buf, sizeof(buf))) != 0) {
+                if (res < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        fprintf(stderr, "Unable to read %s: %s\n", fname, strerror(errno));
                         break;
-                default:
-                        fmt = find_indexed(tag & 0xfc, tag_formats);
-                        if (fmt != NULL) {
-                                fprintf(stdout, fmt, param);
+                }
+                for (pos = 0; pos < res; ) {
+                        if (have_prefix < 2) {
+                                prefix |= buf[pos++] << (8 * have_prefix++);
+                                if (have_prefix == 2) {
+                                        remaining = prefix;
+                                        begin_descriptor();
+                                }
                         } else {
-                                fprintf(stdout, "Reserved tag (%#x, data=%#x)", tag, param);
+                                take = res - pos;
+                                if (take > remaining) {
+                                        take = remaining;
+                                }
+                                feed_descriptor(buf + pos, take);
+                                pos += take;
+                                remaining -= take;
+                        }
+                        if (have_prefix == 2 && remaining == 0) {
+                                end_descriptor();
+                                prefix = have_prefix = 0;
                         }
                 }
         }
-        fprintf(stdout, "\n");
+        if (have_prefix != 0) {
+                fprintf(stderr, "%s: descriptor truncated (%u of %u bytes missing)\n",
+                        fname, remaining, prefix);
+                end_descriptor();
+        }
 }
 
-int main(int argc, char *argv[])
+void read_file(const char fname[])
 {
-        char line[4096];
-        int ii;
+        FILE *str;
 
-        init_hex();
+        if (!strcmp(fname, "-")) {
+                str = stdin;
+        } else {
+                str = fopen(fname, "r");
+                if (str == NULL) {
+                        fprintf(stderr, "Unable to open %s: %s\n", fname, strerror(errno));
+                        return;
+                }
+        }
 
-        for (ii = optind; ii < argc; ++ii) {
-                const char *fname;
-                FILE *str;
+        if (length_prefixed) {
+                read_prefixed(fileno(str), fname);
+        } else {
+                read_hex(str);
+        }
 
-                fname = argv[ii];
-                if (!strcmp(fname, "-")) {
-                        str = stdin;
-                } else {
-                        str = fopen(fname, "r");
-                }
+        if (str != stdin) {
+                fclose(str);
+        }
+}
 
-                length = 0;
-                while (fgets(line, sizeof(line), str) != NULL) {
-                        parse_line(line);
-                }
+int main(int argc, char *argv[])
+{
+        static const struct option long_opts[] = {
+                { "length-prefixed", no_argument, NULL, 'l' },
+                { "split", no_argument, NULL, 's' },
+                { "validate", no_argument, NULL, 'v' },
+                { NULL, 0, NULL, 0 }
+        };
+        int opt;
+        int ii;
 
-                if (str != stdin) {
-                        fclose(str);
+        while ((opt = getopt_long(argc, argv, "lsv", long_opts, NULL)) != -1) {
+                switch (opt) {
+                case 'l':
+                        length_prefixed = 1;
+                        break;
+                case 's':
+                        split_blank = 1;
+                        break;
+                case 'v':
+                        validate = 1;
+                        break;
+                default:
+                        fprintf(stderr, "Usage:\n%s [-l | -s] [-v|--validate] [file ...]\n", argv[0]);
+                        return EXIT_FAILURE;
                 }
+        }
+
+        init_hex();
 
-                print_descriptor();
+        if (optind == argc) {
+                read_file("-");
+        }
+        for (ii = optind; ii < argc; ++ii) {
+                read_file(argv[ii]);
         }
 
-        return EXIT_SUCCESS;
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,344 @@
+/* Copyright 2010 Michael Poole.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* HID report layouts.
+ *
+ * hid_compile() runs a report descriptor through the parser in
+ * hid-desc.h and records where each Input, Output and Feature field
+ * lives in its report.  hid_decode_report() then uses that layout to
+ * pull values out of a report.  Like the parser, neither allocates
+ * memory: a layout is one fixed-size structure.
+ */
+
+#if !defined(HID_REPORT_H)
+#define HID_REPORT_H
+
+#include "hid-desc.h"
+
+/* Layout limits. */
+#define HID_MAX_FIELDS        256  /* Main items per descriptor */
+#define HID_MAX_REPORTS        64  /* (type, report ID) pairs */
+#define HID_MAX_FIELD_USAGES 1024  /* Usages kept across all fields */
+#define HID_MAX_REPORT_COUNT 12288  /* Values per field, as in Linux */
+
+/* Report types, in the order used by hid_layout::index. */
+#define HID_REPORT_INPUT   0
+#define HID_REPORT_OUTPUT  1
+#define HID_REPORT_FEATURE 2
+#define HID_REPORT_TYPES   3
+
+/* Bits from a main item's data. */
+#define HID_FIELD_CONSTANT 0x001
+#define HID_FIELD_VARIABLE 0x002
+#define HID_FIELD_RELATIVE 0x004
+
+/** One Input, Output or Feature main item. */
+struct hid_field {
+        /** Bit position of the first value, after any report ID. */
+        uint32_t bit_offset;
+        uint32_t report_size;
+        uint32_t report_count;
+        int32_t logical_minimum;
+        int32_t logical_maximum;
+        /** Usage range, used when hid_field::usage_count is zero. */
+        uint32_t usage_minimum;
+        uint32_t usage_maximum;
+        /** Index of this field's usages in hid_layout::usage. */
+        uint16_t usage_index;
+        uint16_t usage_count;
+        /** Main item data (HID_FIELD_* bits). */
+        uint16_t flags;
+        /** Index of the report in hid_layout::report. */
+        uint8_t report;
+};
+
+/** One report: fields with the same type and report ID. */
+struct hid_report {
+        uint8_t type;
+        uint8_t id;
+        /** Index of the first field in hid_layout::field. */
+        uint16_t first_field;
+        uint16_t field_count;
+        /** Total size of the fields in bits, excluding the ID. */
+        uint32_t bits;
+};
+
+/** A compiled report descriptor. */
+struct hid_layout {
+        /** Fields, sorted so each report's fields are contiguous. */
+        struct hid_field field[HID_MAX_FIELDS];
+        unsigned int field_count;
+        uint32_t usage[HID_MAX_FIELD_USAGES];
+        unsigned int usage_count;
+        struct hid_report report[HID_MAX_REPORTS];
+        unsigned int report_count;
+        /** Report index plus one for each (type, ID); zero if none. */
+        uint8_t index[HID_REPORT_TYPES][256];
+        /** Non-zero if the descriptor uses report IDs. */
+        int numbered;
+};
+
+/** Returns the size in bytes of report \a r on the wire, including
+ * the report ID byte if the descriptor uses them.
+ */
+static inline unsigned int hid_report_bytes(const struct hid_layout *l, const struct hid_report *r)
+{
+        return (r->bits + 7) / 8 + (l->numbered ? 1 : 0);
+}
+
+/** Returns the report with type \a type and ID \a id, or NULL. */
+static inline const struct hid_report *hid_find_report(const struct hid_layout *l, int type, unsigned int id)
+{
+        unsigned int idx;
+
+        if (type < 0 || type >= HID_REPORT_TYPES || id > 255) {
+                return NULL;
+        }
+        idx = l->index[type][id];
+        return idx ? &l->report[idx - 1] : NULL;
+}
+
+static inline void hid_layout_init(struct hid_layout *l)
+{
+        l->field_count = l->usage_count = l->report_count = 0;
+        l->numbered = 0;
+        memset(l->index, 0, sizeof(l->index));
+}
+
+/** Adds the field for main item \a item, as described by \a p's
+ * current state, to \a l.  Collection and End Collection items are
+ * ignored.  Returns zero on success, HID_ERR_LAYOUT_FULL or
+ * HID_ERR_FIELD_TOO_LARGE.
+ */
+static inline int hid_layout_add(struct hid_layout *l, const struct hid_parser *p, const struct hid_item *item)
+{
+        struct hid_report *r;
+        struct hid_field *f;
+        unsigned int idx;
+        uint64_t bits;
+        int type;
+
+        switch (item->tag) {
+        case HID_MAIN_INPUT: type = HID_REPORT_INPUT; break;
+        case HID_MAIN_OUTPUT: type = HID_REPORT_OUTPUT; break;
+        case HID_MAIN_FEATURE: type = HID_REPORT_FEATURE; break;
+        default: return 0;
+        }
+
+        if (p->global.report_id != 0) {
+                l->numbered = 1;
+        }
+        if (p->global.report_id > 255 || l->field_count >= HID_MAX_FIELDS
+            || l->usage_count + p->local.usage_count > HID_MAX_FIELD_USAGES) {
+                return HID_ERR_LAYOUT_FULL;
+        }
+        idx = l->index[type][p->global.report_id];
+        bits = (uint64_t)p->global.report_size * p->global.report_count
+                + (idx ? l->report[idx - 1].bits : 0);
+        if (p->global.report_count > HID_MAX_REPORT_COUNT || bits > UINT32_MAX) {
+                return HID_ERR_FIELD_TOO_LARGE;
+        }
+        if (idx == 0) {
+                if (l->report_count >= HID_MAX_REPORTS) {
+                        return HID_ERR_LAYOUT_FULL;
+                }
+                r = &l->report[l->report_count++];
+                r->type = type;
+                r->id = p->global.report_id;
+                r->first_field = 0;
+                r->field_count = 0;
+                r->bits = 0;
+                idx = l->index[type][r->id] = l->report_count;
+        }
+        r = &l->report[idx - 1];
+
+        f = &l->field[l->field_count++];
+        f->bit_offset = r->bits;
+        f->report_size = p->global.report_size;
+        f->report_count = p->global.report_count;
+        f->logical_minimum = p->global.logical_minimum;
+        f->logical_maximum = p->global.logical_maximum;
+        f->usage_minimum = p->local.usage_minimum;
+        f->usage_maximum = p->local.usage_maximum;
+        f->usage_index = l->usage_count;
+        f->usage_count = p->local.usage_count;
+        f->flags = item->udata;
+        f->report = idx - 1;
+        memcpy(l->usage + l->usage_count, p->local.usage,
+               p->local.usage_count * sizeof(l->usage[0]));
+        l->usage_count += p->local.usage_count;
+
+        r->bits += f->report_size * f->report_count;
+        r->field_count++;
+        return 0;
+}
+
+static inline int hid_compile_main(struct hid_parser *p, const struct hid_item *item)
+{
+        return hid_layout_add(p->ctx, p, item);
+}
+
+/** Compiles a report descriptor into \a l.  Returns zero on success,
+ * HID_ERR_LAYOUT_FULL if the descriptor has too many fields, reports
+ * or usages, HID_ERR_FIELD_TOO_LARGE if a field or report is too big,
+ * or another HID_ERR_* code from the parser.
+ */
+static inline int hid_compile(struct hid_layout *l, const unsigned char desc[], size_t length)
+{
+        static const struct hid_parse_ops compile_ops = {
+                .main = hid_compile_main,
+        };
+        struct hid_parser parser;
+        struct hid_field tmp;
+        unsigned int ii;
+        unsigned int jj;
+        int res;
+
+        hid_layout_init(l);
+        hid_parser_init(&parser, &compile_ops, l);
+        res = hid_parse(&parser, desc, length);
+        if (res) {
+                return res;
+        }
+
+        /* Group each report's fields together, keeping their order.
+         * Descriptors usually list a report's fields together, so
+         * this insertion sort rarely moves anything.
+         */
+        for (ii = 1; ii < l->field_count; ii++) {
+                tmp = l->field[ii];
+                for (jj = ii; jj > 0 && l->field[jj - 1].report > tmp.report; jj--) {
+                        l->field[jj] = l->field[jj - 1];
+                }
+                l->field[jj] = tmp;
+        }
+        for (ii = l->field_count; ii-- > 0; ) {
+                l->report[l->field[ii].report].first_field = ii;
+        }
+
+        return 0;
+}
+
+/** Extracts the \a size-bit value at bit \a offset of \a data, which
+ * is \a length bytes long.  Bits past the end read as zero.
+ */
+static inline uint32_t hid_extract(const unsigned char data[], size_t length, uint32_t offset, uint32_t size)
+{
+        uint64_t v;
+        size_t pos;
+        int ii;
+
+        pos = offset >> 3;
+        if (pos + 8 <= length) {
+                /* Fast path: load eight bytes at once. */
+                v = 0;
+                for (ii = 7; ii >= 0; ii--) {
+                        v = (v << 8) | data[pos + ii];
+                }
+        } else {
+                v = 0;
+                for (ii = 7; ii >= 0; ii--) {
+                        v <<= 8;
+                        if (pos + ii < length) {
+                                v |= data[pos + ii];
+                        }
+                }
+        }
+        v >>= offset & 7;
+        return size >= 32 ? (uint32_t)v : (uint32_t)(v & ((1u << size) - 1));
+}
+
+/** Called by hid_decode_report() for each value in a report. */
+typedef void (*hid_value_fn)(void *ctx, const struct hid_field *f, uint32_t usage, int32_t value);
+
+/** Decodes one report of type \a type (HID_REPORT_*), starting with
+ * its report ID byte if the descriptor uses them.  Calls \a fn for
+ * each value.  Returns the number of values decoded, or -1 if the
+ * report is not in the layout or is too short.
+ */
+static inline int hid_decode_report(const struct hid_layout *l, int type,
+                                    const unsigned char data[], size_t length,
+                                    hid_value_fn fn, void *ctx)
+{
+        const struct hid_report *r;
+        const struct hid_field *f;
+        unsigned int ii;
+        uint32_t usage;
+        uint32_t sel;
+        uint32_t jj;
+        uint32_t raw;
+        int32_t value;
+        int count;
+
+        if (l->numbered) {
+                if (length < 1) {
+                        return -1;
+                }
+                r = hid_find_report(l, type, data[0]);
+                data++;
+                length--;
+        } else {
+                r = hid_find_report(l, type, 0);
+        }
+        if (r == NULL || length < (r->bits + 7) / 8) {
+                return -1;
+        }
+
+        count = 0;
+        for (ii = 0; ii < r->field_count; ii++) {
+                f = &l->field[r->first_field + ii];
+                if (f->flags & HID_FIELD_CONSTANT) {
+                        continue;
+                }
+                for (jj = 0; jj < f->report_count; jj++) {
+                        raw = hid_extract(data, length, f->bit_offset + jj * f->report_size, f->report_size);
+                        value = raw;
+                        if (f->logical_minimum < 0 && f->report_size > 0 && f->report_size < 32) {
+                                value = (int32_t)(raw << (32 - f->report_size)) >> (32 - f->report_size);
+                        }
+                        if (!(f->flags & HID_FIELD_VARIABLE)) {
+                                /* Array: the value selects a usage. */
+                                usage = f->usage_minimum + (value - f->logical_minimum);
+                                if (f->usage_count > 0) {
+                                        sel = value - f->logical_minimum;
+                                        usage = sel < f->usage_count ? l->usage[f->usage_index + sel] : 0;
+                                }
+                        } else if (jj < f->usage_count) {
+                                usage = l->usage[f->usage_index + jj];
+                        } else if (f->usage_count > 0) {
+                                usage = l->usage[f->usage_index + f->usage_count - 1];
+                        } else {
+                                usage = f->usage_minimum + jj;
+                                if (usage > f->usage_maximum) {
+                                        usage = f->usage_maximum;
+                                }
+                        }
+                        fn(ctx, f, usage, value);
+                        count++;
+                }
+        }
+
+        return count;
+}
+
+#endif /* !defined(HID_REPORT_H) */
@@ -0,0 +1,1269 @@
+/* Copyright 2010 Michael Poole.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* HID Usage Tables: names for usage pages and the usages within them.
+ *
+ * Lookups are two direct array indexes: the usage page selects an
+ * entry in hid_usage_pages[] (vendor-defined pages 0xff00-0xffff and
+ * the FIDO page are special-cased), and the usage ID selects a name
+ * in that page's table.  Pages whose usages are just numbers (Button,
+ * Ordinal, Unicode, ...) carry a format string instead of a table.
+ * Pages that are listed with a NULL table only have their own name
+ * here.
+ */
+
+#if !defined(HID_USAGES_H)
+#define HID_USAGES_H
+
+#include <stddef.h>    /* size_t */
+#include <stdint.h>    /* sized integer types */
+#include <stdio.h>     /* snprintf() */
+
+#if !defined(ARRAY_SIZE)
+# define ARRAY_SIZE(ARR) (sizeof(ARR) / sizeof((ARR)[0]))
+#endif
+
+struct hid_usage_page {
+        /** Name of the usage page, or NULL if it is reserved. */
+        const char *name;
+        /** Usage names, indexed by usage ID; entries may be NULL. */
+        const char *const *usages;
+        /** Number of entries in hid_usage_page::usages. */
+        unsigned int count;
+        /** For ordinal pages, printf() format for a usage ID. */
+        const char *ordinal;
+};
+
+static const char *const hid_usages_generic_desktop[] = {
+        [0x01] = "Pointer",
+        [0x02] = "Mouse",
+        [0x04] = "Joystick",
+        [0x05] = "Gamepad",
+        [0x06] = "Keyboard",
+        [0x07] = "Keypad",
+        [0x08] = "Multi-axis Controller",
+        [0x09] = "Tablet PC System Controls",
+        [0x0a] = "Water Cooling Device",
+        [0x0b] = "Computer Chassis Device",
+        [0x0c] = "Wireless Radio Controls",
+        [0x0d] = "Portable Device Control",
+        [0x0e] = "System Multi-Axis Controller",
+        [0x0f] = "Spatial Controller",
+        [0x10] = "Assistive Control",
+        [0x11] = "Device Dock",
+        [0x12] = "Dockable Device",
+        [0x13] = "Call State Management Control",
+        [0x30] = "X",
+        [0x31] = "Y",
+        [0x32] = "Z",
+        [0x33] = "Rx",
+        [0x34] = "Ry",
+        [0x35] = "Rz",
+        [0x36] = "Slider",
+        [0x37] = "Dial",
+        [0x38] = "Wheel",
+        [0x39] = "Hat Switch",
+        [0x3a] = "Counted Buffer",
+        [0x3b] = "Byte Count",
+        [0x3c] = "Motion Wakeup",
+        [0x3d] = "Start",
+        [0x3e] = "Select",
+        [0x40] = "Vx",
+        [0x41] = "Vy",
+        [0x42] = "Vz",
+        [0x43] = "Vbrx",
+        [0x44] = "Vbry",
+        [0x45] = "Vbrz",
+        [0x46] = "Vno",
+        [0x47] = "Feature Notification",
+        [0x48] = "Resolution Multiplier",
+        [0x49] = "Qx",
+        [0x4a] = "Qy",
+        [0x4b] = "Qz",
+        [0x4c] = "Qw",
+        [0x80] = "System Control",
+        [0x81] = "System Power Down",
+        [0x82] = "System Sleep",
+        [0x83] = "System Wake Up",
+        [0x84] = "System Context Menu",
+        [0x85] = "System Main Menu",
+        [0x86] = "System App Menu",
+        [0x87] = "System Menu Help",
+        [0x88] = "System Menu Exit",
+        [0x89] = "System Menu Select",
+        [0x8a] = "System Menu Right",
+        [0x8b] = "System Menu Left",
+        [0x8c] = "System Menu Up",
+        [0x8d] = "System Menu Down",
+        [0x8e] = "System Cold Restart",
+        [0x8f] = "System Warm Restart",
+        [0x90] = "D-pad Up",
+        [0x91] = "D-pad Down",
+        [0x92] = "D-pad Right",
+        [0x93] = "D-pad Left",
+        [0x94] = "Index Trigger",
+        [0x95] = "Palm Trigger",
+        [0x96] = "Thumbstick",
+        [0x97] = "System Function Shift",
+        [0x98] = "System Function Shift Lock",
+        [0x99] = "System Function Shift Lock Indicator",
+        [0x9a] = "System Dismiss Notification",
+        [0x9b] = "System Do Not Disturb",
+        [0xa0] = "System Dock",
+        [0xa1] = "System Undock",
+        [0xa2] = "System Setup",
+        [0xa3] = "System Break",
+        [0xa4] = "System Debugger Break",
+        [0xa5] = "Application Break",
+        [0xa6] = "Application Debugger Break",
+        [0xa7] = "System Speaker Mute",
+        [0xa8] = "System Hibernate",
+        [0xb0] = "System Display Invert",
+        [0xb1] = "System Display Internal",
+        [0xb2] = "System Display External",
+        [0xb3] = "System Display Both",
+        [0xb4] = "System Display Dual",
+        [0xb5] = "System Display Toggle Int/Ext Mode",
+        [0xb6] = "System Display Swap Primary/Secondary",
+        [0xb7] = "System Display Toggle LCD Autoscale",
+        [0xc0] = "Sensor Zone",
+        [0xc1] = "RPM",
+        [0xc2] = "Coolant Level",
+        [0xc3] = "Coolant Critical Level",
+        [0xc4] = "Coolant Pump",
+        [0xc5] = "Chassis Enclosure",
+        [0xc6] = "Wireless Radio Button",
+        [0xc7] = "Wireless Radio LED",
+        [0xc8] = "Wireless Radio Slider Switch",
+        [0xc9] = "System Display Rotation Lock Button",
+        [0xca] = "System Display Rotation Lock Slider Switch",
+        [0xcb] = "Control Enable",
+        [0xd0] = "Dockable Device Unique ID",
+        [0xd1] = "Dockable Device Vendor ID",
+        [0xd2] = "Dockable Device Primary Usage Page",
+        [0xd3] = "Dockable Device Primary Usage ID",
+        [0xd4] = "Dockable Device Docking State",
+        [0xd5] = "Dockable Device Display Occlusion",
+        [0xd6] = "Dockable Device Object Type",
+};
+
+static const char *const hid_usages_simulation[] = {
+        [0x01] = "Flight Simulation Device",
+        [0x02] = "Automobile Simulation Device",
+        [0x03] = "Tank Simulation Device",
+        [0x04] = "Spaceship Simulation Device",
+        [0x05] = "Submarine Simulation Device",
+        [0x06] = "Sailing Simulation Device",
+        [0x07] = "Motorcycle Simulation Device",
+        [0x08] = "Sports Simulation Device",
+        [0x09] = "Airplane Simulation Device",
+        [0x0a] = "Helicopter Simulation Device",
+        [0x0b] = "Magic Carpet Simulation Device",
+        [0x0c] = "Bicycle Simulation Device",
+        [0x20] = "Flight Control Stick",
+        [0x21] = "Flight Stick",
+        [0x22] = "Cyclic Control",
+        [0x23] = "Cyclic Trim",
+        [0x24] = "Flight Yoke",
+        [0x25] = "Track Control",
+        [0xb0] = "Aileron",
+        [0xb1] = "Aileron Trim",
+        [0xb2] = "Anti-Torque Control",
+        [0xb3] = "Autopilot Enable",
+        [0xb4] = "Chaff Release",
+        [0xb5] = "Collective Control",
+        [0xb6] = "Dive Brake",
+        [0xb7] = "Electronic Countermeasures",
+        [0xb8] = "Elevator",
+        [0xb9] = "Elevator Trim",
+        [0xba] = "Rudder",
+        [0xbb] = "Throttle",
+        [0xbc] = "Flight Communications",
+        [0xbd] = "Flare Release",
+        [0xbe] = "Landing Gear",
+        [0xbf] = "Toe Brake",
+        [0xc0] = "Trigger",
+        [0xc1] = "Weapons Arm",
+        [0xc2] = "Weapons Select",
+        [0xc3] = "Wing Flaps",
+        [0xc4] = "Accelerator",
+        [0xc5] = "Brake",
+        [0xc6] = "Clutch",
+        [0xc7] = "Shifter",
+        [0xc8] = "Steering",
+        [0xc9] = "Turret Direction",
+        [0xca] = "Barrel Elevation",
+        [0xcb] = "Dive Plane",
+        [0xcc] = "Ballast",
+        [0xcd] = "Bicycle Crank",
+        [0xce] = "Handle Bars",
+        [0xcf] = "Front Brake",
+        [0xd0] = "Rear Brake",
+};
+
+static const char *const hid_usages_vr[] = {
+        [0x01] = "Belt",
+        [0x02] = "Body Suit",
+        [0x03] = "Flexor",
+        [0x04] = "Glove",
+        [0x05] = "Head Tracker",
+        [0x06] = "Head Mounted Display",
+        [0x07] = "Hand Tracker",
+        [0x08] = "Oculometer",
+        [0x09] = "Vest",
+        [0x0a] = "Animatronic Device",
+        [0x20] = "Stereo Enable",
+        [0x21] = "Display Enable",
+};
+
+static const char *const hid_usages_sport[] = {
+        [0x01] = "Baseball Bat",
+        [0x02] = "Golf Club",
+        [0x03] = "Rowing Machine",
+        [0x04] = "Treadmill",
+        [0x30] = "Oar",
+        [0x31] = "Slope",
+        [0x32] = "Rate",
+        [0x33] = "Stick Speed",
+        [0x34] = "Stick Face Angle",
+        [0x35] = "Stick Heel/Toe",
+        [0x36] = "Stick Follow Through",
+        [0x37] = "Stick Tempo",
+        [0x38] = "Stick Type",
+        [0x39] = "Stick Height",
+        [0x50] = "Putter",
+        [0x51] = "1 Iron",
+        [0x52] = "2 Iron",
+        [0x53] = "3 Iron",
+        [0x54] = "4 Iron",
+        [0x55] = "5 Iron",
+        [0x56] = "6 Iron",
+        [0x57] = "7 Iron",
+        [0x58] = "8 Iron",
+        [0x59] = "9 Iron",
+        [0x5a] = "10 Iron",
+        [0x5b] = "11 Iron",
+        [0x5c] = "Sand Wedge",
+        [0x5d] = "Loft Wedge",
+        [0x5e] = "Power Wedge",
+        [0x5f] = "1 Wood",
+        [0x60] = "3 Wood",
+        [0x61] = "5 Wood",
+        [0x62] = "7 Wood",
+        [0x63] = "9 Wood",
+};
+
+static const char *const hid_usages_game[] = {
+        [0x01] = "3D Game Controller",
+        [0x02] = "Pinball Device",
+        [0x03] = "Gun Device",
+        [0x20] = "Point of View",
+        [0x21] = "Turn Right/Left",
+        [0x22] = "Pitch Forward/Backward",
+        [0x23] = "Roll Right/Left",
+        [0x24] = "Move Right/Left",
+        [0x25] = "Move Forward/Backward",
+        [0x26] = "Move Up/Down",
+        [0x27] = "Lean Right/Left",
+        [0x28] = "Lean Forward/Backward",
+        [0x29] = "Height of POV",
+        [0x2a] = "Flipper",
+        [0x2b] = "Secondary Flipper",
+        [0x2c] = "Bump",
+        [0x2d] = "New Game",
+        [0x2e] = "Shoot Ball",
+        [0x2f] = "Player",
+        [0x30] = "Gun Bolt",
+        [0x31] = "Gun Clip",
+        [0x32] = "Gun Selector",
+        [0x33] = "Gun Single Shot",
+        [0x34] = "Gun Burst",
+        [0x35] = "Gun Automatic",
+        [0x36] = "Gun Safety",
+        [0x37] = "Gamepad Fire/Jump",
+        [0x39] = "Gamepad Trigger",
+        [0x3a] = "Form-fitting Gamepad",
+};
+
+static const char *const hid_usages_generic_device[] = {
+        [0x01] = "Background/Nonuser Controls",
+        [0x20] = "Battery Strength",
+        [0x21] = "Wireless Channel",
+        [0x22] = "Wireless ID",
+        [0x23] = "Discover Wireless Control",
+        [0x24] = "Security Code Character Entered",
+        [0x25] = "Security Code Character Erased",
+        [0x26] = "Security Code Cleared",
+        [0x27] = "Sequence ID",
+        [0x28] = "Sequence ID Reset",
+        [0x29] = "RF Signal Strength",
+        [0x2a] = "Software Version",
+        [0x2b] = "Protocol Version",
+        [0x2c] = "Hardware Version",
+        [0x2d] = "Major",
+        [0x2e] = "Minor",
+        [0x2f] = "Revision",
+        [0x30] = "Handedness",
+        [0x31] = "Either Hand",
+        [0x32] = "Left Hand",
+        [0x33] = "Right Hand",
+        [0x34] = "Both Hands",
+        [0x40] = "Grip Pose Offset",
+        [0x41] = "Pointer Pose Offset",
+};
+
+static const char *const hid_usages_keyboard[] = {
+        [0x01] = "ErrorRollOver",
+        [0x02] = "POSTFail",
+        [0x03] = "ErrorUndefined",
+        [0x04] = "Keyboard a",
+        [0x05] = "Keyboard b",
+        [0x06] = "Keyboard c",
+        [0x07] = "Keyboard d",
+        [0x08] = "Keyboard e",
+        [0x09] = "Keyboard f",
+        [0x0a] = "Keyboard g",
+        [0x0b] = "Keyboard h",
+        [0x0c] = "Keyboard i",
+        [0x0d] = "Keyboard j",
+        [0x0e] = "Keyboard k",
+        [0x0f] = "Keyboard l",
+        [0x10] = "Keyboard m",
+        [0x11] = "Keyboard n",
+        [0x12] = "Keyboard o",
+        [0x13] = "Keyboard p",
+        [0x14] = "Keyboard q",
+        [0x15] = "Keyboard r",
+        [0x16] = "Keyboard s",
+        [0x17] = "Keyboard t",
+        [0x18] = "Keyboard u",
+        [0x19] = "Keyboard v",
+        [0x1a] = "Keyboard w",
+        [0x1b] = "Keyboard x",
+        [0x1c] = "Keyboard y",
+        [0x1d] = "Keyboard z",
+        [0x1e] = "Keyboard 1 and !",
+        [0x1f] = "Keyboard 2 and @",
+        [0x20] = "Keyboard 3 and #",
+        [0x21] = "Keyboard 4 and $",
+        [0x22] = "Keyboard 5 and %",
+        [0x23] = "Keyboard 6 and ^",
+        [0x24] = "Keyboard 7 and &",
+        [0x25] = "Keyboard 8 and *",
+        [0x26] = "Keyboard 9 and (",
+        [0x27] = "Keyboard 0 and )",
+        [0x28] = "Keyboard Return",
+        [0x29] = "Keyboard Escape",
+        [0x2a] = "Keyboard Backspace",
+        [0x2b] = "Keyboard Tab",
+        [0x2c] = "Keyboard Spacebar",
+        [0x2d] = "Keyboard - and _",
+        [0x2e] = "Keyboard = and +",
+        [0x2f] = "Keyboard [ and {",
+        [0x30] = "Keyboard ] and }",
+        [0x31] = "Keyboard \\ and |",
+        [0x32] = "Keyboard Non-US # and ~",
+        [0x33] = "Keyboard ; and :",
+        [0x34] = "Keyboard ' and \"",
+        [0x35] = "Keyboard ` and ~",
+        [0x36] = "Keyboard , and <",
+        [0x37] = "Keyboard . and >",
+        [0x38] = "Keyboard / and ?",
+        [0x39] = "Keyboard Caps Lock",
+        [0x3a] = "Keyboard F1",
+        [0x3b] = "Keyboard F2",
+        [0x3c] = "Keyboard F3",
+        [0x3d] = "Keyboard F4",
+        [0x3e] = "Keyboard F5",
+        [0x3f] = "Keyboard F6",
+        [0x40] = "Keyboard F7",
+        [0x41] = "Keyboard F8",
+        [0x42] = "Keyboard F9",
+        [0x43] = "Keyboard F10",
+        [0x44] = "Keyboard F11",
+        [0x45] = "Keyboard F12",
+        [0x46] = "Keyboard PrintScreen",
+        [0x47] = "Keyboard Scroll Lock",
+        [0x48] = "Keyboard Pause",
+        [0x49] = "Keyboard Insert",
+        [0x4a] = "Keyboard Home",
+        [0x4b] = "Keyboard PageUp",
+        [0x4c] = "Keyboard Delete Forward",
+        [0x4d] = "Keyboard End",
+        [0x4e] = "Keyboard PageDown",
+        [0x4f] = "Keyboard RightArrow",
+        [0x50] = "Keyboard LeftArrow",
+        [0x51] = "Keyboard DownArrow",
+        [0x52] = "Keyboard UpArrow",
+        [0x53] = "Keypad Num Lock and Clear",
+        [0x54] = "Keypad /",
+        [0x55] = "Keypad *",
+        [0x56] = "Keypad -",
+        [0x57] = "Keypad +",
+        [0x58] = "Keypad Enter",
+        [0x59] = "Keypad 1 and End",
+        [0x5a] = "Keypad 2 and Down Arrow",
+        [0x5b] = "Keypad 3 and PageDn",
+        [0x5c] = "Keypad 4 and Left Arrow",
+        [0x5d] = "Keypad 5",
+        [0x5e] = "Keypad 6 and Right Arrow",
+        [0x5f] = "Keypad 7 and Home",
+        [0x60] = "Keypad 8 and Up Arrow",
+        [0x61] = "Keypad 9 and PageUp",
+        [0x62] = "Keypad 0 and Insert",
+        [0x63] = "Keypad . and Delete",
+        [0x64] = "Keyboard Non-US \\ and |",
+        [0x65] = "Keyboard Application",
+        [0x66] = "Keyboard Power",
+        [0x67] = "Keypad =",
+        [0x68] = "Keyboard F13",
+        [0x69] = "Keyboard F14",
+        [0x6a] = "Keyboard F15",
+        [0x6b] = "Keyboard F16",
+        [0x6c] = "Keyboard F17",
+        [0x6d] = "Keyboard F18",
+        [0x6e] = "Keyboard F19",
+        [0x6f] = "Keyboard F20",
+        [0x70] = "Keyboard F21",
+        [0x71] = "Keyboard F22",
+        [0x72] = "Keyboard F23",
+        [0x73] = "Keyboard F24",
+        [0x74] = "Keyboard Execute",
+        [0x75] = "Keyboard Help",
+        [0x76] = "Keyboard Menu",
+        [0x77] = "Keyboard Select",
+        [0x78] = "Keyboard Stop",
+        [0x79] = "Keyboard Again",
+        [0x7a] = "Keyboard Undo",
+        [0x7b] = "Keyboard Cut",
+        [0x7c] = "Keyboard Copy",
+        [0x7d] = "Keyboard Paste",
+        [0x7e] = "Keyboard Find",
+        [0x7f] = "Keyboard Mute",
+        [0x80] = "Keyboard Volume Up",
+        [0x81] = "Keyboard Volume Down",
+        [0x82] = "Keyboard Locking Caps Lock",
+        [0x83] = "Keyboard Locking Num Lock",
+        [0x84] = "Keyboard Locking Scroll Lock",
+        [0x85] = "Keypad Comma",
+        [0x86] = "Keypad Equal Sign",
+        [0x87] = "Keyboard International1",
+        [0x88] = "Keyboard International2",
+        [0x89] = "Keyboard International3",
+        [0x8a] = "Keyboard International4",
+        [0x8b] = "Keyboard International5",
+        [0x8c] = "Keyboard International6",
+        [0x8d] = "Keyboard International7",
+        [0x8e] = "Keyboard International8",
+        [0x8f] = "Keyboard International9",
+        [0x90] = "Keyboard LANG1",
+        [0x91] = "Keyboard LANG2",
+        [0x92] = "Keyboard LANG3",
+        [0x93] = "Keyboard LANG4",
+        [0x94] = "Keyboard LANG5",
+        [0x95] = "Keyboard LANG6",
+        [0x96] = "Keyboard LANG7",
+        [0x97] = "Keyboard LANG8",
+        [0x98] = "Keyboard LANG9",
+        [0x99] = "Keyboard Alternate Erase",
+        [0x9a] = "Keyboard SysReq/Attention",
+        [0x9b] = "Keyboard Cancel",
+        [0x9c] = "Keyboard Clear",
+        [0x9d] = "Keyboard Prior",
+        [0x9e] = "Keyboard Return",
+        [0x9f] = "Keyboard Separator",
+        [0xa0] = "Keyboard Out",
+        [0xa1] = "Keyboard Oper",
+        [0xa2] = "Keyboard Clear/Again",
+        [0xa3] = "Keyboard CrSel/Props",
+        [0xa4] = "Keyboard ExSel",
+        [0xb0] = "Keypad 00",
+        [0xb1] = "Keypad 000",
+        [0xb2] = "Thousands Separator",
+        [0xb3] = "Decimal Separator",
+        [0xb4] = "Currency Unit",
+        [0xb5] = "Currency Sub-unit",
+        [0xb6] = "Keypad (",
+        [0xb7] = "Keypad )",
+        [0xb8] = "Keypad {",
+        [0xb9] = "Keypad }",
+        [0xba] = "Keypad Tab",
+        [0xbb] = "Keypad Backspace",
+        [0xbc] = "Keypad A",
+        [0xbd] = "Keypad B",
+        [0xbe] = "Keypad C",
+        [0xbf] = "Keypad D",
+        [0xc0] = "Keypad E",
+        [0xc1] = "Keypad F",
+        [0xc2] = "Keypad XOR",
+        [0xc3] = "Keypad ^",
+        [0xc4] = "Keypad %",
+        [0xc5] = "Keypad <",
+        [0xc6] = "Keypad >",
+        [0xc7] = "Keypad &",
+        [0xc8] = "Keypad &&",
+        [0xc9] = "Keypad |",
+        [0xca] = "Keypad ||",
+        [0xcb] = "Keypad :",
+        [0xcc] = "Keypad #",
+        [0xcd] = "Keypad Space",
+        [0xce] = "Keypad @",
+        [0xcf] = "Keypad !",
+        [0xd0] = "Keypad Memory Store",
+        [0xd1] = "Keypad Memory Recall",
+        [0xd2] = "Keypad Memory Clear",
+        [0xd3] = "Keypad Memory Add",
+        [0xd4] = "Keypad Memory Subtract",
+        [0xd5] = "Keypad Memory Multiply",
+        [0xd6] = "Keypad Memory Divide",
+        [0xd7] = "Keypad +/-",
+        [0xd8] = "Keypad Clear",
+        [0xd9] = "Keypad Clear Entry",
+        [0xda] = "Keypad Binary",
+        [0xdb] = "Keypad Octal",
+        [0xdc] = "Keypad Decimal",
+        [0xdd] = "Keypad Hexadecimal",
+        [0xe0] = "Keyboard LeftControl",
+        [0xe1] = "Keyboard LeftShift",
+        [0xe2] = "Keyboard LeftAlt",
+        [0xe3] = "Keyboard Left GUI",
+        [0xe4] = "Keyboard RightControl",
+        [0xe5] = "Keyboard RightShift",
+        [0xe6] = "Keyboard RightAlt",
+        [0xe7] = "Keyboard Right GUI",
+};
+
+static const char *const hid_usages_led[] = {
+        [0x01] = "Num Lock",
+        [0x02] = "Caps Lock",
+        [0x03] = "Scroll Lock",
+        [0x04] = "Compose",
+        [0x05] = "Kana",
+        [0x06] = "Power",
+        [0x07] = "Shift",
+        [0x08] = "Do Not Disturb",
+        [0x09] = "Mute",
+        [0x0a] = "Tone Enable",
+        [0x0b] = "High Cut Filter",
+        [0x0c] = "Low Cut Filter",
+        [0x0d] = "Equalizer Enable",
+        [0x0e] = "Sound Field On",
+        [0x0f] = "Surround On",
+        [0x10] = "Repeat",
+        [0x11] = "Stereo",
+        [0x12] = "Sampling Rate Detect",
+        [0x13] = "Spinning",
+        [0x14] = "CAV",
+        [0x15] = "CLV",
+        [0x16] = "Recording Format Detect",
+        [0x17] = "Off-Hook",
+        [0x18] = "Ring",
+        [0x19] = "Message Waiting",
+        [0x1a] = "Data Mode",
+        [0x1b] = "Battery Operation",
+        [0x1c] = "Battery OK",
+        [0x1d] = "Battery Low",
+        [0x1e] = "Speaker",
+        [0x1f] = "Head Set",
+        [0x20] = "Hold",
+        [0x21] = "Microphone",
+        [0x22] = "Coverage",
+        [0x23] = "Night Mode",
+        [0x24] = "Send Calls",
+        [0x25] = "Call Pickup",
+        [0x26] = "Conference",
+        [0x27] = "Stand-by",
+        [0x28] = "Camera On",
+        [0x29] = "Camera Off",
+        [0x2a] = "On-Line",
+        [0x2b] = "Off-Line",
+        [0x2c] = "Busy",
+        [0x2d] = "Ready",
+        [0x2e] = "Paper-Out",
+        [0x2f] = "Paper-Jam",
+        [0x30] = "Remote",
+        [0x31] = "Forward",
+        [0x32] = "Reverse",
+        [0x33] = "Stop",
+        [0x34] = "Rewind",
+        [0x35] = "Fast Forward",
+        [0x36] = "Play",
+        [0x37] = "Pause",
+        [0x38] = "Record",
+        [0x39] = "Error",
+        [0x3a] = "Usage Selected Indicator",
+        [0x3b] = "Usage In Use Indicator",
+        [0x3c] = "Usage Multi Mode Indicator",
+        [0x3d] = "Indicator On",
+        [0x3e] = "Indicator Flash",
+        [0x3f] = "Indicator Slow Blink",
+        [0x40] = "Indicator Fast Blink",
+        [0x41] = "Indicator Off",
+        [0x42] = "Flash On Time",
+        [0x43] = "Slow Blink On Time",
+        [0x44] = "Slow Blink Off Time",
+        [0x45] = "Fast Blink On Time",
+        [0x46] = "Fast Blink Off Time",
+        [0x47] = "Usage Indicator Color",
+        [0x48] = "Indicator Red",
+        [0x49] = "Indicator Green",
+        [0x4a] = "Indicator Amber",
+        [0x4b] = "Generic Indicator",
+        [0x4c] = "System Suspend",
+        [0x4d] = "External Power Connected",
+};
+
+static const char *const hid_usages_telephony[] = {
+        [0x01] = "Phone",
+        [0x02] = "Answering Machine",
+        [0x03] = "Message Controls",
+        [0x04] = "Handset",
+        [0x05] = "Headset",
+        [0x06] = "Telephony Key Pad",
+        [0x07] = "Programmable Button",
+        [0x20] = "Hook Switch",
+        [0x21] = "Flash",
+        [0x22] = "Feature",
+        [0x23] = "Hold",
+        [0x24] = "Redial",
+        [0x25] = "Transfer",
+        [0x26] = "Drop",
+        [0x27] = "Park",
+        [0x28] = "Forward Calls",
+        [0x29] = "Alternate Function",
+        [0x2a] = "Line",
+        [0x2b] = "Speaker Phone",
+        [0x2c] = "Conference",
+        [0x2d] = "Ring Enable",
+        [0x2e] = "Ring Select",
+        [0x2f] = "Phone Mute",
+        [0x30] = "Caller ID",
+        [0x31] = "Send",
+        [0x50] = "Speed Dial",
+        [0x51] = "Store Number",
+        [0x52] = "Recall Number",
+        [0x53] = "Phone Directory",
+        [0x70] = "Voice Mail",
+        [0x71] = "Screen Calls",
+        [0x72] = "Do Not Disturb",
+        [0x73] = "Message",
+        [0x74] = "Answer On/Off",
+        [0x90] = "Inside Dial Tone",
+        [0x91] = "Outside Dial Tone",
+        [0x92] = "Inside Ring Tone",
+        [0x93] = "Outside Ring Tone",
+        [0x94] = "Priority Ring Tone",
+        [0x95] = "Inside Ringback",
+        [0x96] = "Priority Ringback",
+        [0x97] = "Line Busy Tone",
+        [0x98] = "Reorder Tone",
+        [0x99] = "Call Waiting Tone",
+        [0x9a] = "Confirmation Tone 1",
+        [0x9b] = "Confirmation Tone 2",
+        [0x9c] = "Tones Off",
+        [0x9d] = "Outside Ringback",
+        [0x9e] = "Ringer",
+        [0xb0] = "Phone Key 0",
+        [0xb1] = "Phone Key 1",
+        [0xb2] = "Phone Key 2",
+        [0xb3] = "Phone Key 3",
+        [0xb4] = "Phone Key 4",
+        [0xb5] = "Phone Key 5",
+        [0xb6] = "Phone Key 6",
+        [0xb7] = "Phone Key 7",
+        [0xb8] = "Phone Key 8",
+        [0xb9] = "Phone Key 9",
+        [0xba] = "Phone Key Star",
+        [0xbb] = "Phone Key Pound",
+        [0xbc] = "Phone Key A",
+        [0xbd] = "Phone Key B",
+        [0xbe] = "Phone Key C",
+        [0xbf] = "Phone Key D",
+};
+
+static const char *const hid_usages_consumer[] = {
+        [0x01] = "Consumer Control",
+        [0x02] = "Numeric Key Pad",
+        [0x03] = "Programmable Buttons",
+        [0x04] = "Microphone",
+        [0x05] = "Headphone",
+        [0x06] = "Graphic Equalizer",
+        [0x20] = "+10",
+        [0x21] = "+100",
+        [0x22] = "AM/PM",
+        [0x30] = "Power",
+        [0x31] = "Reset",
+        [0x32] = "Sleep",
+        [0x33] = "Sleep After",
+        [0x34] = "Sleep Mode",
+        [0x35] = "Illumination",
+        [0x36] = "Function Buttons",
+        [0x40] = "Menu",
+        [0x41] = "Menu Pick",
+        [0x42] = "Menu Up",
+        [0x43] = "Menu Down",
+        [0x44] = "Menu Left",
+        [0x45] = "Menu Right",
+        [0x46] = "Menu Escape",
+        [0x47] = "Menu Value Increase",
+        [0x48] = "Menu Value Decrease",
+        [0x60] = "Data On Screen",
+        [0x61] = "Closed Caption",
+        [0x62] = "Closed Caption Select",
+        [0x63] = "VCR/TV",
+        [0x64] = "Broadcast Mode",
+        [0x65] = "Snapshot",
+        [0x66] = "Still",
+        [0x6f] = "Display Brightness Increment",
+        [0x70] = "Display Brightness Decrement",
+        [0x80] = "Selection",
+        [0x81] = "Assign Selection",
+        [0x82] = "Mode Step",
+        [0x83] = "Recall Last",
+        [0x84] = "Enter Channel",
+        [0x85] = "Order Movie",
+        [0x86] = "Channel",
+        [0x87] = "Media Selection",
+        [0x88] = "Media Select Computer",
+        [0x89] = "Media Select TV",
+        [0x8a] = "Media Select WWW",
+        [0x8b] = "Media Select DVD",
+        [0x8c] = "Media Select Telephone",
+        [0x8d] = "Media Select Program Guide",
+        [0x8e] = "Media Select Video Phone",
+        [0x8f] = "Media Select Games",
+        [0x90] = "Media Select Messages",
+        [0x91] = "Media Select CD",
+        [0x92] = "Media Select VCR",
+        [0x93] = "Media Select Tuner",
+        [0x94] = "Quit",
+        [0x95] = "Help",
+        [0x96] = "Media Select Tape",
+        [0x97] = "Media Select Cable",
+        [0x98] = "Media Select Satellite",
+        [0x99] = "Media Select Security",
+        [0x9a] = "Media Select Home",
+        [0x9b] = "Media Select Call",
+        [0x9c] = "Channel Increment",
+        [0x9d] = "Channel Decrement",
+        [0x9e] = "Media Select SAP",
+        [0xa0] = "VCR Plus",
+        [0xa1] = "Once",
+        [0xa2] = "Daily",
+        [0xa3] = "Weekly",
+        [0xa4] = "Monthly",
+        [0xb0] = "Play",
+        [0xb1] = "Pause",
+        [0xb2] = "Record",
+        [0xb3] = "Fast Forward",
+        [0xb4] = "Rewind",
+        [0xb5] = "Scan Next Track",
+        [0xb6] = "Scan Previous Track",
+        [0xb7] = "Stop",
+        [0xb8] = "Eject",
+        [0xb9] = "Random Play",
+        [0xba] = "Select Disc",
+        [0xbb] = "Enter Disc",
+        [0xbc] = "Repeat",
+        [0xbd] = "Tracking",
+        [0xbe] = "Track Normal",
+        [0xbf] = "Slow Tracking",
+        [0xc0] = "Frame Forward",
+        [0xc1] = "Frame Back",
+        [0xc2] = "Mark",
+        [0xc3] = "Clear Mark",
+        [0xc4] = "Repeat From Mark",
+        [0xc5] = "Return To Mark",
+        [0xc6] = "Search Mark Forward",
+        [0xc7] = "Search Mark Backwards",
+        [0xc8] = "Counter Reset",
+        [0xc9] = "Show Counter",
+        [0xca] = "Tracking Increment",
+        [0xcb] = "Tracking Decrement",
+        [0xcc] = "Stop/Eject",
+        [0xcd] = "Play/Pause",
+        [0xce] = "Play/Skip",
+        [0xe0] = "Volume",
+        [0xe1] = "Balance",
+        [0xe2] = "Mute",
+        [0xe3] = "Bass",
+        [0xe4] = "Treble",
+        [0xe5] = "Bass Boost",
+        [0xe6] = "Surround Mode",
+        [0xe7] = "Loudness",
+        [0xe8] = "MPX",
+        [0xe9] = "Volume Increment",
+        [0xea] = "Volume Decrement",
+        [0xf0] = "Speed Select",
+        [0xf1] = "Playback Speed",
+        [0xf2] = "Standard Play",
+        [0xf3] = "Long Play",
+        [0xf4] = "Extended Play",
+        [0xf5] = "Slow",
+        [0x100] = "Fan Enable",
+        [0x101] = "Fan Speed",
+        [0x102] = "Light Enable",
+        [0x103] = "Light Illumination Level",
+        [0x104] = "Climate Control Enable",
+        [0x105] = "Room Temperature",
+        [0x106] = "Security Enable",
+        [0x107] = "Fire Alarm",
+        [0x108] = "Police Alarm",
+        [0x109] = "Proximity",
+        [0x10a] = "Motion",
+        [0x10b] = "Duress Alarm",
+        [0x10c] = "Holdup Alarm",
+        [0x10d] = "Medical Alarm",
+        [0x150] = "Balance Right",
+        [0x151] = "Balance Left",
+        [0x152] = "Bass Increment",
+        [0x153] = "Bass Decrement",
+        [0x154] = "Treble Increment",
+        [0x155] = "Treble Decrement",
+        [0x160] = "Speaker System",
+        [0x161] = "Channel Left",
+        [0x162] = "Channel Right",
+        [0x163] = "Channel Center",
+        [0x164] = "Channel Front",
+        [0x165] = "Channel Center Front",
+        [0x166] = "Channel Side",
+        [0x167] = "Channel Surround",
+        [0x168] = "Channel Low Frequency Enhancement",
+        [0x169] = "Channel Top",
+        [0x16a] = "Channel Unknown",
+        [0x170] = "Sub-channel",
+        [0x171] = "Sub-channel Increment",
+        [0x172] = "Sub-channel Decrement",
+        [0x173] = "Alternate Audio Increment",
+        [0x174] = "Alternate Audio Decrement",
+        [0x180] = "Application Launch Buttons",
+        [0x181] = "AL Launch Button Configuration Tool",
+        [0x182] = "AL Programmable Button Configuration",
+        [0x183] = "AL Consumer Control Configuration",
+        [0x184] = "AL Word Processor",
+        [0x185] = "AL Text Editor",
+        [0x186] = "AL Spreadsheet",
+        [0x187] = "AL Graphics Editor",
+        [0x188] = "AL Presentation App",
+        [0x189] = "AL Database App",
+        [0x18a] = "AL Email Reader",
+        [0x18b] = "AL Newsreader",
+        [0x18c] = "AL Voicemail",
+        [0x18d] = "AL Contacts/Address Book",
+        [0x18e] = "AL Calendar/Schedule",
+        [0x18f] = "AL Task/Project Manager",
+        [0x190] = "AL Log/Journal/Timecard",
+        [0x191] = "AL Checkbook/Finance",
+        [0x192] = "AL Calculator",
+        [0x193] = "AL A/V Capture/Playback",
+        [0x194] = "AL Local Machine Browser",
+        [0x195] = "AL LAN/WAN Browser",
+        [0x196] = "AL Internet Browser",
+        [0x197] = "AL Remote Networking/ISP Connect",
+        [0x198] = "AL Network Conference",
+        [0x199] = "AL Network Chat",
+        [0x19a] = "AL Telephony/Dialer",
+        [0x19b] = "AL Logon",
+        [0x19c] = "AL Logoff",
+        [0x19d] = "AL Logon/Logoff",
+        [0x19e] = "AL Terminal Lock/Screensaver",
+        [0x19f] = "AL Control Panel",
+        [0x1a0] = "AL Command Line Processor/Run",
+        [0x1a1] = "AL Process/Task Manager",
+        [0x1a2] = "AL Select Task/Application",
+        [0x1a3] = "AL Next Task/Application",
+        [0x1a4] = "AL Previous Task/Application",
+        [0x1a5] = "AL Preemptive Halt Task/Application",
+        [0x1a6] = "AL Integrated Help Center",
+        [0x1a7] = "AL Documents",
+        [0x1a8] = "AL Thesaurus",
+        [0x1a9] = "AL Dictionary",
+        [0x1aa] = "AL Desktop",
+        [0x1ab] = "AL Spell Check",
+        [0x1ac] = "AL Grammar Check",
+        [0x1ad] = "AL Wireless Status",
+        [0x1ae] = "AL Keyboard Layout",
+        [0x1af] = "AL Virus Protection",
+        [0x1b0] = "AL Encryption",
+        [0x1b1] = "AL Screen Saver",
+        [0x1b2] = "AL Alarms",
+        [0x1b3] = "AL Clock",
+        [0x1b4] = "AL File Browser",
+        [0x1b5] = "AL Power Status",
+        [0x1b6] = "AL Image Browser",
+        [0x1b7] = "AL Audio Browser",
+        [0x1b8] = "AL Movie Browser",
+        [0x1b9] = "AL Digital Rights Manager",
+        [0x1ba] = "AL Digital Wallet",
+        [0x1bc] = "AL Instant Messaging",
+        [0x1bd] = "AL OEM Features/Tips/Tutorial Browser",
+        [0x1be] = "AL OEM Help",
+        [0x1bf] = "AL Online Community",
+        [0x1c0] = "AL Entertainment Content Browser",
+        [0x1c1] = "AL Online Shopping Browser",
+        [0x1c2] = "AL SmartCard Information/Help",
+        [0x1c3] = "AL Market Monitor/Finance Browser",
+        [0x1c4] = "AL Customized Corporate News Browser",
+        [0x1c5] = "AL Online Activity Browser",
+        [0x1c6] = "AL Research/Search Browser",
+        [0x1c7] = "AL Audio Player",
+        [0x200] = "Generic GUI Application Controls",
+        [0x201] = "AC New",
+        [0x202] = "AC Open",
+        [0x203] = "AC Close",
+        [0x204] = "AC Exit",
+        [0x205] = "AC Maximize",
+        [0x206] = "AC Minimize",
+        [0x207] = "AC Save",
+        [0x208] = "AC Print",
+        [0x209] = "AC Properties",
+        [0x21a] = "AC Undo",
+        [0x21b] = "AC Copy",
+        [0x21c] = "AC Cut",
+        [0x21d] = "AC Paste",
+        [0x21e] = "AC Select All",
+        [0x21f] = "AC Find",
+        [0x220] = "AC Find and Replace",
+        [0x221] = "AC Search",
+        [0x222] = "AC Go To",
+        [0x223] = "AC Home",
+        [0x224] = "AC Back",
+        [0x225] = "AC Forward",
+        [0x226] = "AC Stop",
+        [0x227] = "AC Refresh",
+        [0x228] = "AC Previous Link",
+        [0x229] = "AC Next Link",
+        [0x22a] = "AC Bookmarks",
+        [0x22b] = "AC History",
+        [0x22c] = "AC Subscriptions",
+        [0x22d] = "AC Zoom In",
+        [0x22e] = "AC Zoom Out",
+        [0x22f] = "AC Zoom",
+        [0x230] = "AC Full Screen View",
+        [0x231] = "AC Normal View",
+        [0x232] = "AC View Toggle",
+        [0x233] = "AC Scroll Up",
+        [0x234] = "AC Scroll Down",
+        [0x235] = "AC Scroll",
+        [0x236] = "AC Pan Left",
+        [0x237] = "AC Pan Right",
+        [0x238] = "AC Pan",
+        [0x239] = "AC New Window",
+        [0x23a] = "AC Tile Horizontally",
+        [0x23b] = "AC Tile Vertically",
+        [0x23c] = "AC Format",
+        [0x23d] = "AC Edit",
+        [0x23e] = "AC Bold",
+        [0x23f] = "AC Italics",
+        [0x240] = "AC Underline",
+        [0x241] = "AC Strikethrough",
+        [0x242] = "AC Subscript",
+        [0x243] = "AC Superscript",
+        [0x244] = "AC All Caps",
+        [0x245] = "AC Rotate",
+        [0x246] = "AC Resize",
+        [0x247] = "AC Flip Horizontal",
+        [0x248] = "AC Flip Vertical",
+        [0x249] = "AC Mirror Horizontal",
+        [0x24a] = "AC Mirror Vertical",
+        [0x24b] = "AC Font Select",
+        [0x24c] = "AC Font Color",
+        [0x24d] = "AC Font Size",
+        [0x24e] = "AC Justify Left",
+        [0x24f] = "AC Justify Center H",
+        [0x250] = "AC Justify Right",
+        [0x251] = "AC Justify Block H",
+        [0x252] = "AC Justify Top",
+        [0x253] = "AC Justify Center V",
+        [0x254] = "AC Justify Bottom",
+        [0x255] = "AC Justify Block V",
+        [0x256] = "AC Indent Decrease",
+        [0x257] = "AC Indent Increase",
+        [0x258] = "AC Numbered List",
+        [0x259] = "AC Restart Numbering",
+        [0x25a] = "AC Bulleted List",
+        [0x25b] = "AC Promote",
+        [0x25c] = "AC Demote",
+        [0x25d] = "AC Yes",
+        [0x25e] = "AC No",
+        [0x25f] = "AC Cancel",
+        [0x260] = "AC Catalog",
+        [0x261] = "AC Buy/Checkout",
+        [0x262] = "AC Add to Cart",
+        [0x263] = "AC Expand",
+        [0x264] = "AC Expand All",
+        [0x265] = "AC Collapse",
+        [0x266] = "AC Collapse All",
+        [0x267] = "AC Print Preview",
+        [0x268] = "AC Paste Special",
+        [0x269] = "AC Insert Mode",
+        [0x26a] = "AC Delete",
+        [0x26b] = "AC Lock",
+        [0x26c] = "AC Unlock",
+        [0x26d] = "AC Protect",
+        [0x26e] = "AC Unprotect",
+        [0x26f] = "AC Attach Comment",
+        [0x270] = "AC Delete Comment",
+        [0x271] = "AC View Comment",
+        [0x272] = "AC Select Word",
+        [0x273] = "AC Select Sentence",
+        [0x274] = "AC Select Paragraph",
+        [0x275] = "AC Select Column",
+        [0x276] = "AC Select Row",
+        [0x277] = "AC Select Table",
+        [0x278] = "AC Select Object",
+        [0x279] = "AC Redo/Repeat",
+        [0x27a] = "AC Sort",
+        [0x27b] = "AC Sort Ascending",
+        [0x27c] = "AC Sort Descending",
+        [0x27d] = "AC Filter",
+        [0x27e] = "AC Set Clock",
+        [0x27f] = "AC View Clock",
+        [0x280] = "AC Select Time Zone",
+        [0x281] = "AC Edit Time Zones",
+        [0x282] = "AC Set Alarm",
+        [0x283] = "AC Clear Alarm",
+        [0x284] = "AC Snooze Alarm",
+        [0x285] = "AC Reset Alarm",
+        [0x286] = "AC Synchronize",
+        [0x287] = "AC Send/Receive",
+        [0x288] = "AC Send To",
+        [0x289] = "AC Reply",
+        [0x28a] = "AC Reply All",
+        [0x28b] = "AC Forward Msg",
+        [0x28c] = "AC Send",
+        [0x28d] = "AC Attach File",
+        [0x28e] = "AC Upload",
+        [0x28f] = "AC Download (Save Target As)",
+        [0x290] = "AC Set Borders",
+        [0x291] = "AC Insert Row",
+        [0x292] = "AC Insert Column",
+        [0x293] = "AC Insert File",
+        [0x294] = "AC Insert Picture",
+        [0x295] = "AC Insert Object",
+        [0x296] = "AC Insert Symbol",
+        [0x297] = "AC Save and Close",
+        [0x298] = "AC Rename",
+        [0x299] = "AC Merge",
+        [0x29a] = "AC Split",
+        [0x29b] = "AC Distribute Horizontally",
+        [0x29c] = "AC Distribute Vertically",
+        [0x29d] = "AC Next Keyboard Layout Select",
+};
+
+static const char *const hid_usages_digitizer[] = {
+        [0x01] = "Digitizer",
+        [0x02] = "Pen",
+        [0x03] = "Light Pen",
+        [0x04] = "Touch Screen",
+        [0x05] = "Touch Pad",
+        [0x06] = "Whiteboard",
+        [0x07] = "Coordinate Measuring Machine",
+        [0x08] = "3D Digitizer",
+        [0x09] = "Stereo Plotter",
+        [0x0a] = "Articulated Arm",
+        [0x0b] = "Armature",
+        [0x0c] = "Multiple Point Digitizer",
+        [0x0d] = "Free Space Wand",
+        [0x0e] = "Device Configuration",
+        [0x0f] = "Capacitive Heat Map Digitizer",
+        [0x20] = "Stylus",
+        [0x21] = "Puck",
+        [0x22] = "Finger",
+        [0x23] = "Device Settings",
+        [0x24] = "Character Gesture",
+        [0x30] = "Tip Pressure",
+        [0x31] = "Barrel Pressure",
+        [0x32] = "In Range",
+        [0x33] = "Touch",
+        [0x34] = "Untouch",
+        [0x35] = "Tap",
+        [0x36] = "Quality",
+        [0x37] = "Data Valid",
+        [0x38] = "Transducer Index",
+        [0x39] = "Tablet Function Keys",
+        [0x3a] = "Program Change Keys",
+        [0x3b] = "Battery Strength",
+        [0x3c] = "Invert",
+        [0x3d] = "X Tilt",
+        [0x3e] = "Y Tilt",
+        [0x3f] = "Azimuth",
+        [0x40] = "Altitude",
+        [0x41] = "Twist",
+        [0x42] = "Tip Switch",
+        [0x43] = "Secondary Tip Switch",
+        [0x44] = "Barrel Switch",
+        [0x45] = "Eraser",
+        [0x46] = "Tablet Pick",
+        [0x47] = "Touch Valid",
+        [0x48] = "Width",
+        [0x49] = "Height",
+        [0x51] = "Contact Identifier",
+        [0x52] = "Device Mode",
+        [0x53] = "Device Identifier",
+        [0x54] = "Contact Count",
+        [0x55] = "Contact Count Maximum",
+        [0x56] = "Scan Time",
+        [0x57] = "Surface Switch",
+        [0x58] = "Button Switch",
+        [0x59] = "Pad Type",
+        [0x5a] = "Secondary Barrel Switch",
+        [0x5b] = "Transducer Serial Number",
+        [0x5c] = "Preferred Color",
+        [0x5d] = "Preferred Color is Locked",
+        [0x5e] = "Preferred Line Width",
+        [0x5f] = "Preferred Line Width is Locked",
+        [0x60] = "Latency Mode",
+        [0x61] = "Gesture Character Quality",
+        [0x62] = "Character Gesture Data Length",
+        [0x63] = "Character Gesture Data",
+        [0x64] = "Gesture Character Encoding",
+        [0x65] = "UTF8 Character Gesture Encoding",
+        [0x66] = "UTF16 Little Endian Character Gesture Encoding",
+        [0x67] = "UTF16 Big Endian Character Gesture Encoding",
+        [0x68] = "UTF32 Little Endian Character Gesture Encoding",
+        [0x69] = "UTF32 Big Endian Character Gesture Encoding",
+        [0x6a] = "Capacitive Heat Map Protocol Vendor ID",
+        [0x6b] = "Capacitive Heat Map Protocol Version",
+        [0x6c] = "Capacitive Heat Map Frame Data",
+        [0x6d] = "Gesture Character Enable",
+        [0x6e] = "Transducer Serial Number Part 2",
+        [0x6f] = "No Preferred Color",
+        [0x70] = "Preferred Line Style",
+        [0x71] = "Preferred Line Style is Locked",
+        [0x72] = "Ink",
+        [0x73] = "Pencil",
+        [0x74] = "Highlighter",
+        [0x75] = "Chisel Marker",
+        [0x76] = "Brush",
+        [0x77] = "No Preference",
+        [0x80] = "Digitizer Diagnostic",
+        [0x81] = "Digitizer Error",
+        [0x82] = "Err Normal Status",
+        [0x83] = "Err Transducers Exceeded",
+        [0x84] = "Err Full Trans Features Unavailable",
+        [0x85] = "Err Charge Low",
+        [0x90] = "Transducer Software Info",
+        [0x91] = "Transducer Vendor Id",
+        [0x92] = "Transducer Product Id",
+        [0x93] = "Device Supported Protocols",
+        [0x94] = "Transducer Supported Protocols",
+        [0x95] = "No Protocol",
+        [0x96] = "Wacom AES Protocol",
+        [0x97] = "USI Protocol",
+        [0x98] = "Microsoft Pen Protocol",
+        [0xa0] = "Supported Report Rates",
+        [0xa1] = "Report Rate",
+        [0xa2] = "Transducer Connected",
+        [0xa3] = "Switch Disabled",
+        [0xa4] = "Switch Unimplemented",
+        [0xa5] = "Transducer Switches",
+};
+
+static const struct hid_usage_page hid_usage_pages[256] = {
+        [0x00] = { "Undefined", NULL, 0, NULL },
+        [0x01] = { "Generic Desktop", hid_usages_generic_desktop, ARRAY_SIZE(hid_usages_generic_desktop), NULL },
+        [0x02] = { "Simulation Controls", hid_usages_simulation, ARRAY_SIZE(hid_usages_simulation), NULL },
+        [0x03] = { "VR Controls", hid_usages_vr, ARRAY_SIZE(hid_usages_vr), NULL },
+        [0x04] = { "Sport Controls", hid_usages_sport, ARRAY_SIZE(hid_usages_sport), NULL },
+        [0x05] = { "Game Controls", hid_usages_game, ARRAY_SIZE(hid_usages_game), NULL },
+        [0x06] = { "Generic Device Controls", hid_usages_generic_device, ARRAY_SIZE(hid_usages_generic_device), NULL },
+        [0x07] = { "Keyboard/Keypad", hid_usages_keyboard, ARRAY_SIZE(hid_usages_keyboard), NULL },
+        [0x08] = { "LED", hid_usages_led, ARRAY_SIZE(hid_usages_led), NULL },
+        [0x09] = { "Button", NULL, 0, "Button %u" },
+        [0x0a] = { "Ordinal", NULL, 0, "Instance %u" },
+        [0x0b] = { "Telephony Device", hid_usages_telephony, ARRAY_SIZE(hid_usages_telephony), NULL },
+        [0x0c] = { "Consumer", hid_usages_consumer, ARRAY_SIZE(hid_usages_consumer), NULL },
+        [0x0d] = { "Digitizers", hid_usages_digitizer, ARRAY_SIZE(hid_usages_digitizer), NULL },
+        [0x0e] = { "Haptics", NULL, 0, NULL },
+        [0x0f] = { "Physical Input Device", NULL, 0, NULL },
+        [0x10] = { "Unicode", NULL, 0, "U+%04X" },
+        [0x11] = { "SoC", NULL, 0, NULL },
+        [0x12] = { "Eye and Head Trackers", NULL, 0, NULL },
+        [0x14] = { "Auxiliary Display", NULL, 0, NULL },
+        [0x20] = { "Sensors", NULL, 0, NULL },
+        [0x40] = { "Medical Instrument", NULL, 0, NULL },
+        [0x41] = { "Braille Display", NULL, 0, NULL },
+        [0x59] = { "Lighting And Illumination", NULL, 0, NULL },
+        [0x80] = { "Monitor", NULL, 0, NULL },
+        [0x81] = { "Monitor Enumerated", NULL, 0, "ENUM %u" },
+        [0x82] = { "VESA Virtual Controls", NULL, 0, NULL },
+        [0x84] = { "Power", NULL, 0, NULL },
+        [0x85] = { "Battery System", NULL, 0, NULL },
+        [0x8c] = { "Barcode Scanner", NULL, 0, NULL },
+        [0x8d] = { "Scales", NULL, 0, NULL },
+        [0x8e] = { "Magnetic Stripe Reader", NULL, 0, NULL },
+        [0x90] = { "Camera Control", NULL, 0, NULL },
+        [0x91] = { "Arcade", NULL, 0, NULL },
+        [0x92] = { "Gaming Device", NULL, 0, NULL },
+};
+
+static const struct hid_usage_page hid_usage_page_fido = {
+        "FIDO Alliance", NULL, 0, NULL
+};
+
+static const struct hid_usage_page hid_usage_page_vendor = {
+        "Vendor Defined", NULL, 0, NULL
+};
+
+/** Returns the description of usage page \a page, or NULL if it is
+ * reserved.
+ */
+static inline const struct hid_usage_page *hid_find_usage_page(unsigned int page)
+{
+        if (page < ARRAY_SIZE(hid_usage_pages)) {
+                return hid_usage_pages[page].name ? &hid_usage_pages[page] : NULL;
+        } else if (page >= 0xff00 && page <= 0xffff) {
+                return &hid_usage_page_vendor;
+        } else if (page == 0xf1d0) {
+                return &hid_usage_page_fido;
+        }
+        return NULL;
+}
+
+/** Returns the name of \a usage (with the usage page in its upper 16
+ * bits), or NULL if it has none.  Names for ordinal pages are
+ * formatted into \a buf.
+ */
+static inline const char *hid_usage_name(uint32_t usage, char buf[], size_t len)
+{
+        const struct hid_usage_page *page;
+        unsigned int id;
+
+        page = hid_find_usage_page(usage >> 16);
+        id = usage & 0xffff;
+        if (page == NULL) {
+                return NULL;
+        } else if (page->ordinal != NULL) {
+                if (id == 0) {
+                        return NULL;
+                }
+                snprintf(buf, len, page->ordinal, id);
+                return buf;
+        } else if (id < page->count) {
+                return page->usages[id];
+        }
+        return NULL;
+}
+
+#endif /* !defined(HID_USAGES_H) */
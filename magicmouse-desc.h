@@ -0,0 +1,87 @@
+/* Copyright 2010 Michael Poole.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Report descriptor for the Apple Magic Mouse.
+ *
+ * This matches the reports the mouse actually sends and accepts: a
+ * six-byte (with ID) button and motion report 0x10, a 64-byte vendor
+ * feature report 0x55 and a battery strength feature report 0x47.
+ * The multi-touch report 0x29 is not declared; the mouse only sends
+ * it after the feature writes in mtalk's write_mystery(), which is
+ * why hid-magicmouse registers that report itself.  Like the real
+ * descriptor, it ends with a null byte.
+ */
+
+#if !defined(MAGICMOUSE_DESC_H)
+#define MAGICMOUSE_DESC_H
+
+static const unsigned char magicmouse_descriptor[] = {
+        0x05, 0x01,             /* Usage Page (Generic Desktop) */
+        0x09, 0x02,             /* Usage (Mouse) */
+        0xa1, 0x01,             /* Collection (Application) */
+        0x85, 0x10,             /*   Report ID (0x10) */
+        0x05, 0x09,             /*   Usage Page (Button) */
+        0x19, 0x01,             /*   Usage Minimum (Button 1) */
+        0x29, 0x02,             /*   Usage Maximum (Button 2) */
+        0x15, 0x00,             /*   Logical Minimum (0) */
+        0x25, 0x01,             /*   Logical Maximum (1) */
+        0x95, 0x02,             /*   Report Count (2) */
+        0x75, 0x01,             /*   Report Size (1) */
+        0x81, 0x02,             /*   Input (Variable) */
+        0x95, 0x01,             /*   Report Count (1) */
+        0x75, 0x06,             /*   Report Size (6) */
+        0x81, 0x03,             /*   Input (Constant, Variable) */
+        0x05, 0x01,             /*   Usage Page (Generic Desktop) */
+        0x09, 0x01,             /*   Usage (Pointer) */
+        0xa1, 0x00,             /*   Collection (Physical) */
+        0x16, 0x01, 0x80,       /*     Logical Minimum (-32767) */
+        0x26, 0xff, 0x7f,       /*     Logical Maximum (32767) */
+        0x09, 0x30,             /*     Usage (X) */
+        0x09, 0x31,             /*     Usage (Y) */
+        0x75, 0x10,             /*     Report Size (16) */
+        0x95, 0x02,             /*     Report Count (2) */
+        0x81, 0x06,             /*     Input (Variable, Relative) */
+        0xc0,                   /*   End Collection */
+        0x06, 0x02, 0xff,       /*   Usage Page (Vendor Defined 0xff02) */
+        0x09, 0x55,             /*   Usage (0x55) */
+        0x85, 0x55,             /*   Report ID (0x55) */
+        0x15, 0x00,             /*   Logical Minimum (0) */
+        0x26, 0xff, 0x00,       /*   Logical Maximum (255) */
+        0x75, 0x08,             /*   Report Size (8) */
+        0x95, 0x40,             /*   Report Count (64) */
+        0xb1, 0xa2,             /*   Feature (Variable, No Preferred, Volatile) */
+        0xc0,                   /* End Collection */
+        0x05, 0x06,             /* Usage Page (Generic Device Controls) */
+        0x09, 0x20,             /* Usage (Battery Strength) */
+        0xa1, 0x01,             /* Collection (Application) */
+        0x85, 0x47,             /*   Report ID (0x47) */
+        0x15, 0x00,             /*   Logical Minimum (0) */
+        0x25, 0x64,             /*   Logical Maximum (100) */
+        0x75, 0x08,             /*   Report Size (8) */
+        0x95, 0x01,             /*   Report Count (1) */
+        0xb1, 0xa2,             /*   Feature (Variable, No Preferred, Volatile) */
+        0xc0,                   /* End Collection */
+        0x00
+};
+
+#endif /* !defined(MAGICMOUSE_DESC_H) */
@@ -0,0 +1,375 @@
+/* Copyright 2010 Michael Poole.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Magic Mouse input report decoding.
+ *
+ * hid-magicmouse.c and mtalk both include this file, so it has to
+ * build in the kernel and in userspace; it is written in kernel style
+ * and uses only the <linux/types.h> integer types.
+ *
+ * magicmouse_decode() reads a motion (0x10) or touch (0x29) report
+ * straight out of the receive buffer and fills in a fixed-size
+ * struct magicmouse_report in one pass.  Each touch is an 8-byte
+ * record:
+ *
+ *   bytes 0-2: X (bits 0-11) and Y (bits 12-23), signed
+ *   byte 3:    touch major axis
+ *   byte 4:    touch minor axis
+ *   bytes 5-6: size (bits 0-5), tracking ID (bits 6-9) and
+ *              orientation plus 32 (bits 10-15)
+ *   byte 7:    touch state (MAGICMOUSE_TOUCH_STATE_*)
+ *
+ * The device's Y axis points away from the user; the decoder negates
+ * it so that Y grows toward the user, like pointer motion.
+ *
+ * By default records are unpacked a byte at a time.  If
+ * MAGICMOUSE_DECODE_WORDS is defined before this file is included,
+ * each record is instead loaded as one little-endian 64-bit word and
+ * every field is a shift and mask of that word.  Both paths are
+ * always compiled, so the test vectors below can check them against
+ * each other.
+ */
+
+#ifndef MAGICMOUSE_REPORT_H
+#define MAGICMOUSE_REPORT_H
+
+#include <linux/types.h>
+
+#ifdef __KERNEL__
+#include <asm/unaligned.h>
+#else
+#include <endian.h>	/* le64toh() */
+#include <string.h>	/* memcpy() */
+#endif
+
+#define MAGICMOUSE_MOTION_ID	0x10
+#define MAGICMOUSE_TOUCH_ID	0x29
+#define MAGICMOUSE_MOTION_SIZE	6
+#define MAGICMOUSE_TOUCH_HEADER	6
+#define MAGICMOUSE_TOUCH_RECORD	8
+
+/* Tracking IDs are four bits wide, so more touches than this in one
+ * report would be malformed; the decoder ignores the excess.
+ */
+#define MAGICMOUSE_MAX_TOUCHES	16
+
+/* Values of magicmouse_report::type. */
+#define MAGICMOUSE_NONE		0
+#define MAGICMOUSE_MOTION	1
+#define MAGICMOUSE_TOUCH	2
+
+/* These definitions are not precise, but they're close enough.  (Bits
+ * 0x03 seem to indicate the aspect ratio of the touch, bits 0x70 seem
+ * to be some kind of bit mask -- 0x20 may be a near-field reading,
+ * and 0x40 is actual contact, and 0x10 may be a start/stop or change
+ * indication.)
+ */
+#define MAGICMOUSE_TOUCH_STATE_MASK	0xf0
+#define MAGICMOUSE_TOUCH_STATE_NONE	0x00
+#define MAGICMOUSE_TOUCH_STATE_START	0x30
+#define MAGICMOUSE_TOUCH_STATE_DRAG	0x40
+
+/**
+ * struct magicmouse_touch - One decoded touch record.
+ * @x: Horizontal position; positive to the right.
+ * @y: Vertical position; positive toward the user.
+ * @id: Tracking ID (0-15).
+ * @major: Major axis of the touch ellipse.
+ * @minor: Minor axis of the touch ellipse.
+ * @size: Touch size (0-63).
+ * @orientation: Orientation of the major axis (-32 to 31).
+ * @state: Raw state byte; see MAGICMOUSE_TOUCH_STATE_MASK.
+ */
+struct magicmouse_touch {
+	__s16 x;
+	__s16 y;
+	__u8 id;
+	__u8 major;
+	__u8 minor;
+	__u8 size;
+	__s8 orientation;
+	__u8 state;
+};
+
+/**
+ * struct magicmouse_report - One decoded input report.
+ * @type: MAGICMOUSE_MOTION, MAGICMOUSE_TOUCH, or MAGICMOUSE_NONE if
+ *     the report was not recognized.
+ * @buttons: Button state (bit 0 is left, bit 1 is right).
+ * @dx: Relative X motion.
+ * @dy: Relative Y motion.
+ * @timestamp: 18-bit device timestamp (touch reports only).
+ * @ntouches: Number of entries used in @touch.
+ * @touch: Touch records, in report order.
+ */
+struct magicmouse_report {
+	__u8 type;
+	__u8 buttons;
+	__s16 dx;
+	__s16 dy;
+	__u32 timestamp;
+	int ntouches;
+	struct magicmouse_touch touch[MAGICMOUSE_MAX_TOUCHES];
+};
+
+/* Unpacks the touch record at @tdata a byte at a time. */
+static inline void magicmouse_decode_touch_bytes(struct magicmouse_touch *t,
+		const __u8 *tdata)
+{
+	__u32 x_y = tdata[0] | tdata[1] << 8 | tdata[2] << 16;
+	unsigned int misc = tdata[5] | tdata[6] << 8;
+
+	t->x = (__s32)(x_y << 20) >> 20;
+	t->y = -((__s32)(x_y << 8) >> 20);
+	t->major = tdata[3];
+	t->minor = tdata[4];
+	t->size = misc & 63;
+	t->id = (misc >> 6) & 15;
+	t->orientation = (int)(misc >> 10) - 32;
+	t->state = tdata[7];
+}
+
+/* Unpacks the touch record at @tdata from a single 64-bit load. */
+static inline void magicmouse_decode_touch_word(struct magicmouse_touch *t,
+		const __u8 *tdata)
+{
+	__u64 w;
+
+#ifdef __KERNEL__
+	w = get_unaligned_le64(tdata);
+#else
+	memcpy(&w, tdata, sizeof(w));
+	w = le64toh(w);
+#endif
+	t->x = (__s64)(w << 52) >> 52;
+	t->y = -((__s64)(w << 40) >> 52);
+	t->major = w >> 24;
+	t->minor = w >> 32;
+	t->size = (w >> 40) & 63;
+	t->id = (w >> 46) & 15;
+	t->orientation = (int)((w >> 50) & 63) - 32;
+	t->state = w >> 56;
+}
+
+/**
+ * magicmouse_decode_with() - Decodes one input report.
+ * @r: Receives the decoded report.
+ * @data: Report data, starting with the report ID.
+ * @size: Length of @data in bytes.
+ * @words: Non-zero to use magicmouse_decode_touch_word().
+ *
+ * Returns @r->type.  Reports that are not recognized, or that have
+ * the wrong length, decode as MAGICMOUSE_NONE.
+ */
+static inline int magicmouse_decode_with(struct magicmouse_report *r,
+		const __u8 *data, int size, int words)
+{
+	const __u8 *tdata;
+	int ii;
+
+	r->type = MAGICMOUSE_NONE;
+	r->ntouches = 0;
+	if (size < 1)
+		return MAGICMOUSE_NONE;
+
+	switch (data[0]) {
+	case MAGICMOUSE_MOTION_ID:
+		if (size != MAGICMOUSE_MOTION_SIZE)
+			return MAGICMOUSE_NONE;
+		r->buttons = data[1] & 3;
+		r->dx = (__s16)(data[2] | data[3] << 8);
+		r->dy = (__s16)(data[4] | data[5] << 8);
+		r->timestamp = 0;
+		r->type = MAGICMOUSE_MOTION;
+		break;
+	case MAGICMOUSE_TOUCH_ID:
+		/* Expect six bytes of prefix, and N*8 bytes of touch data. */
+		if (size < MAGICMOUSE_TOUCH_HEADER ||
+		    (size - MAGICMOUSE_TOUCH_HEADER) % MAGICMOUSE_TOUCH_RECORD)
+			return MAGICMOUSE_NONE;
+		r->dx = (__s8)data[1];
+		r->dy = (__s8)data[2];
+		r->buttons = data[3] & 3;
+		r->timestamp = data[3] >> 6 | data[4] << 2 | data[5] << 10;
+		r->ntouches = (size - MAGICMOUSE_TOUCH_HEADER) / MAGICMOUSE_TOUCH_RECORD;
+		if (r->ntouches > MAGICMOUSE_MAX_TOUCHES)
+			r->ntouches = MAGICMOUSE_MAX_TOUCHES;
+		tdata = data + MAGICMOUSE_TOUCH_HEADER;
+		if (words) {
+			for (ii = 0; ii < r->ntouches; ii++, tdata += MAGICMOUSE_TOUCH_RECORD)
+				magicmouse_decode_touch_word(&r->touch[ii], tdata);
+		} else {
+			for (ii = 0; ii < r->ntouches; ii++, tdata += MAGICMOUSE_TOUCH_RECORD)
+				magicmouse_decode_touch_bytes(&r->touch[ii], tdata);
+		}
+		r->type = MAGICMOUSE_TOUCH;
+		break;
+	default:
+		return MAGICMOUSE_NONE;
+	}
+
+	return r->type;
+}
+
+#ifdef MAGICMOUSE_DECODE_WORDS
+#define MAGICMOUSE_DECODE_USE_WORDS 1
+#else
+#define MAGICMOUSE_DECODE_USE_WORDS 0
+#endif
+
+/* Decodes one input report using the configured record decoder. */
+static inline int magicmouse_decode(struct magicmouse_report *r,
+		const __u8 *data, int size)
+{
+	return magicmouse_decode_with(r, data, size, MAGICMOUSE_DECODE_USE_WORDS);
+}
+
+#ifndef __KERNEL__
+
+/**
+ * struct magicmouse_test_vector - A report and how it should decode.
+ * @name: Short description, for failure messages.
+ * @data: Raw report, starting with the report ID.
+ * @size: Length of @data.
+ * @expect: Expected result; only the first @expect.ntouches entries
+ *     of @expect.touch are compared, and @expect.buttons, dx, dy and
+ *     timestamp only if @expect.type is not MAGICMOUSE_NONE.
+ */
+struct magicmouse_test_vector {
+	const char *name;
+	const __u8 *data;
+	int size;
+	struct magicmouse_report expect;
+};
+
+static const __u8 magicmouse_tv_motion[] = {
+	0x10, 0x01, 0x05, 0x00, 0xfb, 0xff,
+};
+
+static const __u8 magicmouse_tv_no_touches[] = {
+	0x29, 0x03, 0xfd, 0xc2, 0x34, 0x12,
+};
+
+static const __u8 magicmouse_tv_two_touches[] = {
+	0x29, 0x00, 0x00, 0x01, 0x00, 0x00,
+	0xb4, 0x1b, 0x80, 0x28, 0x20, 0x14, 0x80, 0x30,
+	0x4e, 0x05, 0x64, 0xff, 0x00, 0xff, 0xff, 0x40,
+};
+
+static const __u8 magicmouse_tv_extremes[] = {
+	0x29, 0x80, 0x7f, 0xff, 0xff, 0xff,
+	0x00, 0x08, 0x80, 0x01, 0x02, 0xc0, 0x01, 0x00,
+	0xff, 0xf7, 0x7f, 0x80, 0x40, 0xe1, 0x04, 0x20,
+};
+
+static const __u8 magicmouse_tv_short_record[] = {
+	0x29, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xb4, 0x1b, 0x80, 0x28, 0x20, 0x14, 0x80,
+};
+
+static const __u8 magicmouse_tv_too_many[MAGICMOUSE_TOUCH_HEADER +
+		(MAGICMOUSE_MAX_TOUCHES + 1) * MAGICMOUSE_TOUCH_RECORD] = {
+	0x29,
+};
+
+static const __u8 magicmouse_tv_unknown[] = {
+	0x61, 0x01,
+};
+
+static const struct magicmouse_test_vector magicmouse_test_vectors[] = {
+	{ "motion", magicmouse_tv_motion, sizeof(magicmouse_tv_motion),
+	  { .type = MAGICMOUSE_MOTION, .buttons = 1, .dx = 5, .dy = -5 } },
+	{ "motion, too short", magicmouse_tv_motion, sizeof(magicmouse_tv_motion) - 1,
+	  { .type = MAGICMOUSE_NONE } },
+	{ "touch, no touches", magicmouse_tv_no_touches, sizeof(magicmouse_tv_no_touches),
+	  { .type = MAGICMOUSE_TOUCH, .buttons = 2, .dx = 3, .dy = -3,
+	    .timestamp = 0x48d3 } },
+	{ "touch, two touches", magicmouse_tv_two_touches, sizeof(magicmouse_tv_two_touches),
+	  { .type = MAGICMOUSE_TOUCH, .buttons = 1, .ntouches = 2,
+	    .touch = {
+		{ .x = -1100, .y = 2047, .id = 0, .major = 40, .minor = 32,
+		  .size = 20, .orientation = 0, .state = 0x30 },
+		{ .x = 1358, .y = -1600, .id = 15, .major = 255, .minor = 0,
+		  .size = 63, .orientation = 31, .state = 0x40 },
+	    } } },
+	{ "touch, extreme values", magicmouse_tv_extremes, sizeof(magicmouse_tv_extremes),
+	  { .type = MAGICMOUSE_TOUCH, .buttons = 3, .dx = -128, .dy = 127,
+	    .timestamp = 0x3ffff, .ntouches = 2,
+	    .touch = {
+		{ .x = -2048, .y = 2048, .id = 7, .major = 1, .minor = 2,
+		  .size = 0, .orientation = -32, .state = 0x00 },
+		{ .x = 2047, .y = -2047, .id = 3, .major = 128, .minor = 64,
+		  .size = 33, .orientation = -31, .state = 0x20 },
+	    } } },
+	{ "touch, partial record", magicmouse_tv_short_record, sizeof(magicmouse_tv_short_record),
+	  { .type = MAGICMOUSE_NONE } },
+	{ "touch, too short", magicmouse_tv_no_touches, MAGICMOUSE_TOUCH_HEADER - 1,
+	  { .type = MAGICMOUSE_NONE } },
+	{ "touch, too many touches", magicmouse_tv_too_many, sizeof(magicmouse_tv_too_many),
+	  { .type = MAGICMOUSE_TOUCH, .ntouches = MAGICMOUSE_MAX_TOUCHES,
+	    .touch = { [0 ... MAGICMOUSE_MAX_TOUCHES - 1] = { .orientation = -32 } } } },
+	{ "unknown report", magicmouse_tv_unknown, sizeof(magicmouse_tv_unknown),
+	  { .type = MAGICMOUSE_NONE } },
+	{ "empty report", magicmouse_tv_unknown, 0,
+	  { .type = MAGICMOUSE_NONE } },
+};
+
+#define MAGICMOUSE_TEST_VECTORS \
+	(sizeof(magicmouse_test_vectors) / sizeof(magicmouse_test_vectors[0]))
+
+/**
+ * magicmouse_check_vector() - Compares a decoded report to a vector.
+ * @tv: The test vector.
+ * @r: The report decoded from @tv->data.
+ *
+ * Returns the index plus one of the first touch that differs, or -1
+ * if the report header differs, or zero if they match.
+ */
+static inline int magicmouse_check_vector(const struct magicmouse_test_vector *tv,
+		const struct magicmouse_report *r)
+{
+	const struct magicmouse_report *e = &tv->expect;
+	const struct magicmouse_touch *a, *b;
+	int ii;
+
+	if (r->type != e->type || r->ntouches != e->ntouches)
+		return -1;
+	if (e->type != MAGICMOUSE_NONE &&
+	    (r->buttons != e->buttons || r->dx != e->dx || r->dy != e->dy ||
+	     r->timestamp != e->timestamp))
+		return -1;
+	for (ii = 0; ii < e->ntouches; ii++) {
+		a = &r->touch[ii];
+		b = &e->touch[ii];
+		if (a->x != b->x || a->y != b->y || a->id != b->id ||
+		    a->major != b->major || a->minor != b->minor ||
+		    a->size != b->size || a->orientation != b->orientation ||
+		    a->state != b->state)
+			return ii + 1;
+	}
+	return 0;
+}
+
+#endif /* !__KERNEL__ */
+
+#endif /* MAGICMOUSE_REPORT_H */
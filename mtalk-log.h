@@ -0,0 +1,308 @@
+/* Copyright 2010 Michael Poole.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* mtalk session logs.
+ *
+ * A log is a header followed by one record per packet.  Each record
+ * holds the packet's receive time (CLOCK_MONOTONIC, in nanoseconds),
+ * which channel and device it came from, and the raw packet, padded
+ * to a multiple of eight bytes.  All fields are in host byte order.
+ *
+ * The writer keeps the whole file mapped and preallocated, so
+ * appending a record is a memcpy() and never waits for the disk.
+ * mtalk_log_reserve() grows the file ahead of the records, off the
+ * writer's hot path; appending only grows it if that fell behind.
+ * The writer updates mtalk_log_header::used after every record, so a log
+ * from a process that died is still readable up to its last record.
+ */
+
+#if !defined(MTALK_LOG_H)
+#define MTALK_LOG_H
+
+#include <errno.h>     /* errno */
+#include <fcntl.h>     /* open(), posix_fallocate() */
+#include <stdint.h>    /* sized integer types */
+#include <string.h>    /* memcpy(), memset() */
+#include <sys/mman.h>  /* mmap(), madvise(), etc */
+#include <sys/stat.h>  /* fstat() */
+#include <unistd.h>    /* ftruncate(), close() */
+
+#define MTALK_LOG_MAGIC   "MTALKLOG"
+#define MTALK_LOG_VERSION 1
+
+struct mtalk_log_header {
+        char magic[8];
+        uint32_t version;
+        /** Size of this header; records start here. */
+        uint32_t header_size;
+        /** CLOCK_REALTIME and CLOCK_MONOTONIC when the log was
+         * started, so readers can convert record times to wall
+         * clock time.
+         */
+        uint64_t start_realtime_ns;
+        uint64_t start_monotonic_ns;
+        /** Bytes of records that follow the header. */
+        uint64_t used;
+};
+
+struct mtalk_log_record {
+        /** CLOCK_MONOTONIC receive time in nanoseconds. */
+        uint64_t timestamp_ns;
+        /** Length of the packet data that follows. */
+        uint16_t length;
+        /** 0 for the HID control channel, 1 for interrupt. */
+        uint8_t channel;
+        /** Index of the device (in mtalk's argument order). */
+        uint8_t device;
+        uint32_t reserved;
+};
+
+#define MTALK_LOG_RECORD_SIZE(LEN) \
+        ((sizeof(struct mtalk_log_record) + (LEN) + 7) & ~(size_t)7)
+
+/** An open log that is being written. */
+struct mtalk_log {
+        int fd;
+        unsigned char *map;
+        /** Bytes mapped (and allocated on disk). */
+        size_t size;
+        /** Bytes to add each time the file fills up. */
+        size_t grow;
+        struct mtalk_log_header *header;
+};
+
+/* Faults in len bytes of a shared file mapping for writing, so the
+ * first record to land there does not take the page faults.
+ */
+static inline void mtalk_log_prefault(unsigned char *p, size_t len)
+{
+        size_t pos;
+
+#if defined(MADV_POPULATE_WRITE)
+        if (madvise(p, len, MADV_POPULATE_WRITE) == 0) {
+                return;
+        }
+#endif
+        /* Older kernels: touch each page instead. */
+        for (pos = 0; pos < len; pos += 4096) {
+                ((volatile unsigned char *)p)[pos] = 0;
+        }
+}
+
+/* Extends the file and mapping of log to size bytes, allocating and
+ * prefaulting only what is new.
+ */
+static inline int mtalk_log_resize(struct mtalk_log *log, size_t size)
+{
+        void *map;
+        int res;
+
+        res = posix_fallocate(log->fd, log->size, size - log->size);
+        if (res != 0) {
+                errno = res;
+                return -1;
+        }
+        if (log->map == NULL) {
+                map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, log->fd, 0);
+        } else {
+                map = mremap(log->map, log->size, size, MREMAP_MAYMOVE);
+        }
+        if (map == MAP_FAILED) {
+                return -1;
+        }
+        if (log->map != NULL) {
+                mtalk_log_prefault((unsigned char *)map + log->size, size - log->size);
+        }
+        log->map = map;
+        log->size = size;
+        log->header = map;
+        return 0;
+}
+
+/** Creates a log at path, preallocating prealloc bytes (and adding
+ * that much again whenever it fills up).  Returns zero on success,
+ * or -1 with errno set.
+ */
+static inline int mtalk_log_create(struct mtalk_log *log, const char path[], size_t prealloc,
+                                   uint64_t realtime_ns, uint64_t monotonic_ns)
+{
+        memset(log, 0, sizeof(*log));
+        log->grow = prealloc < 65536 ? 65536 : prealloc;
+        log->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (log->fd < 0) {
+                return -1;
+        }
+        if (mtalk_log_resize(log, log->grow) < 0) {
+                close(log->fd);
+                return -1;
+        }
+        memcpy(log->header->magic, MTALK_LOG_MAGIC, sizeof(log->header->magic));
+        log->header->version = MTALK_LOG_VERSION;
+        log->header->header_size = sizeof(*log->header);
+        log->header->start_realtime_ns = realtime_ns;
+        log->header->start_monotonic_ns = monotonic_ns;
+        log->header->used = 0;
+        return 0;
+}
+
+/** Grows log by another step if fewer than ahead bytes are left past
+ * its last record.  Call it from somewhere that can afford the wait,
+ * so mtalk_log_append() seldom has to.  Returns zero on success, or
+ * -1 with errno set if the file could not grow.
+ */
+static inline int mtalk_log_reserve(struct mtalk_log *log, size_t ahead)
+{
+        size_t pos;
+
+        pos = sizeof(*log->header) + log->header->used;
+        if (log->size - pos >= ahead) {
+                return 0;
+        }
+        return mtalk_log_resize(log, log->size + (ahead > log->grow ? ahead : log->grow));
+}
+
+/** Appends one packet to log.  Returns zero on success, or -1 with
+ * errno set if the file could not grow.
+ */
+static inline int mtalk_log_append(struct mtalk_log *log, uint64_t timestamp_ns, int channel,
+                                   int device, const unsigned char data[], unsigned int length)
+{
+        struct mtalk_log_record *rec;
+        size_t pos;
+        size_t need;
+
+        pos = sizeof(*log->header) + log->header->used;
+        need = MTALK_LOG_RECORD_SIZE(length);
+        if (pos + need > log->size && mtalk_log_resize(log, log->size + log->grow) < 0) {
+                return -1;
+        }
+        rec = (struct mtalk_log_record *)(log->map + pos);
+        rec->timestamp_ns = timestamp_ns;
+        rec->length = length;
+        rec->channel = channel;
+        rec->device = device;
+        rec->reserved = 0;
+        memcpy(rec + 1, data, length);
+        log->header->used += need;
+        return 0;
+}
+
+/** Trims log to the records written so far and closes it. */
+static inline void mtalk_log_close(struct mtalk_log *log)
+{
+        size_t used;
+
+        if (log->map == NULL) {
+                return;
+        }
+        used = sizeof(*log->header) + log->header->used;
+        munmap(log->map, log->size);
+        if (ftruncate(log->fd, used) < 0) {
+                /* Not fatal: readers stop at header->used anyway. */
+        }
+        close(log->fd);
+        log->map = NULL;
+}
+
+/** A log that is being read. */
+struct mtalk_log_reader {
+        const unsigned char *map;
+        size_t size;
+        size_t pos;
+        size_t end;
+        const struct mtalk_log_header *header;
+};
+
+/** Maps the log at path for reading.  Returns zero on success, -1
+ * with errno set on failure (EINVAL if it is not an mtalk log).
+ */
+static inline int mtalk_log_open(struct mtalk_log_reader *rd, const char path[])
+{
+        struct stat st;
+        void *map;
+        int fd;
+
+        memset(rd, 0, sizeof(*rd));
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                return -1;
+        }
+        if (fstat(fd, &st) < 0) {
+                close(fd);
+                return -1;
+        }
+        if ((size_t)st.st_size < sizeof(struct mtalk_log_header)) {
+                close(fd);
+                errno = EINVAL;
+                return -1;
+        }
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+                return -1;
+        }
+        rd->map = map;
+        rd->size = st.st_size;
+        rd->header = map;
+        if (memcmp(rd->header->magic, MTALK_LOG_MAGIC, sizeof(rd->header->magic))
+            || rd->header->version != MTALK_LOG_VERSION
+            || rd->header->header_size < sizeof(*rd->header)) {
+                munmap(map, st.st_size);
+                errno = EINVAL;
+                return -1;
+        }
+        rd->pos = rd->header->header_size;
+        rd->end = rd->pos + rd->header->used;
+        if (rd->end > rd->size) {
+                rd->end = rd->size;
+        }
+        return 0;
+}
+
+/** Returns the next record in the log, or NULL at the end.  The
+ * packet data follows the record.
+ */
+static inline const struct mtalk_log_record *mtalk_log_next(struct mtalk_log_reader *rd)
+{
+        const struct mtalk_log_record *rec;
+
+        if (rd->pos + sizeof(*rec) > rd->end) {
+                return NULL;
+        }
+        rec = (const struct mtalk_log_record *)(rd->map + rd->pos);
+        if (rd->pos + MTALK_LOG_RECORD_SIZE(rec->length) > rd->end) {
+                return NULL;
+        }
+        rd->pos += MTALK_LOG_RECORD_SIZE(rec->length);
+        return rec;
+}
+
+static inline void mtalk_log_unmap(struct mtalk_log_reader *rd)
+{
+        if (rd->map != NULL) {
+                munmap((void *)rd->map, rd->size);
+                rd->map = NULL;
+        }
+}
+
+#endif /* !defined(MTALK_LOG_H) */
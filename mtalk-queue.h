@@ -0,0 +1,230 @@
+/* Copyright 2010 Michael Poole.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* A queue from one producer thread to one consumer thread.
+ *
+ * mtalk --async hands packets from the thread that reads the sockets
+ * to a writer thread through this queue, so that slow output never
+ * delays a read.  Slots are fixed-size and preallocated; neither side
+ * takes a lock, and neither makes a system call unless the other is
+ * asleep waiting for it.
+ *
+ * Slots use the same sequence words as the shared memory ring in
+ * mtalk-shm.h, which lets the producer overwrite the oldest slot
+ * under MTALK_QUEUE_DROP_OLDEST without the consumer's help: the
+ * consumer notices, skips ahead and counts what it lost.
+ */
+
+#if !defined(MTALK_QUEUE_H)
+#define MTALK_QUEUE_H
+
+#include <errno.h>       /* errno */
+#include <stdint.h>      /* sized integer types */
+#include <stdlib.h>      /* aligned_alloc(), free() */
+#include <string.h>      /* memcpy() */
+#include <sys/eventfd.h> /* eventfd() */
+#include <unistd.h>      /* read(), write(), close() */
+
+/* What mtalk_queue_begin() does when the queue is full. */
+#define MTALK_QUEUE_DROP_OLDEST 0 /* overwrite the oldest item */
+#define MTALK_QUEUE_BLOCK       1 /* wait for the consumer */
+#define MTALK_QUEUE_DROP        2 /* discard the new item */
+
+struct mtalk_queue {
+        unsigned char *slots;
+        /** Bytes in an item, and in a slot with its sequence word. */
+        size_t item_size;
+        size_t slot_size;
+        /** Number of slots; a power of two. */
+        uint64_t capacity;
+        int policy;
+
+        /** Producer side: next item to write, and items discarded. */
+        uint64_t tail __attribute__((aligned(64)));
+        uint64_t dropped;
+        int producer_waiting;
+        int producer_efd;
+
+        /** Consumer side: next item to read, and items overwritten. */
+        uint64_t head __attribute__((aligned(64)));
+        uint64_t lost;
+        int consumer_waiting;
+        int consumer_efd;
+};
+
+static inline uint64_t *mtalk_queue_seq(struct mtalk_queue *q, uint64_t n)
+{
+        return (uint64_t *)(q->slots + (n & (q->capacity - 1)) * q->slot_size);
+}
+
+/** Sets up \a q with \a capacity slots (a power of two) that each
+ * hold \a size bytes, using \a policy when it is full.  Returns zero
+ * on success or -1 with errno set.
+ */
+static inline int mtalk_queue_init(struct mtalk_queue *q, uint64_t capacity, size_t size, int policy)
+{
+        uint64_t ii;
+
+        memset(q, 0, sizeof(*q));
+        q->item_size = size;
+        q->slot_size = (sizeof(uint64_t) + size + 63) & ~(size_t)63;
+        q->capacity = capacity;
+        q->policy = policy;
+        q->slots = aligned_alloc(64, q->slot_size * capacity);
+        if (q->slots == NULL) {
+                return -1;
+        }
+        for (ii = 0; ii < capacity; ii++) {
+                *mtalk_queue_seq(q, ii) = 0;
+        }
+        q->producer_efd = eventfd(0, EFD_CLOEXEC);
+        q->consumer_efd = eventfd(0, EFD_CLOEXEC);
+        if (q->producer_efd < 0 || q->consumer_efd < 0) {
+                free(q->slots);
+                return -1;
+        }
+        return 0;
+}
+
+static inline void mtalk_queue_destroy(struct mtalk_queue *q)
+{
+        close(q->producer_efd);
+        close(q->consumer_efd);
+        free(q->slots);
+        q->slots = NULL;
+}
+
+/* Sleeps on efd until the other side signals it, unless done() is
+ * already true once *waiting is visible to the other side.
+ */
+static inline void mtalk_queue_wait(struct mtalk_queue *q, int *waiting, int efd,
+                                    int (*done)(struct mtalk_queue *))
+{
+        uint64_t count;
+
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+        if (!done(q)) {
+                while (read(efd, &count, sizeof(count)) < 0 && errno == EINTR) {
+                        /* keep waiting */
+                }
+        }
+        __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+}
+
+/* Wakes the other side if it is asleep in mtalk_queue_wait(). */
+static inline void mtalk_queue_wake(int *waiting, int efd)
+{
+        uint64_t one = 1;
+
+        if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+                while (write(efd, &one, sizeof(one)) < 0 && errno == EINTR) {
+                        /* keep trying */
+                }
+        }
+}
+
+static inline int mtalk_queue_has_room(struct mtalk_queue *q)
+{
+        return q->tail - __atomic_load_n(&q->head, __ATOMIC_SEQ_CST) < q->capacity;
+}
+
+static inline int mtalk_queue_has_items(struct mtalk_queue *q)
+{
+        return __atomic_load_n(&q->tail, __ATOMIC_SEQ_CST) != q->head;
+}
+
+/** Starts writing the next item, applying \a policy (normally
+ * q->policy) if the queue is full.  Returns where to put the item,
+ * then call mtalk_queue_commit(); or NULL if it was dropped.
+ */
+static inline void *mtalk_queue_begin(struct mtalk_queue *q, int policy)
+{
+        uint64_t *seq;
+
+        if (policy != MTALK_QUEUE_DROP_OLDEST) {
+                while (!mtalk_queue_has_room(q)) {
+                        if (policy == MTALK_QUEUE_DROP) {
+                                q->dropped++;
+                                return NULL;
+                        }
+                        mtalk_queue_wait(q, &q->producer_waiting, q->producer_efd, mtalk_queue_has_room);
+                }
+        }
+        seq = mtalk_queue_seq(q, q->tail);
+        __atomic_store_n(seq, 2 * q->tail + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        return seq + 1;
+}
+
+/** Publishes the item started by mtalk_queue_begin(). */
+static inline void mtalk_queue_commit(struct mtalk_queue *q)
+{
+        uint64_t n = q->tail;
+
+        __atomic_store_n(mtalk_queue_seq(q, n), 2 * n + 2, __ATOMIC_RELEASE);
+        __atomic_store_n(&q->tail, n + 1, __ATOMIC_SEQ_CST);
+        mtalk_queue_wake(&q->consumer_waiting, q->consumer_efd);
+}
+
+/** Copies the next item to \a out, which has room for the size given
+ * to mtalk_queue_init().  If the queue is empty, waits for an item
+ * if \a wait is set and otherwise returns zero.  Returns 1 if there
+ * was an item.
+ */
+static inline int mtalk_queue_get(struct mtalk_queue *q, void *out, int wait)
+{
+        const uint64_t *seq;
+        uint64_t tail;
+        uint64_t s;
+
+        for (;;) {
+                tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+                if (q->head == tail) {
+                        if (!wait) {
+                                return 0;
+                        }
+                        mtalk_queue_wait(q, &q->consumer_waiting, q->consumer_efd, mtalk_queue_has_items);
+                        continue;
+                }
+                if (tail - q->head > q->capacity) {
+                        q->lost += tail - q->capacity - q->head;
+                        q->head = tail - q->capacity;
+                }
+                seq = mtalk_queue_seq(q, q->head);
+                s = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+                if (s == 2 * q->head + 2) {
+                        memcpy(out, seq + 1, q->item_size);
+                        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                        if (__atomic_load_n(seq, __ATOMIC_RELAXED) == s) {
+                                __atomic_store_n(&q->head, q->head + 1, __ATOMIC_SEQ_CST);
+                                mtalk_queue_wake(&q->producer_waiting, q->producer_efd);
+                                return 1;
+                        }
+                }
+                /* The producer lapped us while we looked; skip it. */
+                q->lost++;
+                __atomic_store_n(&q->head, q->head + 1, __ATOMIC_SEQ_CST);
+        }
+}
+
+#endif /* !defined(MTALK_QUEUE_H) */
@@ -0,0 +1,471 @@
+/* Copyright 2010 Michael Poole.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Just enough SDP to fetch a HID report descriptor.
+ *
+ * mtalk_sdp_query() sends ServiceSearchAttributeRequests over a
+ * connected socket (L2CAP PSM 1 for a real device), following
+ * continuation states until it has the whole attribute list, and
+ * mtalk_sdp_hid_descriptor() digs the report descriptor out of the
+ * HIDDescriptorList attribute.  mtalk_sdp_serve() is the other end,
+ * for simulated mice: it answers those requests for one descriptor,
+ * in small pieces so that the client has to use continuations.
+ *
+ * Everything is big-endian on the wire.  Nothing here allocates.
+ */
+
+#if !defined(MTALK_SDP_H)
+#define MTALK_SDP_H
+
+#include <errno.h>     /* errno */
+#include <poll.h>      /* poll() */
+#include <stdint.h>    /* sized integer types */
+#include <string.h>    /* memcpy() */
+#include <sys/socket.h> /* send(), recv() */
+
+/* The PSM of the SDP server. */
+#define MTALK_SDP_PSM 1
+
+/* PDU IDs. */
+#define MTALK_SDP_ERROR_RSP                0x01
+#define MTALK_SDP_SERVICE_SEARCH_ATTR_REQ  0x06
+#define MTALK_SDP_SERVICE_SEARCH_ATTR_RSP  0x07
+
+/* Error codes in MTALK_SDP_ERROR_RSP. */
+#define MTALK_SDP_ERR_INVALID_SYNTAX       0x0003
+#define MTALK_SDP_ERR_INVALID_CONTINUATION 0x0005
+
+/* Data element types, from the top five bits of each header. */
+#define MTALK_SDP_NIL    0
+#define MTALK_SDP_UINT   1
+#define MTALK_SDP_INT    2
+#define MTALK_SDP_UUID   3
+#define MTALK_SDP_STRING 4
+#define MTALK_SDP_BOOL   5
+#define MTALK_SDP_SEQ    6
+#define MTALK_SDP_ALT    7
+#define MTALK_SDP_URL    8
+
+/* The HID service class, its HIDDescriptorList attribute, and the
+ * descriptor type of a report descriptor within that list.
+ */
+#define MTALK_SDP_UUID_HID            0x1124
+#define MTALK_SDP_ATTR_HID_DESCRIPTOR 0x0206
+#define MTALK_SDP_REPORT_DESCRIPTOR   0x22
+
+/* Largest PDU either end sends or accepts, and the longest
+ * continuation state.
+ */
+#define MTALK_SDP_MTU        672
+#define MTALK_SDP_MAX_CONT   16
+
+/* How long to wait for each response, in milliseconds. */
+#define MTALK_SDP_TIMEOUT 5000
+
+/** Reads the header of the data element at \a data[*pos]: sets \a
+ * type to its MTALK_SDP_* type and \a size to the length of its body,
+ * and moves *pos to the start of the body.  Returns zero, or -1 if
+ * the header or body runs past \a len.
+ */
+static inline int mtalk_sdp_element(const unsigned char data[], int len, int *pos, int *type, int *size)
+{
+        unsigned int idx;
+        int p = *pos;
+
+        if (p >= len) {
+                return -1;
+        }
+        *type = data[p] >> 3;
+        idx = data[p++] & 7;
+        if (idx < 5) {
+                *size = *type == MTALK_SDP_NIL ? 0 : 1 << idx;
+        } else if (idx == 5 && p + 1 <= len) {
+                *size = data[p];
+                p += 1;
+        } else if (idx == 6 && p + 2 <= len) {
+                *size = data[p] << 8 | data[p + 1];
+                p += 2;
+        } else if (idx == 7 && p + 4 <= len && data[p] == 0 && data[p + 1] == 0) {
+                /* Anything over 64 KiB would not fit in a response. */
+                *size = data[p + 2] << 8 | data[p + 3];
+                p += 4;
+        } else {
+                return -1;
+        }
+        if (*size > len - p) {
+                return -1;
+        }
+        *pos = p;
+        return 0;
+}
+
+/** Writes a data element header for \a type with a \a size-byte
+ * body, using the shortest length form that fits.  Returns the
+ * header's length.
+ */
+static inline int mtalk_sdp_put_header(unsigned char buf[], int type, int size)
+{
+        if (size < 256) {
+                buf[0] = type << 3 | 5;
+                buf[1] = size;
+                return 2;
+        }
+        buf[0] = type << 3 | 6;
+        buf[1] = size >> 8;
+        buf[2] = size;
+        return 3;
+}
+
+/* Length of the header mtalk_sdp_put_header() writes. */
+static inline int mtalk_sdp_header_size(int size)
+{
+        return size < 256 ? 2 : 3;
+}
+
+/** Finds the first report descriptor in \a lists, the attribute
+ * lists from a ServiceSearchAttributeResponse, and points \a desc and
+ * \a desc_len at it.  Returns zero, or -1 if there is none or the
+ * lists are malformed.
+ */
+static inline int mtalk_sdp_hid_descriptor(const unsigned char lists[], int len,
+                                           const unsigned char **desc, int *desc_len)
+{
+        int type, size;
+        int rec_end, attr_end, list_end, pair_end;
+        int pos, id;
+
+        /* A sequence of records... */
+        pos = 0;
+        if (mtalk_sdp_element(lists, len, &pos, &type, &size) || type != MTALK_SDP_SEQ) {
+                return -1;
+        }
+        while (pos < len) {
+                /* ... each a sequence of (ID, value) pairs... */
+                if (mtalk_sdp_element(lists, len, &pos, &type, &size) || type != MTALK_SDP_SEQ) {
+                        return -1;
+                }
+                rec_end = pos + size;
+                while (pos < rec_end) {
+                        if (mtalk_sdp_element(lists, rec_end, &pos, &type, &size)
+                            || type != MTALK_SDP_UINT || size != 2) {
+                                return -1;
+                        }
+                        id = lists[pos] << 8 | lists[pos + 1];
+                        pos += size;
+                        if (mtalk_sdp_element(lists, rec_end, &pos, &type, &size)) {
+                                return -1;
+                        }
+                        attr_end = pos + size;
+                        if (id != MTALK_SDP_ATTR_HID_DESCRIPTOR || type != MTALK_SDP_SEQ) {
+                                pos = attr_end;
+                                continue;
+                        }
+                        /* ... where HIDDescriptorList is a sequence
+                         * of (type, descriptor) sequences.
+                         */
+                        while (pos < attr_end) {
+                                if (mtalk_sdp_element(lists, attr_end, &pos, &type, &size)
+                                    || type != MTALK_SDP_SEQ) {
+                                        return -1;
+                                }
+                                list_end = pos + size;
+                                pair_end = list_end;
+                                if (mtalk_sdp_element(lists, pair_end, &pos, &type, &size) == 0
+                                    && type == MTALK_SDP_UINT && size == 1
+                                    && lists[pos] == MTALK_SDP_REPORT_DESCRIPTOR) {
+                                        pos += size;
+                                        if (mtalk_sdp_element(lists, pair_end, &pos, &type, &size)
+                                            || type != MTALK_SDP_STRING) {
+                                                return -1;
+                                        }
+                                        *desc = lists + pos;
+                                        *desc_len = size;
+                                        return 0;
+                                }
+                                pos = list_end;
+                        }
+                }
+        }
+        return -1;
+}
+
+/** Writes a ServiceSearchAttributeRequest for attribute \a attr of
+ * services with class \a uuid to \a buf.  Returns its length.
+ */
+static inline int mtalk_sdp_request(unsigned char buf[], unsigned int tid, uint16_t uuid, uint16_t attr,
+                                    unsigned int max_count, const unsigned char cont[], int cont_len)
+{
+        int len = 13 + cont_len;
+
+        buf[0] = MTALK_SDP_SERVICE_SEARCH_ATTR_REQ;
+        buf[1] = tid >> 8;
+        buf[2] = tid;
+        buf[3] = len >> 8;
+        buf[4] = len;
+        /* ServiceSearchPattern: one 16-bit UUID. */
+        buf[5] = MTALK_SDP_SEQ << 3 | 5;
+        buf[6] = 3;
+        buf[7] = MTALK_SDP_UUID << 3 | 1;
+        buf[8] = uuid >> 8;
+        buf[9] = uuid;
+        /* MaximumAttributeByteCount. */
+        buf[10] = max_count >> 8;
+        buf[11] = max_count;
+        /* AttributeIDList: one 16-bit ID. */
+        buf[12] = MTALK_SDP_SEQ << 3 | 5;
+        buf[13] = 3;
+        buf[14] = MTALK_SDP_UINT << 3 | 1;
+        buf[15] = attr >> 8;
+        buf[16] = attr;
+        buf[17] = cont_len;
+        memcpy(buf + 18, cont, cont_len);
+        return 5 + len;
+}
+
+/** Asks the SDP server on \a fd for attribute \a attr of services
+ * with class \a uuid, and copies the attribute lists from the
+ * responses into \a buf.  Returns their length, or -1 with errno set:
+ * EPROTO for an error or malformed response, EMSGSIZE if they do not
+ * fit in \a size bytes, and ETIMEDOUT if the server stops answering.
+ */
+static inline int mtalk_sdp_query(int fd, uint16_t uuid, uint16_t attr, unsigned char buf[], int size)
+{
+        unsigned char cont[MTALK_SDP_MAX_CONT];
+        unsigned char pdu[MTALK_SDP_MTU];
+        struct pollfd pfd;
+        unsigned int tid;
+        int cont_len;
+        int count;
+        int total;
+        int plen;
+        int res;
+
+        total = 0;
+        cont_len = 0;
+        for (tid = 1; ; tid++) {
+                res = mtalk_sdp_request(pdu, tid, uuid, attr, MTALK_SDP_MTU - 10, cont, cont_len);
+                if (send(fd, pdu, res, 0) < 0) {
+                        return -1;
+                }
+                pfd.fd = fd;
+                pfd.events = POLLIN;
+                res = poll(&pfd, 1, MTALK_SDP_TIMEOUT);
+                if (res <= 0) {
+                        errno = res < 0 ? errno : ETIMEDOUT;
+                        return -1;
+                }
+                res = recv(fd, pdu, sizeof(pdu), 0);
+                if (res < 0) {
+                        return -1;
+                }
+
+                /* Header, then AttributeListsByteCount, the lists
+                 * and a continuation state.
+                 */
+                if (res < 5 || pdu[0] != MTALK_SDP_SERVICE_SEARCH_ATTR_RSP
+                    || (unsigned int)(pdu[1] << 8 | pdu[2]) != (tid & 0xffff)) {
+                        errno = EPROTO;
+                        return -1;
+                }
+                plen = pdu[3] << 8 | pdu[4];
+                if (plen < 3 || 5 + plen > res) {
+                        errno = EPROTO;
+                        return -1;
+                }
+                count = pdu[5] << 8 | pdu[6];
+                if (2 + count + 1 > plen) {
+                        errno = EPROTO;
+                        return -1;
+                }
+                cont_len = pdu[7 + count];
+                if (cont_len > MTALK_SDP_MAX_CONT || 2 + count + 1 + cont_len > plen) {
+                        errno = EPROTO;
+                        return -1;
+                }
+                if (total + count > size) {
+                        errno = EMSGSIZE;
+                        return -1;
+                }
+                memcpy(buf + total, pdu + 7, count);
+                total += count;
+                if (cont_len == 0) {
+                        return total;
+                }
+                memcpy(cont, pdu + 8 + count, cont_len);
+        }
+}
+
+/** Writes an error response for transaction \a tid to \a buf. */
+static inline int mtalk_sdp_error(unsigned char buf[], unsigned int tid, unsigned int code)
+{
+        buf[0] = MTALK_SDP_ERROR_RSP;
+        buf[1] = tid >> 8;
+        buf[2] = tid;
+        buf[3] = 0;
+        buf[4] = 2;
+        buf[5] = code >> 8;
+        buf[6] = code;
+        return 7;
+}
+
+/** Answers ServiceSearchAttributeRequests on \a fd as a HID device
+ * with report descriptor \a desc, until the client hangs up.  Each
+ * response carries at most \a chunk bytes of the attribute lists.
+ * The lists always hold just HIDDescriptorList, and are empty if the
+ * search pattern does not include the HID service class.  Returns
+ * zero once the client hangs up, or -1 on error.
+ */
+static inline int mtalk_sdp_serve(int fd, const unsigned char desc[], int desc_len, int chunk)
+{
+        unsigned char lists[MTALK_SDP_MTU * 4];
+        unsigned char req[MTALK_SDP_MTU];
+        unsigned char rsp[MTALK_SDP_MTU];
+        int s_string, s_pair, s_entry, s_list, s_attrs, s_record, total;
+        int type, size, end, pos;
+        unsigned int tid;
+        unsigned int offset;
+        int count;
+        int found;
+        int res;
+
+        /* The records: SEQ { SEQ { 0x0206, SEQ { SEQ { 0x22,
+         * STRING desc } } } }, built from the inside out.
+         */
+        s_string = mtalk_sdp_header_size(desc_len) + desc_len;
+        s_pair = 2 + s_string;
+        s_entry = mtalk_sdp_header_size(s_pair) + s_pair;
+        s_list = mtalk_sdp_header_size(s_entry) + s_entry;
+        s_attrs = 3 + s_list;
+        s_record = mtalk_sdp_header_size(s_attrs) + s_attrs;
+        total = mtalk_sdp_header_size(s_record) + s_record;
+        if (total > (int)sizeof(lists) || chunk < 1 || chunk > MTALK_SDP_MTU - 10) {
+                errno = EINVAL;
+                return -1;
+        }
+
+        for (;;) {
+                res = recv(fd, req, sizeof(req), 0);
+                if (res <= 0) {
+                        return res;
+                }
+                tid = res >= 3 ? req[1] << 8 | req[2] : 0;
+
+                /* Check the header, then look for the HID class in
+                 * the search pattern.
+                 */
+                pos = 5;
+                if (res < 5 || req[0] != MTALK_SDP_SERVICE_SEARCH_ATTR_REQ
+                    || 5 + (req[3] << 8 | req[4]) != res
+                    || mtalk_sdp_element(req, res, &pos, &type, &size) || type != MTALK_SDP_SEQ) {
+                        res = mtalk_sdp_error(rsp, tid, MTALK_SDP_ERR_INVALID_SYNTAX);
+                        goto reply;
+                }
+                end = pos + size;
+                found = 0;
+                while (pos < end) {
+                        if (mtalk_sdp_element(req, end, &pos, &type, &size)) {
+                                break;
+                        }
+                        if (type == MTALK_SDP_UUID && size == 2
+                            && (req[pos] << 8 | req[pos + 1]) == MTALK_SDP_UUID_HID) {
+                                found = 1;
+                        }
+                        pos += size;
+                }
+                if (pos != end || end + 2 > res) {
+                        res = mtalk_sdp_error(rsp, tid, MTALK_SDP_ERR_INVALID_SYNTAX);
+                        goto reply;
+                }
+                count = req[end] << 8 | req[end + 1];
+                if (count > chunk) {
+                        count = chunk;
+                }
+                pos = end + 2;
+                if (mtalk_sdp_element(req, res, &pos, &type, &size) || type != MTALK_SDP_SEQ
+                    || pos + size >= res || count < 1) {
+                        res = mtalk_sdp_error(rsp, tid, MTALK_SDP_ERR_INVALID_SYNTAX);
+                        goto reply;
+                }
+                pos += size;
+
+                /* Our continuation state is the offset to resume at. */
+                offset = 0;
+                if (req[pos] == 2 && pos + 3 == res) {
+                        offset = req[pos + 1] << 8 | req[pos + 2];
+                } else if (req[pos] != 0 || pos + 1 != res) {
+                        res = mtalk_sdp_error(rsp, tid, MTALK_SDP_ERR_INVALID_CONTINUATION);
+                        goto reply;
+                }
+
+                if (!found) {
+                        total = 2;
+                        lists[0] = MTALK_SDP_SEQ << 3 | 5;
+                        lists[1] = 0;
+                } else {
+                        total = mtalk_sdp_put_header(lists, MTALK_SDP_SEQ, s_record);
+                        total += mtalk_sdp_put_header(lists + total, MTALK_SDP_SEQ, s_attrs);
+                        lists[total++] = MTALK_SDP_UINT << 3 | 1;
+                        lists[total++] = MTALK_SDP_ATTR_HID_DESCRIPTOR >> 8;
+                        lists[total++] = MTALK_SDP_ATTR_HID_DESCRIPTOR & 255;
+                        total += mtalk_sdp_put_header(lists + total, MTALK_SDP_SEQ, s_entry);
+                        total += mtalk_sdp_put_header(lists + total, MTALK_SDP_SEQ, s_pair);
+                        lists[total++] = MTALK_SDP_UINT << 3 | 0;
+                        lists[total++] = MTALK_SDP_REPORT_DESCRIPTOR;
+                        total += mtalk_sdp_put_header(lists + total, MTALK_SDP_STRING, desc_len);
+                        memcpy(lists + total, desc, desc_len);
+                        total += desc_len;
+                }
+                if (offset > (unsigned int)total) {
+                        res = mtalk_sdp_error(rsp, tid, MTALK_SDP_ERR_INVALID_CONTINUATION);
+                        goto reply;
+                }
+                if (count > total - (int)offset) {
+                        count = total - offset;
+                }
+
+                rsp[0] = MTALK_SDP_SERVICE_SEARCH_ATTR_RSP;
+                rsp[1] = tid >> 8;
+                rsp[2] = tid;
+                rsp[5] = count >> 8;
+                rsp[6] = count;
+                memcpy(rsp + 7, lists + offset, count);
+                res = 7 + count;
+                offset += count;
+                if (offset < (unsigned int)total) {
+                        rsp[res++] = 2;
+                        rsp[res++] = offset >> 8;
+                        rsp[res++] = offset;
+                } else {
+                        rsp[res++] = 0;
+                }
+                rsp[3] = (res - 5) >> 8;
+                rsp[4] = res - 5;
+
+        reply:
+                if (send(fd, rsp, res, 0) < 0) {
+                        return -1;
+                }
+        }
+}
+
+#endif /* !defined(MTALK_SDP_H) */
@@ -0,0 +1,275 @@
+/* Copyright 2010 Michael Poole.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Decoded touch frames in shared memory.
+ *
+ * mtalk --shm publishes every decoded report into a ring of
+ * fixed-size slots in a POSIX shared memory object.  There is one
+ * writer and any number of readers; nobody takes a lock or makes a
+ * system call per frame.
+ *
+ * Frame n goes in slot n % capacity.  Each slot has a sequence word
+ * that is odd while the writer is filling it and 2n + 2 once frame n
+ * is complete, and the header's head counts frames published.  A
+ * reader copies a slot, then checks that its sequence word did not
+ * change; if it did, or if head has moved more than capacity frames
+ * past the reader, the reader has been overrun and skips ahead.
+ */
+
+#if !defined(MTALK_SHM_H)
+#define MTALK_SHM_H
+
+#include <errno.h>     /* errno */
+#include <fcntl.h>     /* O_* */
+#include <stdint.h>    /* sized integer types */
+#include <string.h>    /* memcpy(), memset() */
+#include <sys/mman.h>  /* shm_open(), mmap() */
+#include <sys/stat.h>  /* fstat() */
+#include <unistd.h>    /* ftruncate(), close() */
+
+#define MTALK_SHM_MAGIC    "MTALKSHM"
+#define MTALK_SHM_VERSION  2
+#define MTALK_SHM_TOUCHES  16
+
+/* Bits in mtalk_shm_touch::flags. */
+#define MTALK_SHM_TRACKED  0x01
+
+/** One touch, as decoded by mtalk (Y grows toward the user). */
+struct mtalk_shm_touch {
+        int16_t x;
+        int16_t y;
+        uint8_t id;
+        uint8_t major;
+        uint8_t minor;
+        uint8_t size;
+        int8_t orientation;
+        uint8_t state;
+        /** MTALK_SHM_TRACKED if the estimates below are filled in. */
+        uint8_t flags;
+        uint8_t reserved;
+        /** From mtalk --track: velocity, in units per 1000 device
+         * ticks, and acceleration, in units per 1000 ticks squared.
+         */
+        int16_t vx;
+        int16_t vy;
+        int16_t ax;
+        int16_t ay;
+};
+
+/** One decoded report. */
+struct mtalk_shm_frame {
+        /** Sequence word; see the comment at the top of this file. */
+        uint64_t seq;
+        /** Kernel receive time (CLOCK_REALTIME), in nanoseconds. */
+        int64_t rx_ns;
+        /** Device timestamp from 0x29 reports (18 bits). */
+        uint32_t timestamp;
+        /** Index of the device within the publishing mtalk. */
+        uint8_t device;
+        /** FRAME_MOTION (1) or FRAME_TOUCH (2). */
+        uint8_t type;
+        uint8_t buttons;
+        uint8_t ntouches;
+        int16_t dx;
+        int16_t dy;
+        uint8_t reserved[4];
+        struct mtalk_shm_touch touch[MTALK_SHM_TOUCHES];
+};
+
+/** The start of the shared memory object; slots follow it. */
+struct mtalk_shm_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_size;
+        uint32_t frame_size;
+        /** Number of slots; a power of two. */
+        uint32_t capacity;
+        /** Frames published so far. */
+        uint64_t head;
+        uint8_t reserved[32];
+};
+
+static inline struct mtalk_shm_frame *mtalk_shm_slot(struct mtalk_shm_header *h, uint64_t n)
+{
+        return (struct mtalk_shm_frame *)((char *)h + h->header_size) + (n & (h->capacity - 1));
+}
+
+/** Creates (or replaces) the shared memory object \a name with room
+ * for \a capacity frames, which must be a power of two.  Returns the
+ * mapped header, or NULL with errno set.
+ */
+static inline struct mtalk_shm_header *mtalk_shm_create(const char name[], uint32_t capacity)
+{
+        struct mtalk_shm_header *h;
+        size_t size;
+        void *map;
+        int fd;
+
+        size = sizeof(*h) + (size_t)capacity * sizeof(struct mtalk_shm_frame);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+                return NULL;
+        }
+        if (ftruncate(fd, size) < 0) {
+                close(fd);
+                return NULL;
+        }
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+                return NULL;
+        }
+        h = map;
+        memset(h, 0, sizeof(*h));
+        h->version = MTALK_SHM_VERSION;
+        h->header_size = sizeof(*h);
+        h->frame_size = sizeof(struct mtalk_shm_frame);
+        h->capacity = capacity;
+        __atomic_store_n(&h->head, 0, __ATOMIC_RELEASE);
+        /* Write the magic last, so readers that see it see the rest. */
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        memcpy(h->magic, MTALK_SHM_MAGIC, sizeof(h->magic));
+        return h;
+}
+
+/** Starts writing the next frame; fill it in, then call
+ * mtalk_shm_commit().
+ */
+static inline struct mtalk_shm_frame *mtalk_shm_begin(struct mtalk_shm_header *h)
+{
+        uint64_t n = h->head;
+        struct mtalk_shm_frame *f = mtalk_shm_slot(h, n);
+
+        __atomic_store_n(&f->seq, 2 * n + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        return f;
+}
+
+/** Publishes the frame started by mtalk_shm_begin(). */
+static inline void mtalk_shm_commit(struct mtalk_shm_header *h, struct mtalk_shm_frame *f)
+{
+        uint64_t n = h->head;
+
+        __atomic_store_n(&f->seq, 2 * n + 2, __ATOMIC_RELEASE);
+        __atomic_store_n(&h->head, n + 1, __ATOMIC_RELEASE);
+}
+
+/** A reader's view of the ring. */
+struct mtalk_shm_reader {
+        struct mtalk_shm_header *header;
+        size_t size;
+        /** Next frame to read. */
+        uint64_t next;
+        /** Frames overwritten before this reader got to them. */
+        uint64_t lost;
+};
+
+/** Maps the shared memory object \a name for reading, starting at
+ * the newest frame.  Returns zero on success, or -1 with errno set
+ * (EINVAL if it is not an mtalk ring).
+ */
+static inline int mtalk_shm_open(struct mtalk_shm_reader *r, const char name[])
+{
+        struct mtalk_shm_header *h;
+        struct stat st;
+        void *map;
+        int fd;
+
+        fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0) {
+                return -1;
+        }
+        if (fstat(fd, &st) < 0) {
+                close(fd);
+                return -1;
+        }
+        if ((size_t)st.st_size < sizeof(*h)) {
+                close(fd);
+                errno = EINVAL;
+                return -1;
+        }
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+                return -1;
+        }
+        h = map;
+        if (memcmp(h->magic, MTALK_SHM_MAGIC, sizeof(h->magic))
+            || h->version != MTALK_SHM_VERSION
+            || h->frame_size != sizeof(struct mtalk_shm_frame)
+            || h->capacity == 0 || (h->capacity & (h->capacity - 1))
+            || h->header_size + (size_t)h->capacity * h->frame_size > (size_t)st.st_size) {
+                munmap(map, st.st_size);
+                errno = EINVAL;
+                return -1;
+        }
+        r->header = h;
+        r->size = st.st_size;
+        r->next = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+        r->lost = 0;
+        return 0;
+}
+
+/** Copies the next frame to \a out.  Returns 1 if there was one, or
+ * zero if the reader has caught up.  Frames that were overwritten
+ * before they could be read are counted in r->lost and skipped.
+ */
+static inline int mtalk_shm_read(struct mtalk_shm_reader *r, struct mtalk_shm_frame *out)
+{
+        struct mtalk_shm_header *h = r->header;
+        const struct mtalk_shm_frame *f;
+        uint64_t head;
+        uint64_t seq;
+
+        for (;;) {
+                head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+                if (r->next >= head) {
+                        return 0;
+                }
+                if (head - r->next > h->capacity) {
+                        r->lost += head - h->capacity - r->next;
+                        r->next = head - h->capacity;
+                }
+                f = mtalk_shm_slot(h, r->next);
+                seq = __atomic_load_n(&f->seq, __ATOMIC_ACQUIRE);
+                if (seq == 2 * r->next + 2) {
+                        memcpy(out, f, sizeof(*out));
+                        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                        if (__atomic_load_n(&f->seq, __ATOMIC_RELAXED) == seq) {
+                                r->next++;
+                                return 1;
+                        }
+                }
+                /* The writer lapped us while we looked; skip it. */
+                r->lost++;
+                r->next++;
+        }
+}
+
+static inline void mtalk_shm_close(struct mtalk_shm_reader *r)
+{
+        munmap(r->header, r->size);
+        r->header = NULL;
+}
+
+#endif /* !defined(MTALK_SHM_H) */
@@ -0,0 +1,441 @@
+/* Copyright 2010 Michael Poole.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* A simulated Magic Mouse.
+ *
+ * mtalk_sim_run() plays the mouse's side of the HID control and
+ * interrupt channels over a pair of connected SOCK_SEQPACKET sockets.
+ * It acknowledges SET_REPORT requests on the control channel the way
+ * the mouse does, answers GET_REPORT for the feature reports it has
+ * been sent, and once it has seen the 0xf8 feature write that turns
+ * on touch reporting, it streams interrupt reports: 0x29 touch
+ * reports with up to 16 fingers following configurable paths, an
+ * occasional 0x10 motion report, 0x61 "light lost"/"laser
+ * re-established" pairs, and optionally some malformed reports.
+ * mtalk_sim_next() can also be used on its own to generate reports
+ * without any sockets.
+ *
+ * Nobody knows what the last byte of the 0xf8 write (0x32 from
+ * mtalk) does on a real mouse.  The simulator pretends it scales the
+ * report interval, with 0x32 giving the configured rate, so that
+ * mtalk --probe has something to find.
+ *
+ * Reports are built with the encoders below, which are the inverse
+ * of mtalk's decoders and use the same bit layout.
+ */
+
+#if !defined(MTALK_SIM_H)
+#define MTALK_SIM_H
+
+#include <errno.h>      /* errno */
+#include <math.h>       /* sinf(), cosf() */
+#include <stdint.h>     /* sized integer types */
+#include <string.h>     /* memset() */
+#include <sys/socket.h> /* send(), recv() */
+#include <time.h>       /* clock_nanosleep() */
+
+/* HIDP transaction types, from the Bluetooth HID profile. */
+#define HIDP_HANDSHAKE   0x00
+#define HIDP_GET_REPORT  0x40
+#define HIDP_SET_REPORT  0x50
+#define HIDP_DATA        0xa0
+
+/* HIDP handshake result codes. */
+#define HIDP_HSHK_SUCCESSFUL            0x00
+#define HIDP_HSHK_ERR_INVALID_REPORT_ID 0x02
+#define HIDP_HSHK_ERR_UNSUPPORTED       0x03
+
+/* Report types, in the low bits of a HIDP header. */
+#define HIDP_INPUT   0x01
+#define HIDP_OUTPUT  0x02
+#define HIDP_FEATURE 0x03
+
+/* Simulated reports per second unless the caller says otherwise. */
+#define MTALK_SIM_RATE 90
+
+/* The last byte of the 0xf8 feature write that gives that rate. */
+#define MTALK_SIM_F8_NOMINAL 0x32
+
+/* What the simulated link reports in place of L2CAP options and an
+ * HCI controller's readings: the default L2CAP MTU, no flush timeout
+ * (0xffff means never flush), and the link mode bits for an
+ * authenticated, encrypted link where we are master.
+ */
+#define MTALK_SIM_MTU       672
+#define MTALK_SIM_FLUSH_TO  0xffff
+#define MTALK_SIM_LINK_MODE 0x0007
+
+/* Most bytes of attribute lists per response from the SDP stand-in
+ * (see mtalk-sdp.h); small enough that the descriptor takes several.
+ */
+#define MTALK_SIM_SDP_CHUNK 48
+
+/** Sets \a rssi and \a quality to the simulated link's \a n'th
+ * reading.  They wander around -50 dBm and 248 in a fixed pattern,
+ * so runs are repeatable.
+ */
+static inline void mtalk_sim_link(unsigned int n, int *rssi, int *quality)
+{
+        *rssi = -55 + (int)(n * 7 % 11);
+        *quality = 255 - (int)(n * 13 % 16);
+}
+
+/** Writes the 8-byte form of one touch to \a td.  \a y is in the
+ * mouse's own orientation (negative toward the Apple logo).
+ */
+static inline void mtalk_sim_encode_touch(unsigned char td[8], int id, int x, int y,
+                                          int major, int minor, int size,
+                                          int angle, int state)
+{
+        uint32_t x_y = (x & 0xfff) | (y & 0xfff) << 12;
+        unsigned int misc = (size & 63) | (id & 15) << 6 | (angle & 63) << 10;
+
+        td[0] = x_y;
+        td[1] = x_y >> 8;
+        td[2] = x_y >> 16;
+        td[3] = major;
+        td[4] = minor;
+        td[5] = misc;
+        td[6] = misc >> 8;
+        td[7] = state;
+}
+
+/** Writes the header of a 0x29 touch report, with room for \a
+ * ntouches touches, to \a buf.  Returns the report's length.
+ */
+static inline int mtalk_sim_encode_touch_header(unsigned char buf[], int dx, int dy,
+                                                int buttons, uint32_t timestamp,
+                                                int ntouches)
+{
+        uint32_t misc = (buttons & 3) | (timestamp & 0x3ffff) << 6;
+
+        buf[0] = HIDP_DATA | HIDP_INPUT;
+        buf[1] = 0x29;
+        buf[2] = dx;
+        buf[3] = dy;
+        buf[4] = misc;
+        buf[5] = misc >> 8;
+        buf[6] = misc >> 16;
+        return 7 + 8 * ntouches;
+}
+
+/** Writes a 0x10 motion report to \a buf.  Returns its length. */
+static inline int mtalk_sim_encode_motion(unsigned char buf[], int dx, int dy, int buttons)
+{
+        buf[0] = HIDP_DATA | HIDP_INPUT;
+        buf[1] = 0x10;
+        buf[2] = buttons & 3;
+        buf[3] = dx;
+        buf[4] = dx >> 8;
+        buf[5] = dy;
+        buf[6] = dy >> 8;
+        return 7;
+}
+
+/* Paths for simulated fingers. */
+#define MTALK_SIM_CIRCLE 0 /* each finger circles its own spot */
+#define MTALK_SIM_LINE   1 /* fingers sweep side to side together */
+#define MTALK_SIM_RANDOM 2 /* each finger wanders at random */
+
+/** What the simulator generates. */
+struct mtalk_sim_params {
+        /** Reports per second, or zero for as fast as possible. */
+        unsigned int rate;
+        /** Fingers on the mouse, up to 16. */
+        unsigned int fingers;
+        /** One of MTALK_SIM_CIRCLE, etc. */
+        int path;
+        /** Malformed reports per thousand. */
+        unsigned int bad;
+        /** Reports to send before hanging up, or zero for no limit. */
+        uint64_t frames;
+        /** Reports to send before dropping out, as if the mouse went
+         * out of range, or zero for never.
+         */
+        uint64_t drop;
+        /** Seed for MTALK_SIM_RANDOM and malformed reports. */
+        uint32_t seed;
+};
+
+static inline void mtalk_sim_defaults(struct mtalk_sim_params *p)
+{
+        p->rate = MTALK_SIM_RATE;
+        p->fingers = 1;
+        p->path = MTALK_SIM_CIRCLE;
+        p->bad = 0;
+        p->frames = 0;
+        p->drop = 0;
+        p->seed = 1;
+}
+
+/** The simulator's state. */
+struct mtalk_sim {
+        const struct mtalk_sim_params *params;
+        int ctrl;
+        int intr;
+        /** Non-zero once touch reporting has been turned on. */
+        int streaming;
+        /** The last 0xd7 and 0xf8 feature reports written to us. */
+        unsigned char feature_d7[1];
+        unsigned char feature_f8[2];
+        /** Reports generated so far. */
+        uint64_t frame;
+        /** Device timestamp (18 bits).  The real mouse's unit is not
+         * known; the simulator counts microseconds.
+         */
+        uint32_t timestamp;
+        /** xorshift32 state. */
+        uint32_t random;
+        /** Positions for MTALK_SIM_RANDOM. */
+        int x[16];
+        int y[16];
+};
+
+static inline void mtalk_sim_init(struct mtalk_sim *sim, const struct mtalk_sim_params *p)
+{
+        unsigned int ii;
+
+        sim->params = p;
+        sim->ctrl = -1;
+        sim->intr = -1;
+        sim->streaming = 0;
+        sim->feature_d7[0] = 0;
+        sim->feature_f8[0] = 0;
+        sim->feature_f8[1] = MTALK_SIM_F8_NOMINAL;
+        sim->frame = 0;
+        sim->timestamp = 0;
+        sim->random = p->seed ? p->seed : 1;
+        for (ii = 0; ii < 16; ii++) {
+                sim->x[ii] = -900 + 140 * ii;
+                sim->y[ii] = 0;
+        }
+}
+
+static inline uint32_t mtalk_sim_random(struct mtalk_sim *sim)
+{
+        sim->random ^= sim->random << 13;
+        sim->random ^= sim->random >> 17;
+        sim->random ^= sim->random << 5;
+        return sim->random;
+}
+
+/* Answers everything waiting on the control channel, first waiting
+ * for a request if wait is non-zero.  Returns -1 if the host went
+ * away.
+ */
+static inline int mtalk_sim_control(struct mtalk_sim *sim, int wait)
+{
+        unsigned char buf[256];
+        unsigned char reply[4];
+        size_t len;
+        ssize_t res;
+
+        while ((res = recv(sim->ctrl, buf, sizeof(buf), wait ? 0 : MSG_DONTWAIT)) > 0) {
+                wait = 0;
+                reply[0] = HIDP_HANDSHAKE | HIDP_HSHK_SUCCESSFUL;
+                len = 1;
+                switch (buf[0] & 0xf0) {
+                case HIDP_SET_REPORT:
+                        if (res >= 3 && buf[1] == 0xd7) {
+                                sim->feature_d7[0] = buf[2];
+                        } else if (res >= 3 && buf[1] == 0xf8) {
+                                sim->feature_f8[0] = buf[2];
+                                if (res >= 4) {
+                                        sim->feature_f8[1] = buf[3];
+                                }
+                                sim->streaming = 1;
+                        }
+                        break;
+                case HIDP_GET_REPORT:
+                        reply[0] = HIDP_DATA | (buf[0] & 3);
+                        if (res >= 2 && buf[1] == 0xd7) {
+                                reply[1] = 0xd7;
+                                reply[2] = sim->feature_d7[0];
+                                len = 3;
+                        } else if (res >= 2 && buf[1] == 0xf8) {
+                                reply[1] = 0xf8;
+                                reply[2] = sim->feature_f8[0];
+                                reply[3] = sim->feature_f8[1];
+                                len = 4;
+                        } else {
+                                reply[0] = HIDP_HANDSHAKE | HIDP_HSHK_ERR_INVALID_REPORT_ID;
+                        }
+                        break;
+                default:
+                        reply[0] = HIDP_HANDSHAKE | HIDP_HSHK_ERR_UNSUPPORTED;
+                        break;
+                }
+                if (send(sim->ctrl, reply, len, MSG_NOSIGNAL) < 0) {
+                        return -1;
+                }
+        }
+        if (res == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                return -1;
+        }
+        return 0;
+}
+
+/* Returns the time between reports, in nanoseconds, or zero to send
+ * them as fast as possible.
+ */
+static inline uint64_t mtalk_sim_interval(const struct mtalk_sim *sim)
+{
+        unsigned int scale = sim->feature_f8[1] ? sim->feature_f8[1] : 1;
+
+        if (sim->params->rate == 0) {
+                return 0;
+        }
+        return (uint64_t)1000000000 * scale / MTALK_SIM_F8_NOMINAL / sim->params->rate;
+}
+
+/* Damages the report in buf, which is len bytes long, in one of a
+ * few ways that decoders must survive.  Returns its new length.
+ */
+static inline int mtalk_sim_corrupt(struct mtalk_sim *sim, unsigned char buf[], int len)
+{
+        uint32_t r = mtalk_sim_random(sim);
+
+        switch (r & 3) {
+        case 0: /* Truncated. */
+                return len > 2 ? 2 + (int)((r >> 8) % (len - 2)) : len;
+        case 1: /* A stray trailing byte. */
+                buf[len] = r >> 8;
+                return len + 1;
+        case 2: /* More touches than the mouse has IDs. */
+                memset(buf + len, 0, 7 + 17 * 8 - len);
+                return 7 + 17 * 8;
+        default: /* Unknown report ID. */
+                buf[1] ^= 0x80;
+                return len;
+        }
+}
+
+/* Builds the next interrupt report in buf, which must hold at least
+ * 256 bytes.  Returns its length.
+ *
+ * Reports come in cycles of 600.  For the first 400, the fingers
+ * touch and follow their paths; for the rest they are lifted.  Every
+ * tenth report is a 0x10 motion report, and the laser is briefly
+ * lost once per cycle.
+ */
+static inline int mtalk_sim_next(struct mtalk_sim *sim, unsigned char buf[])
+{
+        const struct mtalk_sim_params *p = sim->params;
+        unsigned int phase = sim->frame % 600;
+        float angle = sim->frame * 0.05f;
+        float a;
+        unsigned int ii;
+        int len;
+        int x;
+        int y;
+
+        sim->frame++;
+        sim->timestamp += p->rate ? mtalk_sim_interval(sim) / 1000 : 1;
+        if (phase == 500 || phase == 501) {
+                buf[0] = HIDP_DATA | HIDP_INPUT;
+                buf[1] = 0x61;
+                buf[2] = phase == 500 ? 0x01 : 0x00;
+                len = 3;
+        } else if (phase % 10 == 9) {
+                len = mtalk_sim_encode_motion(buf, (int)(4 * cosf(angle)), (int)(4 * sinf(angle)), 0);
+        } else if (phase >= 400) {
+                len = mtalk_sim_encode_touch_header(buf, 0, 0, 0, sim->timestamp, 0);
+        } else {
+                len = mtalk_sim_encode_touch_header(buf, 0, 0, 0, sim->timestamp, p->fingers);
+                for (ii = 0; ii < p->fingers; ii++) {
+                        switch (p->path) {
+                        case MTALK_SIM_LINE:
+                                a = sinf(angle);
+                                x = (int)(1000 * a);
+                                y = -1200 + 250 * ii;
+                                break;
+                        case MTALK_SIM_RANDOM:
+                                sim->x[ii] += (int)(mtalk_sim_random(sim) % 41) - 20;
+                                sim->y[ii] += (int)(mtalk_sim_random(sim) % 41) - 20;
+                                sim->x[ii] = sim->x[ii] < -1100 ? -1100 : sim->x[ii] > 1358 ? 1358 : sim->x[ii];
+                                sim->y[ii] = sim->y[ii] < -2047 ? -2047 : sim->y[ii] > 1600 ? 1600 : sim->y[ii];
+                                x = sim->x[ii];
+                                y = sim->y[ii];
+                                break;
+                        default:
+                                a = angle + ii * 0.4f;
+                                x = -700 + 130 * ii + (int)(250 * cosf(a));
+                                y = (int)(900 * sinf(a));
+                                break;
+                        }
+                        mtalk_sim_encode_touch(buf + 7 + 8 * ii, ii, x, y, 40, 32, 20, 32,
+                                               phase == 0 ? 0x30 : 0x40);
+                }
+        }
+
+        if (p->bad && mtalk_sim_random(sim) % 1000 < p->bad) {
+                len = mtalk_sim_corrupt(sim, buf, len);
+        }
+        return len;
+}
+
+/** Runs the simulated mouse until the host closes either channel or
+ * p->frames reports have been sent.  Returns -1 if it stopped after
+ * p->drop reports instead, or zero.
+ */
+static inline int mtalk_sim_run(int ctrl, int intr, const struct mtalk_sim_params *p)
+{
+        struct mtalk_sim sim;
+        struct timespec next;
+        unsigned char buf[256];
+        int len;
+
+        mtalk_sim_init(&sim, p);
+        sim.ctrl = ctrl;
+        sim.intr = intr;
+        clock_gettime(CLOCK_MONOTONIC, &next);
+        while (p->frames == 0 || sim.frame < p->frames) {
+                if (mtalk_sim_control(&sim, !sim.streaming) < 0) {
+                        return 0;
+                }
+                if (p->drop && sim.frame >= p->drop) {
+                        return -1;
+                }
+                if (!sim.streaming) {
+                        clock_gettime(CLOCK_MONOTONIC, &next);
+                        continue;
+                }
+                if (p->rate) {
+                        next.tv_nsec += mtalk_sim_interval(&sim);
+                        while (next.tv_nsec >= 1000000000) {
+                                next.tv_nsec -= 1000000000;
+                                next.tv_sec++;
+                        }
+                        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+                                /* keep waiting */
+                        }
+                }
+                len = mtalk_sim_next(&sim, buf);
+                if (send(sim.intr, buf, len, MSG_NOSIGNAL) < 0) {
+                        return 0;
+                }
+        }
+        return 0;
+}
+
+#endif /* !defined(MTALK_SIM_H) */
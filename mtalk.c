@@ -21,16 +21,46 @@
  * SOFTWARE.
  */
 
+#define _GNU_SOURCE 1 /* recvmmsg() */
+
 #include <byteswap.h> /* bswap_16() */
 #include <errno.h>  /* errno */
+#include <fcntl.h>  /* open() */
+#include <getopt.h> /* getopt_long() */
+#include <limits.h> /* PATH_MAX */
 #include <locale.h> /* setlocale() */
-#include <math.h>   /* ldexpf() */
-#include <poll.h>   /* poll(), etc */
+#include <math.h>   /* ldexpf(), log1p(), sqrt() */
+#include <poll.h>   /* poll() */
+#include <pthread.h> /* pthread_create(), etc */
+#include <sched.h>  /* sched_setscheduler(), etc */
+#include <signal.h> /* sigprocmask(), etc */
+#include <stdint.h> /* uint64_t */
 #include <stdio.h>  /* sscanf(), fprintf() */
 #include <stdlib.h> /* exit() */
 #include <string.h> /* memcpy(), strerror() */
+#include <sys/epoll.h> /* epoll_create1(), etc */
+#include <sys/ioctl.h> /* ioctl() */
+#include <sys/signalfd.h> /* signalfd() */
 #include <sys/socket.h> /* socket(), etc */
+#include <sys/stat.h> /* mkdir() */
+#include <sys/mman.h> /* mlockall() */
+#include <sys/prctl.h> /* prctl() */
+#include <sys/resource.h> /* getrusage() */
+#include <sys/timerfd.h> /* timerfd_create(), etc */
+#include <sys/wait.h> /* waitpid() */
+#include <time.h>   /* clock_gettime() */
 #include <unistd.h> /* close(), getopt(), etc */
+#include <linux/uinput.h> /* UI_DEV_SETUP, etc */
+
+#include "hid-report.h"
+#include "hid-usages.h"
+#include "magicmouse-desc.h"
+#include "magicmouse-report.h"
+#include "mtalk-log.h"
+#include "mtalk-queue.h"
+#include "mtalk-sdp.h"
+#include "mtalk-shm.h"
+#include "mtalk-sim.h"
 
 #if !defined(AF_BLUETOOTH)
 # define AF_BLUETOOTH 31
@@ -59,13 +89,531 @@ struct sockaddr_l2 {
         unsigned short  l2_cid;
 };
 
+#if !defined(BTPROTO_HCI)
+# define BTPROTO_HCI 1
+#endif
+
+#if !defined(SOL_L2CAP)
+# define SOL_L2CAP 6
+#endif
+
+/* L2CAP socket options, from the kernel's l2cap.h. */
+#define L2CAP_OPTIONS  0x01
+#define L2CAP_CONNINFO 0x02
+
+struct l2cap_options {
+        uint16_t        omtu;
+        uint16_t        imtu;
+        uint16_t        flush_to;
+        uint8_t         mode;
+        uint8_t         fcs;
+        uint8_t         max_tx;
+        uint16_t        txwin_size;
+};
+
+struct l2cap_conninfo {
+        uint16_t        hci_handle;
+        uint8_t         dev_class[3];
+};
+
+/* Raw HCI sockets, from the kernel's hci.h and hci_sock.h. */
+#define SOL_HCI        0
+#define HCI_FILTER     2
+#define HCI_MAX_DEV    16
+#define HCI_COMMAND_PKT 0x01
+#define HCI_EVENT_PKT  0x04
+#define HCI_EV_CMD_COMPLETE 0x0e
+#define HCI_OP_READ_LINK_QUALITY 0x1403
+#define HCI_OP_READ_RSSI 0x1405
+#define ACL_LINK       1
+#define HCIGETCONNINFO _IOR('H', 213, int)
+
+/* Bits in hci_conn_info::link_mode. */
+#define HCI_LM_MASTER   0x0001
+#define HCI_LM_AUTH     0x0002
+#define HCI_LM_ENCRYPT  0x0004
+#define HCI_LM_TRUSTED  0x0008
+#define HCI_LM_RELIABLE 0x0010
+#define HCI_LM_SECURE   0x0020
+
+struct sockaddr_hci {
+        sa_family_t     hci_family;
+        unsigned short  hci_dev;
+        unsigned short  hci_channel;
+};
+
+struct hci_filter {
+        uint32_t        type_mask;
+        uint32_t        event_mask[2];
+        uint16_t        opcode;
+};
+
+struct hci_conn_info {
+        uint16_t        handle;
+        bdaddr_t        bdaddr;
+        uint8_t         type;
+        uint8_t         out;
+        uint16_t        state;
+        uint32_t        link_mode;
+};
+
+struct hci_conn_info_req {
+        bdaddr_t        bdaddr;
+        uint8_t         type;
+        struct hci_conn_info conn_info[1];
+};
+
 bdaddr_t local;
-bdaddr_t remote;
 
 int ctrl_psm = 0x11;
 int intr_psm = 0x13;
-int ctrl;
-int intr;
+
+/* What simulated mice should send. */
+struct mtalk_sim_params sim_params;
+
+/* Non-zero to generate reports (with sim_params) into record_file
+ * instead of talking to any mouse.
+ */
+int generate;
+
+/* Seconds between statistics reports; zero to disable them. */
+int stats_interval;
+
+/* Most packets to read per recvmmsg() call, and the largest packet. */
+#define MAX_BATCH 64
+#define MAX_PACKET 256
+int batch_size = 16;
+
+/* Socket receive buffer size; zero to leave the default. */
+int rcvbuf_size;
+
+/* L2CAP incoming MTU and flush timeout (in milliseconds) to ask for,
+ * and the sockets' priority; zero (or -1 for the priority) to leave
+ * the defaults.
+ */
+int l2cap_imtu;
+int l2cap_flush_to;
+int socket_priority = -1;
+
+/* Non-zero to print each report's receive timestamp. */
+int print_timestamps;
+
+/* Buffered text output.  Reports are formatted straight into buf,
+ * which is written out when it fills up and after each batch of
+ * packets, so the read loop makes one write() per wakeup at most.
+ */
+#define OUTPUT_SIZE 65536
+struct output {
+        int fd;
+        size_t len;
+        char buf[OUTPUT_SIZE];
+};
+struct output std_output = { STDOUT_FILENO, 0, { 0 } };
+
+/* Log-linear histograms: values below 2^HIST_SUB_BITS get a bucket
+ * each, and each power of two above that is split into
+ * 2^HIST_SUB_BITS buckets, so any value is within about 6% of its
+ * bucket's lower bound.
+ */
+#define HIST_SUB_BITS 4
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+struct histogram {
+        const char *name;
+        const char *unit;
+        uint64_t count;
+        uint64_t min;
+        uint64_t max;
+        uint64_t bucket[HIST_BUCKETS];
+};
+
+/* Non-zero to measure latency and report timing. */
+int measure_latency;
+
+/* Kernel receive time to decode completion, time between reports
+ * on a device, and the change in a device's own timestamp.
+ */
+struct histogram hist_decode = { "rx-to-decode", "ns", 0, 0, 0, { 0 } };
+struct histogram hist_gap = { "report gap", "ns", 0, 0, 0, { 0 } };
+struct histogram hist_device = { "device T delta", "ticks", 0, 0, 0, { 0 } };
+
+/* Non-zero while replaying a log, when receive times are not real. */
+int replaying;
+
+/* Shared memory ring to publish decoded frames in, and its size. */
+const char *shm_name;
+uint32_t shm_capacity = 4096;
+struct mtalk_shm_header *shm;
+
+/* --summary lines per second, or zero to print every report. */
+int summary_rate;
+
+/* Non-zero to print recognized gestures instead of every report. */
+int detect_gestures;
+
+/* --heatmap file name prefix, and seconds between snapshots. */
+const char *heatmap_prefix;
+int heatmap_interval = 60;
+
+/* Non-zero to estimate each touch's velocity and acceleration. */
+int track_touches;
+
+/* Non-zero to print decoded reports as NDJSON rather than text. */
+int print_json;
+
+/* --async: slots in the queue to the writer thread (zero to handle
+ * packets on the reading thread), and what to do when it is full.
+ */
+uint64_t async_slots;
+int queue_policy = MTALK_QUEUE_DROP_OLDEST;
+
+/* --probe: how many round trips to time on the control channel,
+ * which values of the 0xf8 write's last byte to try, and how many
+ * milliseconds to measure each for.
+ */
+int probe;
+struct probe_params {
+        unsigned int rounds;
+        unsigned int from;
+        unsigned int to;
+        unsigned int step;
+        unsigned int dwell;
+} probe_params = { 100, 0x02, 0x62, 0x10, 1000 };
+
+/* --reconnect: the longest wait between attempts to reconnect to a
+ * mouse that went away, in milliseconds, or zero to give up on it.
+ */
+unsigned int reconnect_max_ms;
+
+/* First wait between reconnect attempts; each failure doubles it. */
+#define RECONNECT_MIN_MS 100
+
+/* --sdp: non-zero to fetch each mouse's report descriptor and decode
+ * the reports it declares, and the directory that caches descriptors
+ * by address (empty for no cache).
+ */
+int use_sdp;
+char sdp_cache[PATH_MAX];
+
+/* Non-zero to check the report decoder and exit. */
+int run_selftest;
+
+/* Non-zero if anything needs reports decoded into struct frame. */
+int decode_frames;
+
+/* SCHED_FIFO priority for --rt, or zero; CPU to pin to, or -1. */
+int rt_priority;
+int rt_cpu = -1;
+
+/* Session log to write, and how much to preallocate for it. */
+const char *record_file;
+size_t record_prealloc = 64 << 20;
+struct mtalk_log record_log;
+
+/* Session log to replay instead of talking to a mouse. */
+const char *replay_file;
+int replay_paced;
+
+/* CLOCK_REALTIME minus CLOCK_MONOTONIC, in nanoseconds. */
+int64_t realtime_offset;
+
+/* Non-zero to feed reports to uinput devices instead of printing. */
+int use_uinput;
+
+/* The mouse reports touch IDs 0 through 15. */
+#define MAX_TOUCHES MAGICMOUSE_MAX_TOUCHES
+
+/* Frame types. */
+#define FRAME_NONE   MAGICMOUSE_NONE
+#define FRAME_MOTION MAGICMOUSE_MOTION /* 0x10: buttons and relative motion */
+#define FRAME_TOUCH  MAGICMOUSE_TOUCH  /* 0x29: buttons, motion and touches */
+
+/* One decoded motion or touch report. */
+struct frame {
+        /* The report itself, from magicmouse_decode(). */
+        struct magicmouse_report r;
+        /* From --track, for each of r.touch: velocity in units per
+         * 1000 device ticks, and acceleration in units per 1000 ticks
+         * squared.
+         */
+        struct touch_motion {
+                int vx;
+                int vy;
+                int ax;
+                int ay;
+        } motion[MAX_TOUCHES];
+        /* Non-zero if motion[] is filled in. */
+        int tracked;
+};
+
+/* Packets and bytes read from each channel since the last report. */
+struct channel_stats {
+        unsigned long packets;
+        unsigned long bytes;
+};
+
+/* A uinput device and the multitouch state it has been sent. */
+struct uinput_state {
+        int fd;
+        /* Tracking ID in each slot, and which slots are in use. */
+        int tracking[MAX_TOUCHES];
+        unsigned int active;
+        int next_tracking_id;
+        int last_buttons;
+        int last_tool;
+};
+
+/* Transports, as indexes into transports[]. */
+#define TRANSPORT_L2CAP 0
+#define TRANSPORT_SIM   1
+
+/* Gesture thresholds, in touch position units and nanoseconds. */
+#define TAP_SLOP        40
+#define TAP_TIME        250000000
+#define SCROLL_MIN      40
+#define PINCH_MIN       80
+#define SWIPE_MIN       400
+#define GESTURE_HISTORY 8
+
+/* Gesture modes. */
+#define GESTURE_NONE   0
+#define GESTURE_SCROLL 1
+#define GESTURE_PINCH  2
+#define GESTURE_SWIPE  3
+
+/* Recent positions of one touch, newest at head. */
+struct touch_history {
+        int x[GESTURE_HISTORY];
+        int y[GESTURE_HISTORY];
+        int64_t t[GESTURE_HISTORY];
+        unsigned int head;
+        unsigned int count;
+        /* Where the touch was when the current gesture started. */
+        int start_x;
+        int start_y;
+};
+
+/* Gesture recognizer state for one device.  A contact lasts from the
+ * first finger down to the last finger up; within it, the mode is
+ * chosen again whenever the set of fingers changes.
+ */
+struct gestures {
+        struct touch_history touch[MAX_TOUCHES];
+        /* Touch IDs that are down. */
+        unsigned int active;
+        int mode;
+        /* Most fingers down at once, and when the first went down. */
+        int fingers;
+        int64_t down_t;
+        /* Non-zero once any touch has moved more than TAP_SLOP. */
+        int moved;
+        /* Centroid at the last frame, and finger spacing at the start
+         * of the gesture, for scroll and pinch.
+         */
+        int last_cx;
+        int last_cy;
+        int start_dist;
+        int last_scale;
+};
+
+/* Trajectory tracking.  Estimates are Q8 fixed point, per
+ * TRACK_TICKS device ticks; a touch unseen for TRACK_STALE ticks
+ * starts over.  The filter gains are 1/2, 1/4 and 1/16.
+ */
+#define TRACK_TICKS   1000
+#define TRACK_STALE   0x10000
+#define TRACK_SAMPLES 4
+
+/* Recent samples of one touch and the alpha-beta-gamma filter state
+ * for it.  The filter starts from finite differences of the first
+ * three samples.
+ */
+struct track {
+        int x[TRACK_SAMPLES];
+        int y[TRACK_SAMPLES];
+        int64_t t[TRACK_SAMPLES];
+        unsigned int head;
+        unsigned int count;
+        int64_t fx, fy;
+        int64_t vx, vy;
+        int64_t ax, ay;
+};
+
+/* Tracker state for one device. */
+struct tracker {
+        /* Device timestamp, unwrapped from its 18 bits. */
+        int64_t clock;
+        unsigned int last_timestamp;
+        int have_timestamp;
+        /* Touch IDs seen in the last frame. */
+        unsigned int active;
+        struct track track[MAX_TOUCHES];
+};
+
+/* The heatmap covers the touch surface (in struct frame's axes) in
+ * square cells of 1 << HEAT_CELL_BITS units.  Cells are stored in
+ * HEAT_TILE x HEAT_TILE tiles, so nearby touches in either direction
+ * land in the same few cache lines.
+ */
+#define HEAT_X_MIN      -1100
+#define HEAT_X_MAX      1358
+#define HEAT_Y_MIN      -1600
+#define HEAT_Y_MAX      2047
+#define HEAT_CELL_BITS  4
+#define HEAT_TILE       8
+#define HEAT_TILES_X    ((((HEAT_X_MAX - HEAT_X_MIN) >> HEAT_CELL_BITS) + HEAT_TILE) / HEAT_TILE)
+#define HEAT_TILES_Y    ((((HEAT_Y_MAX - HEAT_Y_MIN) >> HEAT_CELL_BITS) + HEAT_TILE) / HEAT_TILE)
+#define HEAT_WIDTH      (HEAT_TILES_X * HEAT_TILE)
+#define HEAT_HEIGHT     (HEAT_TILES_Y * HEAT_TILE)
+
+/* Touches seen in one heatmap cell, and the sums of their sizes. */
+struct heat_cell {
+        uint64_t count;
+        uint64_t major;
+        uint64_t minor;
+};
+
+struct heat_cell heatmap[HEAT_WIDTH * HEAT_HEIGHT];
+
+/* The last heatmap snapshot, the thread writing it, and whether that
+ * thread is still running or has yet to be joined.
+ */
+struct heat_cell heatmap_copy[HEAT_WIDTH * HEAT_HEIGHT];
+pthread_t heatmap_writer;
+int heatmap_running;
+int heatmap_joinable;
+
+/* One reading of a link's quality. */
+struct link_sample {
+        int rssi;
+        int quality;
+        unsigned int mode;
+};
+
+/* One mouse and everything we keep for it. */
+struct device {
+        int transport;
+        bdaddr_t remote;
+        char name[24];
+        /* Control and interrupt channels, or -1 when closed. */
+        int fds[2];
+        /* The channel whose connect() is still in progress, or -1. */
+        int connecting;
+        /* Where its reports go. */
+        struct output *out;
+        /* The simulator process, for TRANSPORT_SIM. */
+        pid_t sim_pid;
+        /* Its compiled report descriptor, from --sdp, or NULL. */
+        struct hid_layout *layout;
+        struct channel_stats stats[2];
+        struct uinput_state uinput;
+        /* Receive time (CLOCK_REALTIME) of the last report and
+         * the last device timestamp, for the latency histograms.
+         */
+        int64_t last_rx_ns;
+        unsigned int last_timestamp;
+        int have_timestamp;
+        /* Reports since the last --summary line, and the latest
+         * touch report's state.
+         */
+        struct summary {
+                unsigned long reports;
+                unsigned long touch_reports;
+                int ntouches;
+                int x;
+                int y;
+                int buttons;
+        } summary;
+        struct gestures gestures;
+        struct tracker tracker;
+        /* Reconnection state: when we lost the mouse (CLOCK_MONOTONIC
+         * ns, zero if it has not been lost or has recovered), whether
+         * it is still to be reconnected, when to try next, and totals
+         * for the session.
+         */
+        struct reconnect {
+                int64_t lost_ns;
+                int waiting;
+                int64_t retry_ns;
+                unsigned int backoff_ms;
+                unsigned int attempts;
+                unsigned int recoveries;
+                int64_t down_ns;
+                int64_t max_down_ns;
+        } reconnect;
+        /* Link parameters and quality, for --latency: the interrupt
+         * channel's L2CAP options, and RSSI and link quality readings
+         * from the HCI controller.
+         */
+        struct link {
+                int have_options;
+                unsigned int imtu;
+                unsigned int omtu;
+                unsigned int flush_to;
+                /* Readings so far, and the errno from the last
+                 * failure to take one.
+                 */
+                unsigned int samples;
+                int error;
+                /* The reading under way: which HCI requests are
+                 * still unanswered (LINK_PENDING_*), on which
+                 * adapter and connection, and the answers so far.
+                 */
+                unsigned int pending;
+                int hci_dev;
+                unsigned int hci_handle;
+                struct link_sample next;
+                int rssi;
+                int rssi_min;
+                int rssi_max;
+                long rssi_sum;
+                int quality;
+                int quality_min;
+                unsigned int mode;
+        } link;
+};
+
+#define MAX_DEVICES 64
+struct device devices[MAX_DEVICES];
+unsigned int device_count;
+
+/* If set, each device's reports go to a file named by appending the
+ * device's name to this.
+ */
+const char *output_prefix;
+
+/* How to reach a mouse: open() sets d->fds and returns 0, returns 1
+ * if it has started connecting d->fds[d->connecting] in the
+ * background, or returns -1.  Once that socket is writable,
+ * connected() carries on and returns the same way.  close()
+ * returns zero if the mouse hung up on purpose.  link() reads the
+ * link's quality into s and returns 0, returns 1 if it has asked the
+ * controller and hci_events() will finish the reading, or returns -1
+ * with errno set.  sdp() asks
+ * the mouse's SDP server for its HID descriptor list, copies the
+ * attribute lists into buf and returns their length, or returns -1
+ * with errno set.
+ */
+struct transport {
+        const char *name;
+        int (*open)(struct device *d);
+        int (*connected)(struct device *d);
+        int (*close)(struct device *d);
+        int (*link)(struct device *d, int epfd, struct link_sample *s);
+        int (*sdp)(struct device *d, unsigned char buf[], int size);
+};
+
+/* Tags for epoll_event.data.u32: the low two bits say what the event
+ * is for, and the rest are the device index for EV_CTRL and EV_INTR,
+ * or which timer or other descriptor it is.
+ */
+#define EV_CTRL   0
+#define EV_INTR   1
+#define EV_SIGNAL 2
+#define EV_TIMER  3
+#define EV_SUMMARY (1 << 2 | EV_TIMER)
+#define EV_HEATMAP (2 << 2 | EV_TIMER)
+#define EV_LOG     (3 << 2 | EV_TIMER)
+#define EV_HCI     (1 << 2 | EV_SIGNAL)
 
 int scan_bdaddr(bdaddr_t *addr, const char text[])
 {
@@ -82,13 +630,198 @@ int scan_bdaddr(bdaddr_t *addr, const char text[])
         return 0;
 }
 
+/* Adds a device using the given transport.  Returns NULL if there
+ * are too many.
+ */
+struct device *add_device(int transport)
+{
+        struct device *d;
+
+        if (device_count >= MAX_DEVICES) {
+                fprintf(stderr, "Too many devices (at most %d)\n", MAX_DEVICES);
+                return NULL;
+        }
+        d = &devices[device_count];
+        memset(d, 0, sizeof(*d));
+        d->transport = transport;
+        d->fds[0] = d->fds[1] = -1;
+        d->connecting = -1;
+        d->uinput.fd = -1;
+        snprintf(d->name, sizeof(d->name), transport == TRANSPORT_SIM ? "sim%u" : "dev%u", device_count);
+        device_count++;
+        return d;
+}
+
+/* Parses a --generate spec into sim_params.  Returns zero on
+ * success.
+ */
+int parse_generate(char *spec)
+{
+        static char *const keys[] = { "fingers", "rate", "path", "bad", "frames", "seed", "drop", NULL };
+        static char *const paths[] = { "circle", "line", "random", NULL };
+        unsigned long val;
+        char *value;
+        char *sep;
+        int key;
+
+        while (*spec != '\0') {
+                key = getsubopt(&spec, keys, &value);
+                if (key < 0 || value == NULL) {
+                        return -1;
+                }
+                if (key == 2) {
+                        for (sim_params.path = 0; paths[sim_params.path] != NULL; sim_params.path++) {
+                                if (!strcmp(value, paths[sim_params.path])) break;
+                        }
+                        if (paths[sim_params.path] == NULL) return -1;
+                        continue;
+                }
+                val = strtoul(value, &sep, 0);
+                if (*sep != '\0') {
+                        return -1;
+                }
+                switch (key) {
+                case 0:
+                        if (val > MAX_TOUCHES) return -1;
+                        sim_params.fingers = val;
+                        break;
+                case 1:
+                        if (val > 1000000) return -1;
+                        sim_params.rate = val;
+                        break;
+                case 3:
+                        if (val > 1000) return -1;
+                        sim_params.bad = val;
+                        break;
+                case 4:
+                        sim_params.frames = val;
+                        break;
+                case 5:
+                        sim_params.seed = val;
+                        break;
+                case 6:
+                        sim_params.drop = val;
+                        break;
+                }
+        }
+        return 0;
+}
+
+int parse_probe(char *spec)
+{
+        static char *const keys[] = { "rounds", "from", "to", "step", "dwell", NULL };
+        unsigned long val;
+        char *value;
+        char *sep;
+        int key;
+
+        while (*spec != '\0') {
+                key = getsubopt(&spec, keys, &value);
+                if (key < 0 || value == NULL) {
+                        return -1;
+                }
+                val = strtoul(value, &sep, 0);
+                if (*sep != '\0') {
+                        return -1;
+                }
+                switch (key) {
+                case 0:
+                        if (val < 1 || val > 1000000) return -1;
+                        probe_params.rounds = val;
+                        break;
+                case 1:
+                        if (val > 255) return -1;
+                        probe_params.from = val;
+                        break;
+                case 2:
+                        if (val > 255) return -1;
+                        probe_params.to = val;
+                        break;
+                case 3:
+                        if (val < 1 || val > 255) return -1;
+                        probe_params.step = val;
+                        break;
+                case 4:
+                        if (val < 1 || val > 3600000) return -1;
+                        probe_params.dwell = val;
+                        break;
+                }
+        }
+        return probe_params.from <= probe_params.to ? 0 : -1;
+}
+
 void parse_args(int argc, char *argv[])
 {
+        static const struct option long_opts[] = {
+                { "ctrl-psm", required_argument, NULL, 'c' },
+                { "intr-psm", required_argument, NULL, 'i' },
+                { "local", required_argument, NULL, 'l' },
+                { "remote", required_argument, NULL, 'r' },
+                { "stats", required_argument, NULL, 's' },
+                { "batch", required_argument, NULL, 'b' },
+                { "rcvbuf", required_argument, NULL, 'B' },
+                { "imtu", required_argument, NULL, 'U' },
+                { "flush-to", required_argument, NULL, 'O' },
+                { "priority", required_argument, NULL, 'V' },
+                { "timestamps", no_argument, NULL, 'T' },
+                { "latency", no_argument, NULL, 'Y' },
+                { "rt", optional_argument, NULL, 'R' },
+                { "cpu", required_argument, NULL, 'C' },
+                { "summary", optional_argument, NULL, 'Z' },
+                { "shm", required_argument, NULL, 'M' },
+                { "gestures", no_argument, NULL, 'G' },
+                { "track", no_argument, NULL, 'K' },
+                { "json", no_argument, NULL, 'J' },
+                { "async", optional_argument, NULL, 'A' },
+                { "backpressure", required_argument, NULL, 'Q' },
+                { "probe", optional_argument, NULL, 'E' },
+                { "reconnect", optional_argument, NULL, 'F' },
+                { "selftest", no_argument, NULL, 'X' },
+                { "sdp", optional_argument, NULL, 'D' },
+                { "heatmap", required_argument, NULL, 'H' },
+                { "heatmap-interval", required_argument, NULL, 'I' },
+                { "shm-frames", required_argument, NULL, 'N' },
+                { "write", required_argument, NULL, 'w' },
+                { "log-size", required_argument, NULL, 'L' },
+                { "play", required_argument, NULL, 'p' },
+                { "paced", no_argument, NULL, 'P' },
+                { "uinput", no_argument, NULL, 'u' },
+                { "sim", optional_argument, NULL, 'S' },
+                { "generate", required_argument, NULL, 'g' },
+                { "output", required_argument, NULL, 'o' },
+                { NULL, 0, NULL, 0 }
+        };
+        struct device *d;
+        long mbytes;
+        int use_sim;
         int opt;
 
-        while ((opt = getopt(argc, argv, "c:i:l:r:")) != -1) {
+        mtalk_sim_defaults(&sim_params);
+        use_sim = 0;
+
+        while ((opt = getopt_long(argc, argv, "b:B:c:g:i:l:L:o:p:Pr:s:S::Tuw:", long_opts, NULL)) != -1) {
                 switch (opt) {
                         char *sep;
+                case 'b':
+                        batch_size = strtol(optarg, &sep, 0);
+                        if (*sep != '\0' || batch_size < 1 || batch_size > MAX_BATCH) goto usage;
+                        break;
+                case 'B':
+                        rcvbuf_size = strtol(optarg, &sep, 0);
+                        if (*sep != '\0' || rcvbuf_size < 0) goto usage;
+                        break;
+                case 'U':
+                        l2cap_imtu = strtol(optarg, &sep, 0);
+                        if (*sep != '\0' || l2cap_imtu < 48 || l2cap_imtu > 65535) goto usage;
+                        break;
+                case 'O':
+                        l2cap_flush_to = strtol(optarg, &sep, 0);
+                        if (*sep != '\0' || l2cap_flush_to < 1 || l2cap_flush_to > 65535) goto usage;
+                        break;
+                case 'V':
+                        socket_priority = strtol(optarg, &sep, 0);
+                        if (*sep != '\0' || socket_priority < 0) goto usage;
+                        break;
                 case 'c':
                         ctrl_psm = strtol(optarg, &sep, 0);
                         if (ctrl_psm < 0 || ctrl_psm > 65535 || !(ctrl_psm & 1)) goto usage;
@@ -101,181 +834,3646 @@ void parse_args(int argc, char *argv[])
                         if (scan_bdaddr(&local, optarg)) goto usage;
                         break;
                 case 'r':
-                        if (scan_bdaddr(&remote, optarg)) goto usage;
+                        d = add_device(TRANSPORT_L2CAP);
+                        if (d == NULL || scan_bdaddr(&d->remote, optarg)) goto usage;
+                        snprintf(d->name, sizeof(d->name), "%02x:%02x:%02x:%02x:%02x:%02x",
+                                 d->remote.b[5], d->remote.b[4], d->remote.b[3],
+                                 d->remote.b[2], d->remote.b[1], d->remote.b[0]);
+                        break;
+                case 'o':
+                        output_prefix = optarg;
+                        break;
+                case 's':
+                        stats_interval = strtol(optarg, &sep, 0);
+                        if (*sep != '\0' || stats_interval < 0) goto usage;
+                        break;
+                case 'T':
+                        print_timestamps = 1;
+                        break;
+                case 'Y':
+                        measure_latency = 1;
+                        break;
+                case 'R':
+                        rt_priority = 50;
+                        if (optarg != NULL) {
+                                rt_priority = strtol(optarg, &sep, 0);
+                                if (*sep != '\0' || rt_priority < 1 || rt_priority > 99) goto usage;
+                        }
+                        break;
+                case 'Z':
+                        summary_rate = 10;
+                        if (optarg != NULL) {
+                                summary_rate = strtol(optarg, &sep, 0);
+                                if (*sep != '\0' || summary_rate < 1 || summary_rate > 1000) goto usage;
+                        }
+                        break;
+                case 'G':
+                        detect_gestures = 1;
+                        break;
+                case 'K':
+                        track_touches = 1;
+                        break;
+                case 'J':
+                        print_json = 1;
+                        break;
+                case 'F':
+                        reconnect_max_ms = 30000;
+                        if (optarg != NULL) {
+                                reconnect_max_ms = strtoul(optarg, &sep, 0) * 1000;
+                                if (*sep != '\0' || reconnect_max_ms < RECONNECT_MIN_MS
+                                    || reconnect_max_ms > 3600000) goto usage;
+                        }
+                        break;
+                case 'X':
+                        run_selftest = 1;
+                        break;
+                case 'D':
+                        use_sdp = 1;
+                        if (optarg != NULL) {
+                                snprintf(sdp_cache, sizeof(sdp_cache), "%s", optarg);
+                        } else if (getenv("XDG_CACHE_HOME") != NULL) {
+                                snprintf(sdp_cache, sizeof(sdp_cache), "%s/mtalk", getenv("XDG_CACHE_HOME"));
+                        } else if (getenv("HOME") != NULL) {
+                                snprintf(sdp_cache, sizeof(sdp_cache), "%s/.cache/mtalk", getenv("HOME"));
+                        }
+                        break;
+                case 'E':
+                        probe = 1;
+                        if (optarg != NULL && parse_probe(optarg)) goto usage;
+                        break;
+                case 'A':
+                        async_slots = 1024;
+                        if (optarg != NULL) {
+                                async_slots = strtoull(optarg, &sep, 0);
+                                if (*sep != '\0' || async_slots < 2 || (async_slots & (async_slots - 1))) goto usage;
+                        }
+                        break;
+                case 'Q':
+                        if (!strcmp(optarg, "drop-oldest")) {
+                                queue_policy = MTALK_QUEUE_DROP_OLDEST;
+                        } else if (!strcmp(optarg, "block")) {
+                                queue_policy = MTALK_QUEUE_BLOCK;
+                        } else if (!strcmp(optarg, "drop")) {
+                                queue_policy = MTALK_QUEUE_DROP;
+                        } else {
+                                goto usage;
+                        }
+                        break;
+                case 'H':
+                        heatmap_prefix = optarg;
+                        break;
+                case 'I':
+                        heatmap_interval = strtol(optarg, &sep, 0);
+                        if (*sep != '\0' || heatmap_interval < 1) goto usage;
+                        break;
+                case 'M':
+                        shm_name = optarg;
+                        break;
+                case 'N':
+                        shm_capacity = strtoul(optarg, &sep, 0);
+                        if (*sep != '\0' || shm_capacity < 2 || (shm_capacity & (shm_capacity - 1))) goto usage;
+                        break;
+                case 'C':
+                        rt_cpu = strtol(optarg, &sep, 0);
+                        if (*sep != '\0' || rt_cpu < 0 || rt_cpu >= CPU_SETSIZE) goto usage;
+                        break;
+                case 'w':
+                        record_file = optarg;
+                        break;
+                case 'L':
+                        mbytes = strtol(optarg, &sep, 0);
+                        if (*sep != '\0' || mbytes < 1) goto usage;
+                        record_prealloc = (size_t)mbytes << 20;
+                        break;
+                case 'p':
+                        replay_file = optarg;
+                        break;
+                case 'P':
+                        replay_paced = 1;
+                        break;
+                case 'u':
+                        use_uinput = 1;
+                        break;
+                case 'g':
+                        generate = 1;
+                        if (parse_generate(optarg)) goto usage;
+                        break;
+                case 'S':
+                        use_sim = 1;
+                        if (add_device(TRANSPORT_SIM) == NULL) goto usage;
+                        if (optarg != NULL) {
+                                sim_params.rate = strtoul(optarg, &sep, 0);
+                                if (*sep != '\0' || sim_params.rate > 1000000) goto usage;
+                        }
                         break;
                 case '?':
+                default:
                         usage:
-                        fprintf(stdout, "Usage:\n%s [-c ctrl_psm] [-i intr_psm] [-l local_addr] [-r remote_addr]\n",
+                        fprintf(stdout, "Usage:\n%s [-c ctrl_psm] [-i intr_psm] [-l local_addr] [-r remote_addr]...\n"
+                                "    [-s|--stats seconds] [-b|--batch count] [-B|--rcvbuf bytes]\n"
+                                "    [--imtu bytes] [--flush-to ms] [--priority n]\n"
+                                "    [-T|--timestamps] [--latency] [--rt[=priority]] [--cpu n] [--summary[=hz]]\n"
+                                "    [-w|--write file [-L|--log-size MiB]]\n"
+                                "    [-p|--play file [-P|--paced]] [-u|--uinput] [-S|--sim[=rate]]...\n"
+                                "    [-o|--output prefix] [--shm name [--shm-frames power-of-2]] [--gestures]\n"
+                                "    [--track] [--heatmap prefix [--heatmap-interval seconds]] [--json]\n"
+                                "    [--async[=slots] [--backpressure drop-oldest|block|drop]]\n"
+                                "    [--probe[=rounds=N,from=N,to=N,step=N,dwell=MS]]\n"
+                                "    [-g|--generate fingers=N,rate=HZ,path=circle|line|random,bad=N,frames=N,seed=N,drop=N]\n"
+                                "    [--reconnect[=max-seconds]] [--sdp[=cache-dir]] [--selftest]\n",
                                 argv[0]);
                         exit(EXIT_FAILURE);
                 }
         }
+        if (probe && replay_file != NULL) {
+                fprintf(stderr, "--probe needs a mouse, not a log\n");
+                exit(EXIT_FAILURE);
+        }
+        if (generate && !use_sim && (record_file == NULL || sim_params.frames == 0 || device_count > 0)) {
+                fprintf(stderr, "--generate needs --sim, or --write and a frame count\n");
+                exit(EXIT_FAILURE);
+        }
+        if (device_count == 0 && !generate && replay_file == NULL) {
+                /* Original behavior: one mouse at the default address. */
+                add_device(TRANSPORT_L2CAP);
+        }
+}
+
+/* Applies --imtu and --flush-to to an L2CAP socket that has not
+ * connected yet.
+ */
+int set_l2cap_options(int fd, const char name[])
+{
+        struct l2cap_options opts;
+        socklen_t len;
+        int err;
+
+        memset(&opts, 0, sizeof(opts));
+        len = sizeof(opts);
+        if (getsockopt(fd, SOL_L2CAP, L2CAP_OPTIONS, &opts, &len) < 0) {
+                err = errno;
+                fprintf(stderr, "Unable to get %s L2CAP options: %s\n", name, strerror(err));
+                return -err;
+        }
+        if (l2cap_imtu > 0) {
+                opts.imtu = l2cap_imtu;
+        }
+        if (l2cap_flush_to > 0) {
+                opts.flush_to = l2cap_flush_to;
+        }
+        if (setsockopt(fd, SOL_L2CAP, L2CAP_OPTIONS, &opts, sizeof(opts)) < 0) {
+                err = errno;
+                fprintf(stderr, "Unable to set %s L2CAP options: %s\n", name, strerror(err));
+                return -err;
+        }
+        return 0;
 }
 
-int connect_socket(const char name[], int psm)
+/* Opens an L2CAP socket to psm on remote.  With nonblock, the socket
+ * is non-blocking and may still be connecting when this returns; it
+ * becomes writable when connect() finishes.  Returns the socket or
+ * -errno.
+ */
+int connect_socket(const bdaddr_t *remote, const char name[], int psm, int nonblock)
 {
         struct sockaddr_l2 la;
         int res;
+        int err;
         int fd;
 
-        fd = socket(AF_BLUETOOTH, SOCK_SEQPACKET, BTPROTO_L2CAP);
+        fd = socket(AF_BLUETOOTH, SOCK_SEQPACKET | (nonblock ? SOCK_NONBLOCK : 0), BTPROTO_L2CAP);
         if (fd < 0) {
-                fprintf(stderr, "Unable to create %s socket: %s\n", name, strerror(errno));
-                return -errno;
+                err = errno;
+                fprintf(stderr, "Unable to create %s socket: %s\n", name, strerror(err));
+                return -err;
         }
         memset(&la, 0, sizeof(la));
         la.l2_family = AF_BLUETOOTH;
         memcpy(&la.l2_bdaddr, &local, sizeof(bdaddr_t));
         res = bind(fd, (struct sockaddr*)&la, sizeof(la));
         if (res < 0) {
-                fprintf(stderr, "Unable to bind %s socket: %s\n", name, strerror(errno));
-                return -errno;
+                err = errno;
+                fprintf(stderr, "Unable to bind %s socket: %s\n", name, strerror(err));
+                close(fd);
+                return -err;
+        }
+        if (l2cap_imtu > 0 || l2cap_flush_to > 0) {
+                res = set_l2cap_options(fd, name);
+                if (res < 0) {
+                        close(fd);
+                        return res;
+                }
         }
         memset(&la, 0, sizeof(la));
         la.l2_family = AF_BLUETOOTH;
         la.l2_psm = htobs(psm);
-        memcpy(&la.l2_bdaddr, &remote, sizeof(bdaddr_t));
+        memcpy(&la.l2_bdaddr, remote, sizeof(bdaddr_t));
         res = connect(fd, (struct sockaddr*)&la, sizeof(la));
-        if (res < 0) {
-                fprintf(stderr, "Unable to connect %s socket: %s\n", name, strerror(errno));
-                return -errno;
+        if (res < 0 && !(nonblock && errno == EINPROGRESS)) {
+                err = errno;
+                fprintf(stderr, "Unable to connect %s socket: %s\n", name, strerror(err));
+                close(fd);
+                return -err;
         }
         return fd;
 }
 
-void connect_sockets(void)
+/* Puts a connected socket back in blocking mode, asks for kernel
+ * receive timestamps and sets its receive buffer size and priority.
+ */
+int tune_socket(int fd, const char name[])
 {
-        ctrl = connect_socket("control", ctrl_psm);
-        if (ctrl < 0) {
-                exit(EXIT_FAILURE);
-        }
+        int one = 1;
+        int flags;
+        int err;
 
-        intr = connect_socket("interrupt", intr_psm);
-        if (intr < 0) {
-                exit(EXIT_FAILURE);
+        flags = fcntl(fd, F_GETFL);
+        if (flags < 0 || ((flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) < 0)) {
+                err = errno;
+                fprintf(stderr, "Unable to make %s socket blocking: %s\n", name, strerror(err));
+                return -err;
+        }
+        if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0) {
+                err = errno;
+                fprintf(stderr, "Unable to enable timestamps on %s socket: %s\n", name, strerror(err));
+                return -err;
+        }
+        if (rcvbuf_size > 0
+            && setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf_size, sizeof(rcvbuf_size)) < 0) {
+                err = errno;
+                fprintf(stderr, "Unable to set %s receive buffer: %s\n", name, strerror(err));
+                return -err;
+        }
+        if (socket_priority >= 0
+            && setsockopt(fd, SOL_SOCKET, SO_PRIORITY, &socket_priority, sizeof(socket_priority)) < 0) {
+                err = errno;
+                fprintf(stderr, "Unable to set %s priority: %s\n", name, strerror(err));
+                return -err;
         }
+        return 0;
 }
 
-void write_mystery(void)
+/* Starts connecting d's control channel.  l2cap_connected() takes
+ * over when it is writable.
+ */
+int l2cap_open(struct device *d)
 {
-        unsigned char mystery_1[] = { 0x53, 0xd7, 0x01 };
-        unsigned char mystery_2[] = { 0x53, 0xf8, 0x01, 0x32 };
-        ssize_t res;
-
-        res = send(ctrl, mystery_1, sizeof(mystery_1), 0);
-        if (res < 0) {
-                fprintf(stderr, "Cannot send first mystery on command port: %s\n", strerror(errno));
-                exit(EXIT_FAILURE);
-        }
-        res = send(ctrl, mystery_2, sizeof(mystery_2), 0);
-        if (res < 0) {
-                fprintf(stderr, "Cannot send second mystery on command port: %s\n", strerror(errno));
-                exit(EXIT_FAILURE);
+        d->fds[1] = -1;
+        d->fds[0] = connect_socket(&d->remote, "control", ctrl_psm, 1);
+        if (d->fds[0] < 0) {
+                return -1;
         }
+        d->connecting = EV_CTRL;
+        return 1;
 }
 
-void read_socket(int fd, const char name[])
+/* Carries on connecting d once d->fds[d->connecting] is writable: the
+ * control channel must be up before the interrupt channel is tried,
+ * and both are tuned once the interrupt channel is up too.
+ */
+int l2cap_connected(struct device *d)
 {
-        static const char hexdigits[] = "0123456789abcdef";
-        unsigned char data[256];
-        int res;
-        int ii;
+        static const char *const names[2] = { "control", "interrupt" };
+        struct l2cap_options opts;
+        socklen_t len;
+        int chan;
+        int err;
 
-        res = recv(fd, data, sizeof(data), MSG_DONTWAIT);
-        if (res < 0) {
-                if (errno == EAGAIN) {
-                        usleep(1000);
-                } else {
-                        fprintf(stderr, "Read error on HID %s: %s\n", name, strerror(errno));
-                }
-        } else if (data[0] == 0xa1 && (data[1] & 0xf0) == 0x60 && res == 3) {
-                if (data[1] == 0x61 && data[2] == 0x01) {
-                        fprintf(stdout, "light: lost, please put the mouse back down!\n");
-                } else if (data[1] == 0x61 && data[2] == 0x00) {
-                        fprintf(stdout, "light: laser re-established\n");
-                } else {
-                        /* Unknown report. */
-                        fprintf(stdout, "  ???: a1%02x%02x\n", data[1], data[2]);
-                }
-        } else if (data[0] == 0xa1 && data[1] == 0x10 && res == 7) {
-                /* Mouse motion, maybe click.  This actually seems to
-                 * follow the HID, so it should be parsed using report
-                 * introspection under any serious driver.
-                 */
-                fprintf(stdout, " move: rsvd?=%02x, x=%+3d, y=%+3d\n", data[2],
-                        (short)(data[3] | (data[4] << 8)),
-                        (short)(data[5] | (data[6] << 8)));
-        } else if (data[0] == 0xa1 && data[1] == 0x29 && ((res - 7) % 8 == 0)) {
-                int ntouches = (res - 5) / 8;
-                static const char btns[] = " LRB";
-                fprintf(stdout, "touch: x=%+3d y=%+3d (T=%6d%c)",
-                        (char)data[2], (char)data[3],
-                        (data[4] | (data[5] << 8) | (data[6] << 16)) >> 6,
-                        btns[data[4] & 3]);
-                for (ii = 0; ii < ntouches; ii++) {
-                        /* On my mouse, X ranges from about -1100
-                         * (left) to +1358 (right).  Y ranges from
-                         * -2047 (Apple logo) to +1600 (front of
-                         * mouse).  Angle 0 is from the left, angle
-                         * 128 is from the logo to the nose, angle 255
-                         * is from the right.
-                         */
-                        unsigned char *td = data + ii * 8 + 7;
-                        int x_y = td[0] << 8 | td[1] << 16 | td[2] << 24;
-                        int misc = td[5] << 0 | td[6] << 8;
-                        fprintf(stdout, " (ID=%d X=%+05d Y=%+05d major=%3d minor=%3d size=%2d angle=%02d state=%02x)",
-                                (misc >> 6) & 15,
-                                (x_y << 12) >> 20,
-                                (x_y <<  0) >> 20,
-                                td[3],
-                                td[4],
-                                (misc >>  0) & 63,
-                                (misc >> 10) & 63,
-                                td[7]);
-                }
-                fprintf(stdout, "\n");
-        } else {
-                fprintf(stdout, "%2d bytes %s:", res, name);
-                for (ii = 0; ii < res; ii++) {
-                        if (ii % 4 == 0) fputc(' ', stdout);
-                        fputc(hexdigits[data[ii] >> 4], stdout);
-                        fputc(hexdigits[data[ii] & 15], stdout);
+        chan = d->connecting;
+        len = sizeof(err);
+        if (getsockopt(d->fds[chan], SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+                err = errno;
+        }
+        if (err != 0) {
+                fprintf(stderr, "Unable to connect %s socket: %s\n", names[chan], strerror(err));
+                goto fail;
+        }
+        if (chan == EV_CTRL) {
+                d->fds[1] = connect_socket(&d->remote, "interrupt", intr_psm, 1);
+                if (d->fds[1] < 0) {
+                        goto fail;
                 }
-                fprintf(stdout, "\n");
+                d->connecting = EV_INTR;
+                return 1;
         }
-}
 
-void read_data(void)
-{
-        struct pollfd pfd[3];
-        int res;
+        d->connecting = -1;
+        if (tune_socket(d->fds[0], "control") < 0 || tune_socket(d->fds[1], "interrupt") < 0) {
+                goto fail;
+        }
 
-        pfd[0].fd = ctrl;
-        pfd[0].events = POLLIN;
-        pfd[1].fd = intr;
-        pfd[1].events = POLLIN;
+        /* Note what the interrupt channel ended up with. */
+        memset(&opts, 0, sizeof(opts));
+        len = sizeof(opts);
+        if (getsockopt(d->fds[1], SOL_L2CAP, L2CAP_OPTIONS, &opts, &len) == 0) {
+                d->link.have_options = 1;
+                d->link.imtu = opts.imtu;
+                d->link.omtu = opts.omtu;
+                d->link.flush_to = opts.flush_to;
+        }
+        return 0;
 
-        while (1) {
-                pfd[0].revents = pfd[1].revents = 0;
-                res = poll(pfd, 1, -1);
-                switch (res) {
-                case 0:
-                        read_socket(pfd[0].fd, "control");
+fail:
+        close(d->fds[0]);
+        if (d->fds[1] >= 0) {
+                close(d->fds[1]);
+        }
+        d->fds[0] = d->fds[1] = -1;
+        d->connecting = -1;
+        return -1;
+}
+
+int l2cap_close(struct device *d)
+{
+        close(d->fds[0]);
+        close(d->fds[1]);
+        return -1;
+}
+
+int watch_fd(int epfd, int fd, uint32_t tag, uint32_t events)
+{
+        struct epoll_event ev;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.u32 = tag;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                fprintf(stderr, "Unable to watch fd %d: %s\n", fd, strerror(errno));
+                return -1;
+        }
+        return 0;
+}
+
+/* Raw HCI sockets for --latency's link readings, one per adapter,
+ * opened when first needed and kept until the read loop ends (-1
+ * when not tried yet, -2 if there is no such adapter or it could not
+ * be opened, so it is not tried again on every reading).  They are
+ * non-blocking and watched in the read loop, so a slow controller
+ * never delays reading reports.
+ */
+int hci_fds[HCI_MAX_DEV];
+
+/* Bits in link::pending. */
+#define LINK_PENDING_RSSI    1
+#define LINK_PENDING_QUALITY 2
+
+/* Returns the HCI socket for adapter dev, opening it and watching it
+ * in epfd if need be, or -1 if there is no such adapter.
+ */
+int hci_socket(int dev, int epfd)
+{
+        struct sockaddr_hci sa;
+        struct hci_filter filter;
+        int fd;
+
+        if (hci_fds[dev] != -1) {
+                return hci_fds[dev] >= 0 ? hci_fds[dev] : -1;
+        }
+        fd = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, BTPROTO_HCI);
+        if (fd < 0) {
+                hci_fds[dev] = -2;
+                return -1;
+        }
+        memset(&sa, 0, sizeof(sa));
+        sa.hci_family = AF_BLUETOOTH;
+        sa.hci_dev = dev;
+        memset(&filter, 0, sizeof(filter));
+        filter.type_mask = 1u << HCI_EVENT_PKT;
+        filter.event_mask[0] = 1u << HCI_EV_CMD_COMPLETE;
+        if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0
+            || setsockopt(fd, SOL_HCI, HCI_FILTER, &filter, sizeof(filter)) < 0
+            || watch_fd(epfd, fd, EV_HCI, EPOLLIN)) {
+                close(fd);
+                hci_fds[dev] = -2;
+                return -1;
+        }
+        hci_fds[dev] = fd;
+        return fd;
+}
+
+/* Closes every HCI socket hci_socket() opened. */
+void hci_close(void)
+{
+        unsigned int ii;
+
+        for (ii = 0; ii < HCI_MAX_DEV; ii++) {
+                if (hci_fds[ii] >= 0) {
+                        close(hci_fds[ii]);
+                }
+                hci_fds[ii] = -1;
+        }
+}
+
+/* Sends HCI command opcode, with a connection handle as its only
+ * parameter, on the raw HCI socket fd.  Returns zero or -1.
+ */
+int hci_send(int fd, unsigned int opcode, unsigned int handle)
+{
+        unsigned char buf[6];
+
+        buf[0] = HCI_COMMAND_PKT;
+        buf[1] = opcode;
+        buf[2] = opcode >> 8;
+        buf[3] = 2;
+        buf[4] = handle;
+        buf[5] = handle >> 8;
+        return write(fd, buf, sizeof(buf)) == sizeof(buf) ? 0 : -1;
+}
+
+int l2cap_sdp(struct device *d, unsigned char buf[], int size)
+{
+        int res;
+        int err;
+        int fd;
+
+        fd = connect_socket(&d->remote, "SDP", MTALK_SDP_PSM, 0);
+        if (fd < 0) {
+                errno = -fd;
+                return -1;
+        }
+        res = mtalk_sdp_query(fd, MTALK_SDP_UUID_HID, MTALK_SDP_ATTR_HID_DESCRIPTOR, buf, size);
+        err = errno;
+        close(fd);
+        errno = err;
+        return res;
+}
+
+/* Asks d's adapter for the RSSI and link quality of d's connection;
+ * the answers come back through hci_events().
+ */
+int l2cap_link(struct device *d, int epfd, struct link_sample *s)
+{
+        struct hci_conn_info_req req;
+        struct l2cap_conninfo info;
+        socklen_t len;
+        int dev;
+        int fd;
+
+        len = sizeof(info);
+        if (getsockopt(d->fds[1], SOL_L2CAP, L2CAP_CONNINFO, &info, &len) < 0) {
+                return -1;
+        }
+
+        fd = -1;
+        for (dev = 0; dev < HCI_MAX_DEV; dev++) {
+                fd = hci_socket(dev, epfd);
+                if (fd < 0) {
+                        continue;
+                }
+                memset(&req, 0, sizeof(req));
+                req.bdaddr = d->remote;
+                req.type = ACL_LINK;
+                if (ioctl(fd, HCIGETCONNINFO, &req) == 0
+                    && req.conn_info[0].handle == info.hci_handle) {
+                        break;
+                }
+                fd = -1;
+        }
+        if (fd < 0) {
+                errno = ENODEV;
+                return -1;
+        }
+
+        if (hci_send(fd, HCI_OP_READ_RSSI, info.hci_handle) < 0
+            || hci_send(fd, HCI_OP_READ_LINK_QUALITY, info.hci_handle) < 0) {
+                return -1;
+        }
+        memset(s, 0, sizeof(*s));
+        s->mode = req.conn_info[0].link_mode;
+        d->link.hci_dev = dev;
+        d->link.hci_handle = info.hci_handle;
+        d->link.pending = LINK_PENDING_RSSI | LINK_PENDING_QUALITY;
+        return 1;
+}
+
+/* Writes out everything buffered in o. */
+void out_flush(struct output *o)
+{
+        size_t pos;
+        ssize_t res;
+
+        for (pos = 0; pos < o->len; pos += res) {
+                res = write(o->fd, o->buf + pos, o->len - pos);
+                if (res < 0) {
+                        if (errno == EINTR) {
+                                res = 0;
+                                continue;
+                        }
+                        break;
+                }
+        }
+        o->len = 0;
+}
+
+/* Makes room for at least n more bytes in o. */
+void out_reserve(struct output *o, size_t n)
+{
+        if (o->len + n > sizeof(o->buf)) {
+                out_flush(o);
+        }
+}
+
+/* Appends value to o in decimal, padded to width: with zeros after
+ * the sign if OUT_ZERO, else with spaces before it.  OUT_SIGN adds
+ * a '+' to non-negative values.  Like printf("%+05d") and so on, but
+ * without parsing a format for every number.
+ */
+#define OUT_SIGN 1
+#define OUT_ZERO 2
+void out_int(struct output *o, long value, int width, int flags)
+{
+        char digits[24];
+        unsigned long v;
+        char sign;
+        int nd;
+
+        v = value < 0 ? -(unsigned long)value : (unsigned long)value;
+        sign = value < 0 ? '-' : (flags & OUT_SIGN) ? '+' : 0;
+        nd = 0;
+        do {
+                digits[nd++] = '0' + v % 10;
+                v /= 10;
+        } while (v != 0);
+        width -= nd + (sign != 0);
+        if (!(flags & OUT_ZERO)) {
+                while (width-- > 0) o->buf[o->len++] = ' ';
+        }
+        if (sign) o->buf[o->len++] = sign;
+        while (width-- > 0) o->buf[o->len++] = '0';
+        while (nd > 0) o->buf[o->len++] = digits[--nd];
+}
+
+void out_hex(struct output *o, unsigned int byte)
+{
+        static const char hexdigits[] = "0123456789abcdef";
+
+        o->buf[o->len++] = hexdigits[(byte >> 4) & 15];
+        o->buf[o->len++] = hexdigits[byte & 15];
+}
+
+void out_str(struct output *o, const char str[])
+{
+        while (*str != '\0') o->buf[o->len++] = *str++;
+}
+
+/* Writes out every device's buffered output. */
+void flush_outputs(void)
+{
+        unsigned int ii;
+
+        out_flush(&std_output);
+        for (ii = 0; ii < device_count; ii++) {
+                if (devices[ii].out != NULL && devices[ii].out != &std_output) {
+                        out_flush(devices[ii].out);
+                }
+        }
+}
+
+/* Starts a simulated mouse (see mtalk-sim.h) in a child process,
+ * connected to us by a pair of SOCK_SEQPACKET socketpairs.
+ */
+int sim_open(struct device *d)
+{
+        int ctrl_pair[2];
+        int intr_pair[2];
+        unsigned int ii;
+
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, ctrl_pair) < 0
+            || socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, intr_pair) < 0) {
+                fprintf(stderr, "Unable to create simulator sockets: %s\n", strerror(errno));
+                return -1;
+        }
+
+        fflush(NULL);
+        d->sim_pid = fork();
+        if (d->sim_pid < 0) {
+                fprintf(stderr, "Unable to start simulator: %s\n", strerror(errno));
+                return -1;
+        } else if (d->sim_pid == 0) {
+                /* Leave signals to the parent, and die with it.  Drop
+                 * other devices' sockets so they see us hang up.
+                 */
+                signal(SIGINT, SIG_IGN);
+                prctl(PR_SET_PDEATHSIG, SIGTERM);
+                for (ii = 0; ii < device_count; ii++) {
+                        if (devices[ii].fds[0] >= 0) {
+                                close(devices[ii].fds[0]);
+                                close(devices[ii].fds[1]);
+                        }
+                }
+                close(ctrl_pair[0]);
+                close(intr_pair[0]);
+                _exit(mtalk_sim_run(ctrl_pair[1], intr_pair[1], &sim_params) < 0
+                      ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+        close(ctrl_pair[1]);
+        close(intr_pair[1]);
+        d->fds[0] = ctrl_pair[0];
+        d->fds[1] = intr_pair[0];
+        if (tune_socket(d->fds[0], "control") < 0 || tune_socket(d->fds[1], "interrupt") < 0) {
+                return -1;
+        }
+        d->link.have_options = 1;
+        d->link.imtu = l2cap_imtu > 0 ? l2cap_imtu : MTALK_SIM_MTU;
+        d->link.omtu = MTALK_SIM_MTU;
+        d->link.flush_to = l2cap_flush_to > 0 ? l2cap_flush_to : MTALK_SIM_FLUSH_TO;
+        return 0;
+}
+
+int sim_close(struct device *d)
+{
+        int status;
+
+        close(d->fds[0]);
+        close(d->fds[1]);
+        if (d->sim_pid <= 0 || waitpid(d->sim_pid, &status, 0) < 0) {
+                return -1;
+        }
+        d->sim_pid = 0;
+        return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS ? 0 : -1;
+}
+
+/* Makes up link readings for a simulated mouse. */
+int sim_link(struct device *d, int epfd, struct link_sample *s)
+{
+        (void)epfd;
+        mtalk_sim_link(d->link.samples, &s->rssi, &s->quality);
+        s->mode = MTALK_SIM_LINK_MODE;
+        return 0;
+}
+
+/* Queries a local SDP stand-in, run in a child process, that serves
+ * the descriptor from magicmouse-desc.h.
+ */
+int sim_sdp(struct device *d, unsigned char buf[], int size)
+{
+        int status;
+        int pair[2];
+        pid_t pid;
+        int res;
+        int err;
+
+        (void)d;
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) < 0) {
+                return -1;
+        }
+        fflush(NULL);
+        pid = fork();
+        if (pid < 0) {
+                err = errno;
+                close(pair[0]);
+                close(pair[1]);
+                errno = err;
+                return -1;
+        } else if (pid == 0) {
+                signal(SIGINT, SIG_IGN);
+                prctl(PR_SET_PDEATHSIG, SIGTERM);
+                close(pair[0]);
+                _exit(mtalk_sdp_serve(pair[1], magicmouse_descriptor, sizeof(magicmouse_descriptor),
+                                      MTALK_SIM_SDP_CHUNK) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+        close(pair[1]);
+        res = mtalk_sdp_query(pair[0], MTALK_SDP_UUID_HID, MTALK_SDP_ATTR_HID_DESCRIPTOR, buf, size);
+        err = errno;
+        close(pair[0]);
+        waitpid(pid, &status, 0);
+        errno = err;
+        return res;
+}
+
+const struct transport transports[] = {
+        { "l2cap", l2cap_open, l2cap_connected, l2cap_close, l2cap_link, l2cap_sdp },
+        { "sim", sim_open, NULL, sim_close, sim_link, sim_sdp },
+};
+
+/* Sets path to the --sdp cache file for d's descriptor.  Returns
+ * zero, or -1 if the name is too long.
+ */
+int descriptor_path(const struct device *d, char path[], size_t size)
+{
+        return (size_t)snprintf(path, size, "%s/%02x:%02x:%02x:%02x:%02x:%02x.desc", sdp_cache,
+                 d->remote.b[5], d->remote.b[4], d->remote.b[3],
+                 d->remote.b[2], d->remote.b[1], d->remote.b[0]) < size ? 0 : -1;
+}
+
+/* Reads a cached descriptor, written in hex as hid-parse reads it.
+ * Returns its length, or -1.
+ */
+int load_descriptor(const char path[], unsigned char desc[], int size)
+{
+        unsigned int byte;
+        FILE *f;
+        int len;
+        int res;
+
+        f = fopen(path, "r");
+        if (f == NULL) {
+                return -1;
+        }
+        for (len = 0; (res = fscanf(f, "%2x", &byte)) == 1 && len < size; len++) {
+                desc[len] = byte;
+        }
+        fclose(f);
+        return res == EOF && len > 0 ? len : -1;
+}
+
+/* Writes a descriptor to the cache, creating the cache directory and
+ * its parents as needed.  Returns zero on success.
+ */
+int save_descriptor(const char path[], const unsigned char desc[], int len)
+{
+        char tmp[PATH_MAX];
+        char *sep;
+        FILE *f;
+        int ii;
+
+        snprintf(tmp, sizeof(tmp), "%s", sdp_cache);
+        for (sep = strchr(tmp + 1, '/'); ; sep = strchr(sep + 1, '/')) {
+                if (sep != NULL) {
+                        *sep = '\0';
+                }
+                if (mkdir(tmp, 0777) < 0 && errno != EEXIST) {
+                        return -1;
+                }
+                if (sep == NULL) {
+                        break;
+                }
+                *sep = '/';
+        }
+
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+        f = fopen(tmp, "w");
+        if (f == NULL) {
+                return -1;
+        }
+        for (ii = 0; ii < len; ii++) {
+                fprintf(f, "%02x%c", desc[ii], ii % 16 == 15 || ii == len - 1 ? '\n' : ' ');
+        }
+        if (fclose(f) || rename(tmp, path) < 0) {
+                return -1;
+        }
+        return 0;
+}
+
+/* Applies --sdp to d: loads its report descriptor from the cache, or
+ * (if query is set) fetches it over SDP and caches it, then compiles
+ * it into d->layout.  The SDP exchange blocks, so it is left to
+ * startup; reconnects, which happen in the read loop, only try the
+ * cache.  Once d has a layout this does nothing.  Failures are
+ * reported but not fatal: d's reports are then all decoded by hand.
+ * The layout is only published once it is complete, and then never
+ * changes or goes away, so the --async writer thread can use it
+ * without locking.
+ */
+void fetch_descriptor(struct device *d, int query)
+{
+        static unsigned char lists[4096];
+        static unsigned char cached[4096];
+        const unsigned char *desc;
+        char path[PATH_MAX];
+        struct hid_layout *l;
+        const char *source;
+        int len;
+        int res;
+
+        if (!use_sdp || d->layout != NULL) {
+                return;
+        }
+        l = malloc(sizeof(*l));
+        if (l == NULL) {
+                fprintf(stderr, "sdp: %s: %s\n", d->name, strerror(errno));
+                return;
+        }
+
+        path[0] = '\0';
+        if (sdp_cache[0] != '\0' && descriptor_path(d, path, sizeof(path)) < 0) {
+                path[0] = '\0';
+        }
+        len = path[0] != '\0' ? load_descriptor(path, cached, sizeof(cached)) : -1;
+        if (len > 0 && hid_compile(l, cached, len) == 0) {
+                source = "cache";
+        } else if (!query) {
+                goto fail;
+        } else {
+                res = transports[d->transport].sdp(d, lists, sizeof(lists));
+                if (res < 0) {
+                        fprintf(stderr, "sdp: %s: query failed: %s\n", d->name, strerror(errno));
+                        goto fail;
+                }
+                if (mtalk_sdp_hid_descriptor(lists, res, &desc, &len)) {
+                        fprintf(stderr, "sdp: %s: no report descriptor in the HID record\n", d->name);
+                        goto fail;
+                }
+                res = hid_compile(l, desc, len);
+                if (res) {
+                        fprintf(stderr, "sdp: %s: unable to compile the report descriptor (error %d)\n",
+                                d->name, res);
+                        goto fail;
+                }
+                source = "SDP";
+                if (path[0] != '\0' && save_descriptor(path, desc, len) < 0) {
+                        fprintf(stderr, "sdp: %s: unable to cache descriptor in %s: %s\n",
+                                d->name, path, strerror(errno));
+                }
+        }
+        fprintf(stderr, "sdp: %s: %d-byte report descriptor from %s, %u reports\n",
+                d->name, len, source, l->report_count);
+        __atomic_store_n(&d->layout, l, __ATOMIC_RELEASE);
+        return;
+
+fail:
+        free(l);
+}
+
+int write_mystery(int ctrl)
+{
+        unsigned char mystery_1[] = { 0x53, 0xd7, 0x01 };
+        unsigned char mystery_2[] = { 0x53, 0xf8, 0x01, 0x32 };
+        ssize_t res;
+
+        res = send(ctrl, mystery_1, sizeof(mystery_1), 0);
+        if (res < 0) {
+                fprintf(stderr, "Cannot send first mystery on command port: %s\n", strerror(errno));
+                return -1;
+        }
+        res = send(ctrl, mystery_2, sizeof(mystery_2), 0);
+        if (res < 0) {
+                fprintf(stderr, "Cannot send second mystery on command port: %s\n", strerror(errno));
+                return -1;
+        }
+        return 0;
+}
+
+/* Starts a line for a packet: the device prefix, if any, and the
+ * receive time if -T was given.
+ */
+void print_prefix(struct output *o, const char prefix[], const struct timespec *ts)
+{
+        if (prefix != NULL) {
+                out_str(o, prefix);
+                out_str(o, " ");
+        }
+        if (print_timestamps) {
+                out_int(o, ts->tv_sec, 0, 0);
+                o->buf[o->len++] = '.';
+                out_int(o, ts->tv_nsec, 9, OUT_ZERO);
+                o->buf[o->len++] = ' ';
+        }
+}
+
+void print_report(struct output *o, const char prefix[], const unsigned char data[], int res,
+                  const char name[], const struct timespec *ts)
+{
+        struct magicmouse_report r;
+        struct magicmouse_touch t;
+        int type;
+        int ii;
+
+        /* The longest report (31 touches) takes about 3 KiB. */
+        out_reserve(o, 4096);
+        print_prefix(o, prefix, ts);
+        type = FRAME_NONE;
+        if (res >= 2 && data[0] == 0xa1) {
+                type = magicmouse_decode(&r, data + 1, res - 1);
+        }
+        if (res == 3 && data[0] == 0xa1 && (data[1] & 0xf0) == 0x60) {
+                if (data[1] == 0x61 && data[2] == 0x01) {
+                        out_str(o, "light: lost, please put the mouse back down!\n");
+                } else if (data[1] == 0x61 && data[2] == 0x00) {
+                        out_str(o, "light: laser re-established\n");
+                } else {
+                        /* Unknown report. */
+                        out_str(o, "  ???: a1");
+                        out_hex(o, data[1]);
+                        out_hex(o, data[2]);
+                        out_str(o, "\n");
+                }
+        } else if (type == FRAME_MOTION) {
+                /* Mouse motion, maybe click.  This actually seems to
+                 * follow the HID, so it should be parsed using report
+                 * introspection under any serious driver.
+                 */
+                out_str(o, " move: rsvd?=");
+                out_hex(o, data[2]);
+                out_str(o, ", x=");
+                out_int(o, r.dx, 3, OUT_SIGN);
+                out_str(o, ", y=");
+                out_int(o, r.dy, 3, OUT_SIGN);
+                out_str(o, "\n");
+        } else if (type == FRAME_TOUCH) {
+                static const char btns[] = " LRB";
+                out_str(o, "touch: x=");
+                out_int(o, r.dx, 3, OUT_SIGN);
+                out_str(o, " y=");
+                out_int(o, r.dy, 3, OUT_SIGN);
+                out_str(o, " (T=");
+                out_int(o, r.timestamp, 6, 0);
+                o->buf[o->len++] = btns[r.buttons];
+                out_str(o, ")");
+                /* Show every record, even past MAX_TOUCHES. */
+                for (ii = 0; ii < (res - 7) / 8; ii++) {
+                        /* On my mouse, X ranges from about -1100
+                         * (left) to +1358 (right).  Y ranges from
+                         * -2047 (Apple logo) to +1600 (front of
+                         * mouse).  Angle 0 is from the left, angle
+                         * 128 is from the logo to the nose, angle 255
+                         * is from the right.  This prints them as the
+                         * mouse reports them, so Y and the angle are
+                         * undone from magicmouse_decode()'s axes.
+                         */
+                        magicmouse_decode_touch_bytes(&t, data + ii * 8 + 7);
+                        out_str(o, " (ID=");
+                        out_int(o, t.id, 0, 0);
+                        out_str(o, " X=");
+                        out_int(o, t.x, 5, OUT_SIGN | OUT_ZERO);
+                        out_str(o, " Y=");
+                        out_int(o, -t.y, 5, OUT_SIGN | OUT_ZERO);
+                        out_str(o, " major=");
+                        out_int(o, t.major, 3, 0);
+                        out_str(o, " minor=");
+                        out_int(o, t.minor, 3, 0);
+                        out_str(o, " size=");
+                        out_int(o, t.size, 2, 0);
+                        out_str(o, " angle=");
+                        out_int(o, t.orientation + 32, 2, OUT_ZERO);
+                        out_str(o, " state=");
+                        out_hex(o, t.state);
+                        out_str(o, ")");
+                }
+                out_str(o, "\n");
+        } else {
+                out_int(o, res, 2, 0);
+                out_str(o, " bytes ");
+                out_str(o, name);
+                out_str(o, ":");
+                for (ii = 0; ii < res; ii++) {
+                        if (ii % 4 == 0) o->buf[o->len++] = ' ';
+                        out_hex(o, data[ii]);
+                }
+                out_str(o, "\n");
+        }
+}
+
+/* Appends one value from a declared report to the output in ctx,
+ * named after its usage if hid-usages.h knows it.
+ */
+void print_hid_value(void *ctx, const struct hid_field *f, uint32_t usage, int32_t value)
+{
+        struct output *o = ctx;
+        const char *name;
+        char buf[64];
+
+        out_reserve(o, 128);
+        o->buf[o->len++] = ' ';
+        name = hid_usage_name(usage, buf, sizeof(buf));
+        if (name != NULL) {
+                out_str(o, name);
+        } else {
+                out_hex(o, usage >> 24);
+                out_hex(o, usage >> 16);
+                out_hex(o, usage >> 8);
+                out_hex(o, usage);
+        }
+        o->buf[o->len++] = '=';
+        out_int(o, value, 0, f->logical_minimum < 0 ? OUT_SIGN : 0);
+}
+
+/* Prints a DATA packet carrying a report that layout l declares,
+ * using the descriptor to decode it.  Returns -1, having printed
+ * nothing, for any other packet.
+ */
+int print_declared(struct output *o, const char prefix[], const struct hid_layout *l,
+                   const unsigned char data[], int res, const struct timespec *ts)
+{
+        static const char *const types[HID_REPORT_TYPES] = { "input", "output", "feature" };
+        const struct hid_report *r;
+        int type;
+
+        /* The low bits of a DATA header are the report type. */
+        if (res < 2 || (data[0] & 0xfc) != HIDP_DATA || (data[0] & 3) == 0) {
+                return -1;
+        }
+        type = (data[0] & 3) - 1;
+        r = hid_find_report(l, type, l->numbered ? data[1] : 0);
+        if (r == NULL || (unsigned int)(res - 1) < hid_report_bytes(l, r)) {
+                return -1;
+        }
+
+        out_reserve(o, 128);
+        print_prefix(o, prefix, ts);
+        out_str(o, "  hid: ");
+        out_str(o, types[type]);
+        if (l->numbered) {
+                o->buf[o->len++] = ' ';
+                out_hex(o, data[1]);
+        }
+        hid_decode_report(l, type, data + 1, res - 1, print_hid_value, o);
+        out_reserve(o, 1);
+        out_str(o, "\n");
+        return 0;
+}
+
+/* Decodes a motion or touch report into f.  Returns f->r.type, which
+ * is FRAME_NONE for any other report.  Y grows toward the user, as
+ * for pointer motion, and touch positions use hid-magicmouse's axes.
+ */
+int decode_frame(const unsigned char data[], int len, struct frame *f)
+{
+        if (len < 2 || data[0] != 0xa1) {
+                f->r.type = FRAME_NONE;
+                f->r.ntouches = 0;
+                return FRAME_NONE;
+        }
+        return magicmouse_decode(&f->r, data + 1, len - 1);
+}
+
+/* Reports whether decoding \a tv with record decoder \a words went
+ * as expected, and returns one if it did not.
+ */
+int selftest_vector(const struct magicmouse_test_vector *tv, int words)
+{
+        struct magicmouse_report r;
+        int res;
+
+        magicmouse_decode_with(&r, tv->data, tv->size, words);
+        res = magicmouse_check_vector(tv, &r);
+        if (res == 0) {
+                return 0;
+        }
+        if (res < 0) {
+                fprintf(stderr, "selftest: %s (%s): wrong type, buttons, motion or touch count\n",
+                        tv->name, words ? "words" : "bytes");
+        } else {
+                fprintf(stderr, "selftest: %s (%s): touch %d differs\n",
+                        tv->name, words ? "words" : "bytes", res - 1);
+        }
+        return 1;
+}
+
+/* Runs --selftest: decodes the test vectors from magicmouse-report.h
+ * with both record decoders, then round-trips random reports from the
+ * simulator's encoders through them.  Returns the number of failures.
+ */
+int selftest(void)
+{
+        static unsigned char buf[7 + 8 * MAX_TOUCHES];
+        struct magicmouse_test_vector tv;
+        struct magicmouse_touch *t;
+        struct mtalk_sim sim;
+        unsigned int ii;
+        uint32_t rnd;
+        int failures;
+        int words;
+        int jj;
+
+        failures = 0;
+        for (ii = 0; ii < MAGICMOUSE_TEST_VECTORS; ii++) {
+                for (words = 0; words < 2; words++) {
+                        failures += selftest_vector(&magicmouse_test_vectors[ii], words);
+                }
+        }
+
+        mtalk_sim_init(&sim, &sim_params);
+        for (ii = 0; ii < 10000; ii++) {
+                memset(&tv, 0, sizeof(tv));
+                tv.name = "random";
+                tv.data = buf + 1;
+                rnd = mtalk_sim_random(&sim);
+                tv.expect.buttons = rnd & 3;
+                tv.expect.dx = (signed char)(rnd >> 8);
+                tv.expect.dy = (signed char)(rnd >> 16);
+                if (rnd >> 31) {
+                        tv.expect.type = FRAME_MOTION;
+                        tv.size = mtalk_sim_encode_motion(buf, tv.expect.dx, tv.expect.dy,
+                                                          tv.expect.buttons) - 1;
+                } else {
+                        tv.expect.type = FRAME_TOUCH;
+                        tv.expect.timestamp = mtalk_sim_random(&sim) & 0x3ffff;
+                        tv.expect.ntouches = (rnd >> 24) % (MAX_TOUCHES + 1);
+                        for (jj = 0; jj < tv.expect.ntouches; jj++) {
+                                t = &tv.expect.touch[jj];
+                                rnd = mtalk_sim_random(&sim);
+                                t->x = (int)(rnd & 0xfff) - 2048;
+                                /* Decoded Y runs from -2047 to 2048. */
+                                t->y = 2048 - (int)(rnd >> 12 & 0xfff);
+                                t->id = rnd >> 24 & 15;
+                                rnd = mtalk_sim_random(&sim);
+                                t->major = rnd;
+                                t->minor = rnd >> 8;
+                                t->size = rnd >> 16 & 63;
+                                t->orientation = (int)(rnd >> 22 & 63) - 32;
+                                t->state = mtalk_sim_random(&sim);
+                                mtalk_sim_encode_touch(buf + 7 + 8 * jj, t->id, t->x, -t->y,
+                                                       t->major, t->minor, t->size,
+                                                       t->orientation + 32, t->state);
+                        }
+                        tv.size = mtalk_sim_encode_touch_header(buf, tv.expect.dx, tv.expect.dy,
+                                                                tv.expect.buttons, tv.expect.timestamp,
+                                                                tv.expect.ntouches) - 1;
+                }
+                for (words = 0; words < 2; words++) {
+                        failures += selftest_vector(&tv, words);
+                }
+        }
+
+        printf("selftest: %u vectors and %u random reports, %d failures\n",
+               (unsigned int)MAGICMOUSE_TEST_VECTORS, ii, failures);
+        return failures;
+}
+
+int uinput_abs(int fd, int code, int min, int max, int fuzz)
+{
+        struct uinput_abs_setup abs;
+
+        memset(&abs, 0, sizeof(abs));
+        abs.code = code;
+        abs.absinfo.minimum = min;
+        abs.absinfo.maximum = max;
+        abs.absinfo.fuzz = fuzz;
+        return ioctl(fd, UI_SET_ABSBIT, code) < 0 || ioctl(fd, UI_ABS_SETUP, &abs) < 0;
+}
+
+/* Creates a uinput device, like hid-magicmouse's, for d. */
+int uinput_open(struct device *d)
+{
+        static const int keys[] = { BTN_LEFT, BTN_RIGHT, BTN_TOUCH, BTN_TOOL_FINGER,
+                                    BTN_TOOL_DOUBLETAP, BTN_TOOL_TRIPLETAP, BTN_TOOL_QUADTAP };
+        struct uinput_setup setup;
+        unsigned int ii;
+        int fd;
+
+        fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+                fprintf(stderr, "Unable to open /dev/uinput: %s\n", strerror(errno));
+                return -1;
+        }
+
+        memset(&setup, 0, sizeof(setup));
+        setup.id.bustype = BUS_BLUETOOTH;
+        setup.id.vendor = 0x05ac;
+        setup.id.product = 0x030d;
+        snprintf(setup.name, sizeof(setup.name), "mtalk Magic Mouse %s", d->name);
+        if (ioctl(fd, UI_SET_EVBIT, EV_KEY) < 0
+            || ioctl(fd, UI_SET_EVBIT, EV_REL) < 0
+            || ioctl(fd, UI_SET_EVBIT, EV_ABS) < 0
+            || ioctl(fd, UI_SET_RELBIT, REL_X) < 0
+            || ioctl(fd, UI_SET_RELBIT, REL_Y) < 0
+            || ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_POINTER) < 0) {
+                goto fail;
+        }
+        for (ii = 0; ii < sizeof(keys) / sizeof(keys[0]); ii++) {
+                if (ioctl(fd, UI_SET_KEYBIT, keys[ii]) < 0) {
+                        goto fail;
+                }
+        }
+        if (uinput_abs(fd, ABS_MT_SLOT, 0, MAX_TOUCHES - 1, 0)
+            || uinput_abs(fd, ABS_MT_TRACKING_ID, 0, 65535, 0)
+            || uinput_abs(fd, ABS_MT_TOUCH_MAJOR, 0, 255, 4)
+            || uinput_abs(fd, ABS_MT_TOUCH_MINOR, 0, 255, 4)
+            || uinput_abs(fd, ABS_MT_ORIENTATION, -32, 31, 1)
+            || uinput_abs(fd, ABS_MT_POSITION_X, -1100, 1358, 4)
+            || uinput_abs(fd, ABS_MT_POSITION_Y, -1589, 2047, 4)
+            || ioctl(fd, UI_DEV_SETUP, &setup) < 0
+            || ioctl(fd, UI_DEV_CREATE) < 0) {
+                goto fail;
+        }
+        d->uinput.fd = fd;
+        return 0;
+
+fail:
+        fprintf(stderr, "Unable to set up uinput device: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+}
+
+/* Sends one frame to a uinput device as a single write(): each
+ * touch goes in the slot matching its ID (multitouch protocol B),
+ * then buttons, motion and a SYN_REPORT.
+ */
+void uinput_emit(struct uinput_state *u, const struct frame *f)
+{
+        static const int tools[] = { 0, BTN_TOOL_FINGER, BTN_TOOL_DOUBLETAP,
+                                     BTN_TOOL_TRIPLETAP, BTN_TOOL_QUADTAP };
+        /* Seven events per touch, two per lift, plus keys and motion. */
+        static struct input_event ev[MAX_TOUCHES * 9 + 16];
+        unsigned int seen;
+        int nn;
+        int ii;
+        int id;
+        int tool;
+
+#define EMIT(t, c, v) do { ev[nn].type = (t); ev[nn].code = (c); ev[nn].value = (v); nn++; } while (0)
+
+        nn = 0;
+        seen = 0;
+        if (f->r.type == FRAME_TOUCH) {
+                for (ii = 0; ii < f->r.ntouches; ii++) {
+                        const struct magicmouse_touch *t = &f->r.touch[ii];
+                        int state = t->state & MAGICMOUSE_TOUCH_STATE_MASK;
+
+                        if (state != MAGICMOUSE_TOUCH_STATE_START && state != MAGICMOUSE_TOUCH_STATE_DRAG) {
+                                continue;
+                        }
+                        id = t->id;
+                        seen |= 1u << id;
+                        EMIT(EV_ABS, ABS_MT_SLOT, id);
+                        if (!(u->active & (1u << id))) {
+                                u->tracking[id] = u->next_tracking_id;
+                                u->next_tracking_id = (u->next_tracking_id + 1) & 0xffff;
+                                EMIT(EV_ABS, ABS_MT_TRACKING_ID, u->tracking[id]);
+                        }
+                        EMIT(EV_ABS, ABS_MT_POSITION_X, t->x);
+                        EMIT(EV_ABS, ABS_MT_POSITION_Y, t->y);
+                        EMIT(EV_ABS, ABS_MT_TOUCH_MAJOR, t->major);
+                        EMIT(EV_ABS, ABS_MT_TOUCH_MINOR, t->minor);
+                        EMIT(EV_ABS, ABS_MT_ORIENTATION, t->orientation);
+                }
+                /* Touches that ended or vanished free their slots. */
+                for (id = 0; id < MAX_TOUCHES; id++) {
+                        if ((u->active & ~seen) & (1u << id)) {
+                                EMIT(EV_ABS, ABS_MT_SLOT, id);
+                                EMIT(EV_ABS, ABS_MT_TRACKING_ID, -1);
+                        }
+                }
+                u->active = seen;
+
+                tool = __builtin_popcount(u->active);
+                if (tool > 4) {
+                        tool = 4;
+                }
+                if (tool != u->last_tool) {
+                        EMIT(EV_KEY, BTN_TOUCH, tool > 0);
+                        if (u->last_tool > 0) {
+                                EMIT(EV_KEY, tools[u->last_tool], 0);
+                        }
+                        if (tool > 0) {
+                                EMIT(EV_KEY, tools[tool], 1);
+                        }
+                        u->last_tool = tool;
+                }
+        }
+
+        if (f->r.buttons != u->last_buttons) {
+                EMIT(EV_KEY, BTN_LEFT, f->r.buttons & 1);
+                EMIT(EV_KEY, BTN_RIGHT, (f->r.buttons >> 1) & 1);
+                u->last_buttons = f->r.buttons;
+        }
+        if (f->r.dx) {
+                EMIT(EV_REL, REL_X, f->r.dx);
+        }
+        if (f->r.dy) {
+                EMIT(EV_REL, REL_Y, f->r.dy);
+        }
+        EMIT(EV_SYN, SYN_REPORT, 0);
+#undef EMIT
+
+        if (write(u->fd, ev, nn * sizeof(ev[0])) < 0 && errno != EAGAIN) {
+                fprintf(stderr, "Unable to write to uinput: %s\n", strerror(errno));
+        }
+}
+
+int64_t timespec_ns(const struct timespec *ts)
+{
+        return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+void ns_timespec(int64_t ns, struct timespec *ts)
+{
+        ts->tv_sec = ns / 1000000000;
+        ts->tv_nsec = ns % 1000000000;
+}
+
+unsigned int hist_index(uint64_t value)
+{
+        int shift;
+
+        if (value < (1u << HIST_SUB_BITS)) {
+                return value;
+        }
+        shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+        return ((shift + 1) << HIST_SUB_BITS) + (value >> shift) - (1u << HIST_SUB_BITS);
+}
+
+/* Returns the smallest value that goes in bucket idx. */
+uint64_t hist_value(unsigned int idx)
+{
+        unsigned int shift;
+
+        if (idx < (1u << HIST_SUB_BITS)) {
+                return idx;
+        }
+        shift = (idx >> HIST_SUB_BITS) - 1;
+        return (uint64_t)((idx & ((1u << HIST_SUB_BITS) - 1)) + (1u << HIST_SUB_BITS)) << shift;
+}
+
+void hist_add(struct histogram *h, int64_t value)
+{
+        uint64_t v = value < 0 ? 0 : value;
+
+        if (h->count == 0 || v < h->min) {
+                h->min = v;
+        }
+        if (v > h->max) {
+                h->max = v;
+        }
+        h->count++;
+        h->bucket[hist_index(v)]++;
+}
+
+/* Returns the pct'th percentile of h's values, which must not be
+ * empty: the upper bound of its bucket, within [min, max].
+ */
+uint64_t hist_percentile(const struct histogram *h, double pct)
+{
+        uint64_t target;
+        uint64_t value;
+        uint64_t seen;
+        unsigned int jj;
+
+        target = (uint64_t)(h->count * pct / 100.0 + 0.5);
+        if (target < 1) {
+                target = 1;
+        }
+        for (jj = 0, seen = 0; jj < HIST_BUCKETS && seen + h->bucket[jj] < target; jj++) {
+                seen += h->bucket[jj];
+        }
+        value = hist_value(jj + 1) - 1;
+        return value < h->min ? h->min : value > h->max ? h->max : value;
+}
+
+/* Prints h's count, extremes and percentiles to stderr. */
+void hist_print(const struct histogram *h)
+{
+        static const double pct[] = { 50, 90, 99, 99.9 };
+        unsigned int ii;
+
+        if (h->count == 0) {
+                return;
+        }
+        fprintf(stderr, "latency: %s (%s) n=%llu min=%llu", h->name, h->unit,
+                (unsigned long long)h->count, (unsigned long long)h->min);
+        for (ii = 0; ii < sizeof(pct) / sizeof(pct[0]); ii++) {
+                fprintf(stderr, " p%g=%llu", pct[ii], (unsigned long long)hist_percentile(h, pct[ii]));
+        }
+        fprintf(stderr, " max=%llu\n", (unsigned long long)h->max);
+}
+
+/* Empties h. */
+void hist_reset(struct histogram *h)
+{
+        h->count = h->min = h->max = 0;
+        memset(h->bucket, 0, sizeof(h->bucket));
+}
+
+void print_latency(void)
+{
+        hist_print(&hist_decode);
+        hist_print(&hist_gap);
+        hist_print(&hist_device);
+}
+
+/* Adds a finished reading to d's link statistics. */
+void add_link_sample(struct device *d, const struct link_sample *s)
+{
+        struct link *l = &d->link;
+
+        if (l->samples == 0 || s->rssi < l->rssi_min) {
+                l->rssi_min = s->rssi;
+        }
+        if (l->samples == 0 || s->rssi > l->rssi_max) {
+                l->rssi_max = s->rssi;
+        }
+        if (l->samples == 0 || s->quality < l->quality_min) {
+                l->quality_min = s->quality;
+        }
+        l->rssi = s->rssi;
+        l->rssi_sum += s->rssi;
+        l->quality = s->quality;
+        l->mode = s->mode;
+        l->samples++;
+}
+
+/* Starts a reading of each connected device's link quality.  HCI
+ * readings finish later, in hci_events(); one still unanswered from
+ * the last call counts as failed.
+ */
+void sample_links(int epfd)
+{
+        struct device *d;
+        struct link *l;
+        int res;
+
+        for (d = devices; d < devices + device_count; d++) {
+                l = &d->link;
+                if (l->pending) {
+                        l->pending = 0;
+                        l->error = ETIMEDOUT;
+                }
+                if (d->fds[0] < 0 || d->connecting >= 0) {
+                        continue;
+                }
+                res = transports[d->transport].link(d, epfd, &l->next);
+                if (res < 0) {
+                        l->error = errno;
+                } else if (res == 0) {
+                        add_link_sample(d, &l->next);
+                }
+        }
+}
+
+/* Returns the device waiting for a reading of connection handle on
+ * adapter dev, or NULL.
+ */
+struct device *link_device(unsigned int dev, unsigned int handle)
+{
+        struct device *d;
+
+        for (d = devices; d < devices + device_count; d++) {
+                if (d->link.pending && d->link.hci_dev == (int)dev && d->link.hci_handle == handle) {
+                        return d;
+                }
+        }
+        return NULL;
+}
+
+/* Reads the Command Complete events waiting on the HCI sockets and
+ * finishes the readings they answer.
+ */
+void hci_events(void)
+{
+        unsigned char buf[260];
+        struct device *d;
+        struct link *l;
+        unsigned int opcode;
+        unsigned int handle;
+        unsigned int dev;
+        ssize_t res;
+
+        for (dev = 0; dev < HCI_MAX_DEV; dev++) {
+                if (hci_fds[dev] < 0) {
+                        continue;
+                }
+                /* Event: type, code, length, credits, opcode, then
+                 * status, handle and the value.
+                 */
+                while ((res = read(hci_fds[dev], buf, sizeof(buf))) > 0) {
+                        if (res < 10 || buf[0] != HCI_EVENT_PKT || buf[1] != HCI_EV_CMD_COMPLETE) {
+                                continue;
+                        }
+                        opcode = buf[4] | buf[5] << 8;
+                        handle = buf[7] | buf[8] << 8;
+                        d = link_device(dev, handle);
+                        if (d == NULL) {
+                                continue;
+                        }
+                        l = &d->link;
+                        if (opcode == HCI_OP_READ_RSSI && (l->pending & LINK_PENDING_RSSI)) {
+                                l->next.rssi = (signed char)buf[9];
+                                l->pending &= ~LINK_PENDING_RSSI;
+                        } else if (opcode == HCI_OP_READ_LINK_QUALITY && (l->pending & LINK_PENDING_QUALITY)) {
+                                l->next.quality = buf[9];
+                                l->pending &= ~LINK_PENDING_QUALITY;
+                        } else {
+                                continue;
+                        }
+                        if (buf[6] != 0) {
+                                l->pending = 0;
+                                l->error = EIO;
+                        } else if (l->pending == 0) {
+                                add_link_sample(d, &l->next);
+                        }
+                }
+        }
+}
+
+/* Prints each device's link parameters and quality readings, to go
+ * with the latency histograms.
+ */
+void print_links(void)
+{
+        static const struct {
+                unsigned int bit;
+                const char *name;
+        } modes[] = {
+                { HCI_LM_AUTH, "auth" },
+                { HCI_LM_ENCRYPT, "encrypt" },
+                { HCI_LM_TRUSTED, "trusted" },
+                { HCI_LM_RELIABLE, "reliable" },
+                { HCI_LM_SECURE, "secure" },
+        };
+        const struct device *d;
+        const struct link *l;
+        unsigned int ii;
+
+        for (d = devices; d < devices + device_count; d++) {
+                l = &d->link;
+                if (!l->have_options && l->samples == 0 && l->error == 0) {
+                        continue;
+                }
+                fprintf(stderr, "link: %s", d->name);
+                if (l->have_options) {
+                        fprintf(stderr, " imtu=%u omtu=%u flush-to=%u", l->imtu, l->omtu, l->flush_to);
+                }
+                if (socket_priority >= 0) {
+                        fprintf(stderr, " priority=%d", socket_priority);
+                }
+                if (l->samples > 0) {
+                        fprintf(stderr, " rssi=%d (min=%d avg=%.1f max=%d) quality=%d (min=%d) mode=%s",
+                                l->rssi, l->rssi_min, (double)l->rssi_sum / l->samples, l->rssi_max,
+                                l->quality, l->quality_min, l->mode & HCI_LM_MASTER ? "master" : "slave");
+                        for (ii = 0; ii < sizeof(modes) / sizeof(modes[0]); ii++) {
+                                if (l->mode & modes[ii].bit) {
+                                        fprintf(stderr, ",%s", modes[ii].name);
+                                }
+                        }
+                        fprintf(stderr, " samples=%u", l->samples);
+                }
+                if (l->error != 0) {
+                        fprintf(stderr, " (last reading failed: %s)", strerror(l->error));
+                }
+                fprintf(stderr, "\n");
+        }
+}
+
+/* Adds a decoded interrupt report's timings to the latency
+ * histograms.
+ */
+void measure_report(struct device *d, const struct timespec *ts, const struct frame *f)
+{
+        struct timespec now;
+        int64_t rx;
+
+        rx = timespec_ns(ts);
+        if (!replaying) {
+                clock_gettime(CLOCK_REALTIME, &now);
+                hist_add(&hist_decode, timespec_ns(&now) - rx);
+        }
+        if (d->last_rx_ns != 0) {
+                hist_add(&hist_gap, rx - d->last_rx_ns);
+        }
+        d->last_rx_ns = rx;
+        if (f->r.type == FRAME_TOUCH) {
+                if (d->have_timestamp) {
+                        hist_add(&hist_device, (f->r.timestamp - d->last_timestamp) & 0x3ffff);
+                }
+                d->last_timestamp = f->r.timestamp;
+                d->have_timestamp = 1;
+        }
+}
+
+/* Copies a decoded frame into the shared memory ring. */
+void publish_frame(struct device *d, const struct frame *f, const struct timespec *ts)
+{
+        struct mtalk_shm_frame *sf;
+        int ii;
+
+        sf = mtalk_shm_begin(shm);
+        sf->rx_ns = timespec_ns(ts);
+        sf->timestamp = f->r.timestamp;
+        sf->device = d - devices;
+        sf->type = f->r.type;
+        sf->buttons = f->r.buttons;
+        sf->ntouches = f->r.ntouches;
+        sf->dx = f->r.dx;
+        sf->dy = f->r.dy;
+        for (ii = 0; ii < f->r.ntouches; ii++) {
+                sf->touch[ii].x = f->r.touch[ii].x;
+                sf->touch[ii].y = f->r.touch[ii].y;
+                sf->touch[ii].id = f->r.touch[ii].id;
+                sf->touch[ii].major = f->r.touch[ii].major;
+                sf->touch[ii].minor = f->r.touch[ii].minor;
+                sf->touch[ii].size = f->r.touch[ii].size;
+                sf->touch[ii].orientation = f->r.touch[ii].orientation;
+                sf->touch[ii].state = f->r.touch[ii].state;
+                if (f->tracked) {
+                        sf->touch[ii].flags = MTALK_SHM_TRACKED;
+                        sf->touch[ii].vx = f->motion[ii].vx;
+                        sf->touch[ii].vy = f->motion[ii].vy;
+                        sf->touch[ii].ax = f->motion[ii].ax;
+                        sf->touch[ii].ay = f->motion[ii].ay;
+                } else {
+                        sf->touch[ii].flags = 0;
+                        sf->touch[ii].vx = sf->touch[ii].vy = 0;
+                        sf->touch[ii].ax = sf->touch[ii].ay = 0;
+                }
+        }
+        mtalk_shm_commit(shm, sf);
+}
+
+/* Feeds a new sample at device time t to a touch's filter. */
+void track_sample(struct track *k, int x, int y, int64_t t)
+{
+        unsigned int prev;
+        int64_t dt, dt0;
+        int64_t px, py;
+        int64_t rx, ry;
+
+        prev = k->head;
+        k->head = (k->head + 1) % TRACK_SAMPLES;
+        k->x[k->head] = x;
+        k->y[k->head] = y;
+        k->t[k->head] = t;
+        if (k->count < TRACK_SAMPLES) {
+                k->count++;
+        }
+        dt = t - k->t[prev];
+
+        if (k->count == 1) {
+                k->fx = (int64_t)x << 8;
+                k->fy = (int64_t)y << 8;
+                k->vx = k->vy = k->ax = k->ay = 0;
+        } else if (dt <= 0) {
+                /* A repeated timestamp: nothing to learn from. */
+                k->count--;
+                k->head = prev;
+        } else if (k->count == 2) {
+                k->vx = (((int64_t)x << 8) - k->fx) * TRACK_TICKS / dt;
+                k->vy = (((int64_t)y << 8) - k->fy) * TRACK_TICKS / dt;
+                k->fx = (int64_t)x << 8;
+                k->fy = (int64_t)y << 8;
+        } else if (k->count == 3) {
+                px = (((int64_t)x << 8) - k->fx) * TRACK_TICKS / dt;
+                py = (((int64_t)y << 8) - k->fy) * TRACK_TICKS / dt;
+                dt0 = (dt + k->t[prev] - k->t[(prev + TRACK_SAMPLES - 1) % TRACK_SAMPLES]) / 2;
+                k->ax = (px - k->vx) * TRACK_TICKS / dt0;
+                k->ay = (py - k->vy) * TRACK_TICKS / dt0;
+                k->vx = px;
+                k->vy = py;
+                k->fx = (int64_t)x << 8;
+                k->fy = (int64_t)y << 8;
+        } else {
+                /* Predict, then correct by the residual. */
+                px = k->fx + k->vx * dt / TRACK_TICKS + k->ax * dt / TRACK_TICKS * dt / TRACK_TICKS / 2;
+                py = k->fy + k->vy * dt / TRACK_TICKS + k->ay * dt / TRACK_TICKS * dt / TRACK_TICKS / 2;
+                k->vx += k->ax * dt / TRACK_TICKS;
+                k->vy += k->ay * dt / TRACK_TICKS;
+                rx = ((int64_t)x << 8) - px;
+                ry = ((int64_t)y << 8) - py;
+                k->fx = px + rx / 2;
+                k->fy = py + ry / 2;
+                k->vx += rx / 4 * TRACK_TICKS / dt;
+                k->vy += ry / 4 * TRACK_TICKS / dt;
+                k->ax += rx / 8 * TRACK_TICKS / dt * TRACK_TICKS / dt;
+                k->ay += ry / 8 * TRACK_TICKS / dt * TRACK_TICKS / dt;
+        }
+}
+
+/* Returns a Q8 estimate rounded to an int16_t's range. */
+int track_value(int64_t v)
+{
+        v = (v + (v < 0 ? -128 : 128)) / 256;
+        return v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : (int)v;
+}
+
+/* Updates d's tracker with a touch frame and fills in the frame's
+ * velocity and acceleration estimates.
+ */
+void track_frame(struct device *d, struct frame *f)
+{
+        struct tracker *tr = &d->tracker;
+        struct track *k;
+        unsigned int seen;
+        int ii;
+        int id;
+
+        if (tr->have_timestamp) {
+                tr->clock += (f->r.timestamp - tr->last_timestamp) & 0x3ffff;
+        }
+        tr->last_timestamp = f->r.timestamp;
+        tr->have_timestamp = 1;
+
+        seen = 0;
+        for (ii = 0; ii < f->r.ntouches; ii++) {
+                id = f->r.touch[ii].id;
+                k = &tr->track[id];
+                if (!(tr->active & (1u << id)) || (f->r.touch[ii].state & MAGICMOUSE_TOUCH_STATE_MASK) == MAGICMOUSE_TOUCH_STATE_START
+                    || tr->clock - k->t[k->head] > TRACK_STALE) {
+                        k->count = 0;
+                }
+                seen |= 1u << id;
+                track_sample(k, f->r.touch[ii].x, f->r.touch[ii].y, tr->clock);
+                f->motion[ii].vx = track_value(k->vx);
+                f->motion[ii].vy = track_value(k->vy);
+                f->motion[ii].ax = track_value(k->ax);
+                f->motion[ii].ay = track_value(k->ay);
+        }
+        tr->active = seen;
+        f->tracked = 1;
+}
+
+/* Prints the estimates from track_frame() after a touch report. */
+void print_track(struct output *o, const char prefix[], const struct frame *f)
+{
+        int ii;
+
+        out_reserve(o, 128 + 64 * MAX_TOUCHES);
+        if (prefix != NULL) {
+                out_str(o, prefix);
+                out_str(o, " ");
+        }
+        out_str(o, "track:");
+        for (ii = 0; ii < f->r.ntouches; ii++) {
+                out_str(o, " (ID=");
+                out_int(o, f->r.touch[ii].id, 0, 0);
+                out_str(o, " vx=");
+                out_int(o, f->motion[ii].vx, 0, OUT_SIGN);
+                out_str(o, " vy=");
+                out_int(o, f->motion[ii].vy, 0, OUT_SIGN);
+                out_str(o, " ax=");
+                out_int(o, f->motion[ii].ax, 0, OUT_SIGN);
+                out_str(o, " ay=");
+                out_int(o, f->motion[ii].ay, 0, OUT_SIGN);
+                out_str(o, ")");
+        }
+        out_str(o, "\n");
+}
+
+/* Starts a gesture line on d's output. */
+struct output *gesture_line(struct device *d, const struct timespec *ts, const char what[])
+{
+        struct output *o = d->out;
+
+        out_reserve(o, 256);
+        if (o == &std_output && device_count > 1) {
+                out_str(o, d->name);
+                out_str(o, " ");
+        }
+        if (print_timestamps) {
+                out_int(o, ts->tv_sec, 0, 0);
+                o->buf[o->len++] = '.';
+                out_int(o, ts->tv_nsec, 9, OUT_ZERO);
+                o->buf[o->len++] = ' ';
+        }
+        out_str(o, "gesture: ");
+        out_str(o, what);
+        return o;
+}
+
+/* Returns the velocity of h over its history, in units per second. */
+void touch_velocity(const struct touch_history *h, int *vx, int *vy)
+{
+        unsigned int oldest;
+        int64_t dt;
+
+        *vx = *vy = 0;
+        if (h->count < 2) {
+                return;
+        }
+        oldest = (h->head + GESTURE_HISTORY + 1 - h->count) % GESTURE_HISTORY;
+        dt = h->t[h->head] - h->t[oldest];
+        if (dt <= 0) {
+                return;
+        }
+        *vx = (int64_t)(h->x[h->head] - h->x[oldest]) * 1000000000 / dt;
+        *vy = (int64_t)(h->y[h->head] - h->y[oldest]) * 1000000000 / dt;
+}
+
+/* Sums the positions of the touches in mask and their distances from
+ * where they started.  Returns how many there are.
+ */
+int gesture_centroid(const struct gestures *g, unsigned int mask, int *cx, int *cy, int *mx, int *my)
+{
+        const struct touch_history *h;
+        int n;
+        int id;
+
+        *cx = *cy = *mx = *my = 0;
+        for (n = id = 0; id < MAX_TOUCHES; id++) {
+                if (!(mask & (1u << id))) {
+                        continue;
+                }
+                h = &g->touch[id];
+                *cx += h->x[h->head];
+                *cy += h->y[h->head];
+                *mx += h->x[h->head] - h->start_x;
+                *my += h->y[h->head] - h->start_y;
+                n++;
+        }
+        if (n > 0) {
+                *cx /= n;
+                *cy /= n;
+                *mx /= n;
+                *my /= n;
+        }
+        return n;
+}
+
+/* Returns the distance between the first two touches in mask. */
+int gesture_spread(const struct gestures *g, unsigned int mask)
+{
+        const struct touch_history *a;
+        const struct touch_history *b;
+        int dx;
+        int dy;
+
+        a = &g->touch[__builtin_ctz(mask)];
+        mask &= mask - 1;
+        b = &g->touch[__builtin_ctz(mask)];
+        dx = a->x[a->head] - b->x[b->head];
+        dy = a->y[a->head] - b->y[b->head];
+        return (int)sqrtf((float)dx * dx + (float)dy * dy);
+}
+
+/* Feeds one touch frame to d's gesture recognizer, printing any
+ * gestures it completes.  Taps and swipes are reported when the
+ * last finger lifts; scrolls and pinches on every frame while they
+ * last.  The work per frame is bounded by the 16 touch IDs.
+ */
+void recognize_gestures(struct device *d, const struct frame *f, const struct timespec *ts)
+{
+        static const char *const directions[] = { "left", "right", "up", "down" };
+        struct gestures *g = &d->gestures;
+        struct touch_history *h;
+        struct output *o;
+        unsigned int seen;
+        int64_t now;
+        int cx, cy, mx, my;
+        int vx, vy;
+        int state;
+        int dist;
+        int ii;
+        int id;
+        int n;
+
+        now = timespec_ns(ts);
+        seen = 0;
+        for (ii = 0; ii < f->r.ntouches; ii++) {
+                state = f->r.touch[ii].state & MAGICMOUSE_TOUCH_STATE_MASK;
+                if (state != MAGICMOUSE_TOUCH_STATE_START && state != MAGICMOUSE_TOUCH_STATE_DRAG) {
+                        continue;
+                }
+                id = f->r.touch[ii].id;
+                seen |= 1u << id;
+                h = &g->touch[id];
+                if (!(g->active & (1u << id))) {
+                        h->count = 0;
+                        h->start_x = f->r.touch[ii].x;
+                        h->start_y = f->r.touch[ii].y;
+                }
+                h->head = (h->head + 1) % GESTURE_HISTORY;
+                h->x[h->head] = f->r.touch[ii].x;
+                h->y[h->head] = f->r.touch[ii].y;
+                h->t[h->head] = now;
+                if (h->count < GESTURE_HISTORY) {
+                        h->count++;
+                }
+                if (abs(h->x[h->head] - h->start_x) > TAP_SLOP || abs(h->y[h->head] - h->start_y) > TAP_SLOP) {
+                        g->moved = 1;
+                }
+        }
+
+        if (g->active == 0) {
+                if (seen == 0) {
+                        return;
+                }
+                /* A new contact. */
+                g->fingers = 0;
+                g->down_t = now;
+                g->moved = 0;
+        }
+        n = __builtin_popcount(seen);
+        if (n > g->fingers) {
+                g->fingers = n;
+        }
+
+        if (seen == 0) {
+                /* The contact ended. */
+                if (!g->moved && now - g->down_t < TAP_TIME) {
+                        o = gesture_line(d, ts, "tap fingers=");
+                        out_int(o, g->fingers, 0, 0);
+                        out_str(o, "\n");
+                } else if (g->mode == GESTURE_SWIPE) {
+                        gesture_centroid(g, g->active, &cx, &cy, &mx, &my);
+                        if (abs(mx) > SWIPE_MIN || abs(my) > SWIPE_MIN) {
+                                o = gesture_line(d, ts, "swipe ");
+                                out_str(o, directions[abs(mx) > abs(my) ? (mx > 0) : 2 + (my > 0)]);
+                                out_str(o, " fingers=");
+                                out_int(o, g->fingers, 0, 0);
+                                out_str(o, "\n");
+                        }
+                }
+                g->active = 0;
+                g->mode = GESTURE_NONE;
+                return;
+        }
+
+        if (seen != g->active) {
+                /* Fingers came or went: start the gesture over from
+                 * here, keeping the lifted fingers' motion for swipes.
+                 */
+                for (id = 0; id < MAX_TOUCHES; id++) {
+                        h = &g->touch[id];
+                        if (seen & (1u << id)) {
+                                h->start_x = h->x[h->head];
+                                h->start_y = h->y[h->head];
+                        }
+                }
+                g->active = seen;
+                g->mode = n >= 3 ? GESTURE_SWIPE : GESTURE_NONE;
+                gesture_centroid(g, seen, &g->last_cx, &g->last_cy, &mx, &my);
+                g->start_dist = n == 2 ? gesture_spread(g, seen) : 0;
+                g->last_scale = 100;
+                return;
+        }
+
+        gesture_centroid(g, seen, &cx, &cy, &mx, &my);
+        if (g->mode == GESTURE_NONE && n <= 2) {
+                dist = n == 2 ? gesture_spread(g, seen) : 0;
+                if (n == 2 && abs(dist - g->start_dist) > PINCH_MIN
+                    && abs(dist - g->start_dist) > abs(mx) + abs(my)) {
+                        g->mode = GESTURE_PINCH;
+                } else if (abs(mx) > SCROLL_MIN || abs(my) > SCROLL_MIN) {
+                        g->mode = GESTURE_SCROLL;
+                }
+        }
+
+        if (g->mode == GESTURE_SCROLL && (cx != g->last_cx || cy != g->last_cy)) {
+                touch_velocity(&g->touch[__builtin_ctz(seen)], &vx, &vy);
+                o = gesture_line(d, ts, "scroll fingers=");
+                out_int(o, n, 0, 0);
+                out_str(o, " dx=");
+                out_int(o, cx - g->last_cx, 0, OUT_SIGN);
+                out_str(o, " dy=");
+                out_int(o, cy - g->last_cy, 0, OUT_SIGN);
+                out_str(o, " vx=");
+                out_int(o, vx, 0, OUT_SIGN);
+                out_str(o, " vy=");
+                out_int(o, vy, 0, OUT_SIGN);
+                out_str(o, "\n");
+        } else if (g->mode == GESTURE_PINCH && g->start_dist > 0) {
+                ii = gesture_spread(g, seen) * 100 / g->start_dist;
+                if (ii != g->last_scale) {
+                        o = gesture_line(d, ts, ii > g->last_scale ? "pinch out scale=" : "pinch in scale=");
+                        out_int(o, ii, 0, 0);
+                        out_str(o, "%\n");
+                        g->last_scale = ii;
+                }
+        }
+        g->last_cx = cx;
+        g->last_cy = cy;
+}
+
+/* Returns the index in heatmap[] of the cell holding (x, y). */
+unsigned int heat_index(int x, int y)
+{
+        unsigned int cx;
+        unsigned int cy;
+
+        x = x < HEAT_X_MIN ? HEAT_X_MIN : x > HEAT_X_MAX ? HEAT_X_MAX : x;
+        y = y < HEAT_Y_MIN ? HEAT_Y_MIN : y > HEAT_Y_MAX ? HEAT_Y_MAX : y;
+        cx = (x - HEAT_X_MIN) >> HEAT_CELL_BITS;
+        cy = (y - HEAT_Y_MIN) >> HEAT_CELL_BITS;
+        return ((cy / HEAT_TILE) * HEAT_TILES_X + cx / HEAT_TILE) * (HEAT_TILE * HEAT_TILE)
+                + (cy % HEAT_TILE) * HEAT_TILE + cx % HEAT_TILE;
+}
+
+/* Adds the touches in a frame that are on the surface to the heatmap. */
+void heat_add(const struct frame *f)
+{
+        struct heat_cell *c;
+        int state;
+        int ii;
+
+        for (ii = 0; ii < f->r.ntouches; ii++) {
+                state = f->r.touch[ii].state & MAGICMOUSE_TOUCH_STATE_MASK;
+                if (state != MAGICMOUSE_TOUCH_STATE_START && state != MAGICMOUSE_TOUCH_STATE_DRAG) {
+                        continue;
+                }
+                c = &heatmap[heat_index(f->r.touch[ii].x, f->r.touch[ii].y)];
+                c->count++;
+                c->major += f->r.touch[ii].major;
+                c->minor += f->r.touch[ii].minor;
+        }
+}
+
+/* Leaves the reading thread's CPU and priority to it, for threads
+ * that only write output.
+ */
+void leave_realtime(void)
+{
+        struct sched_param sp;
+        cpu_set_t cpus;
+        int ii;
+
+        if (rt_priority > 0) {
+                memset(&sp, 0, sizeof(sp));
+                pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+        }
+        if (rt_cpu >= 0) {
+                CPU_ZERO(&cpus);
+                for (ii = 0; ii < CPU_SETSIZE; ii++) {
+                        if (ii != rt_cpu) {
+                                CPU_SET(ii, &cpus);
+                        }
+                }
+                pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        }
+}
+
+/* Writes heatmap cells as <prefix>.pgm (log-scaled counts, front of
+ * the mouse at the top) and <prefix>.csv (every cell that has been
+ * touched).  Each file is written under a temporary name and renamed
+ * into place, so readers never see half a snapshot.
+ */
+int heat_write(const struct heat_cell cells[], const char prefix[])
+{
+        unsigned char row[HEAT_WIDTH];
+        const struct heat_cell *c;
+        char tmp[PATH_MAX];
+        char path[PATH_MAX];
+        uint64_t max;
+        double scale;
+        FILE *f;
+        int x;
+        int y;
+
+        max = 0;
+        for (x = 0; x < HEAT_WIDTH * HEAT_HEIGHT; x++) {
+                if (cells[x].count > max) {
+                        max = cells[x].count;
+                }
+        }
+        scale = max > 0 ? 255.0 / log1p((double)max) : 0.0;
+
+        snprintf(path, sizeof(path), "%s.pgm", prefix);
+        snprintf(tmp, sizeof(tmp), "%s.pgm.tmp", prefix);
+        f = fopen(tmp, "w");
+        if (f == NULL) {
+                return -1;
+        }
+        fprintf(f, "P5\n%d %d\n255\n", HEAT_WIDTH, HEAT_HEIGHT);
+        for (y = 0; y < HEAT_HEIGHT; y++) {
+                for (x = 0; x < HEAT_WIDTH; x++) {
+                        c = &cells[heat_index(HEAT_X_MIN + (x << HEAT_CELL_BITS),
+                                              HEAT_Y_MIN + (y << HEAT_CELL_BITS))];
+                        row[x] = (unsigned char)(log1p((double)c->count) * scale + 0.5);
+                }
+                fwrite(row, 1, sizeof(row), f);
+        }
+        if (fclose(f) || rename(tmp, path) < 0) {
+                return -1;
+        }
+
+        snprintf(path, sizeof(path), "%s.csv", prefix);
+        snprintf(tmp, sizeof(tmp), "%s.csv.tmp", prefix);
+        f = fopen(tmp, "w");
+        if (f == NULL) {
+                return -1;
+        }
+        fprintf(f, "x,y,count,major,minor\n");
+        for (y = 0; y < HEAT_HEIGHT; y++) {
+                for (x = 0; x < HEAT_WIDTH; x++) {
+                        c = &cells[heat_index(HEAT_X_MIN + (x << HEAT_CELL_BITS),
+                                              HEAT_Y_MIN + (y << HEAT_CELL_BITS))];
+                        if (c->count == 0) {
+                                continue;
+                        }
+                        fprintf(f, "%d,%d,%llu,%.1f,%.1f\n",
+                                HEAT_X_MIN + (x << HEAT_CELL_BITS), HEAT_Y_MIN + (y << HEAT_CELL_BITS),
+                                (unsigned long long)c->count,
+                                (double)c->major / c->count, (double)c->minor / c->count);
+                }
+        }
+        if (fclose(f) || rename(tmp, path) < 0) {
+                return -1;
+        }
+        return 0;
+}
+
+/* Writes the copy heat_snapshot() took, then says it is done. */
+void *heat_main(void *arg)
+{
+        (void)arg;
+        leave_realtime();
+        if (heat_write(heatmap_copy, heatmap_prefix) < 0) {
+                fprintf(stderr, "Unable to write heatmap %s: %s\n", heatmap_prefix, strerror(errno));
+        }
+        __atomic_store_n(&heatmap_running, 0, __ATOMIC_RELEASE);
+        return NULL;
+}
+
+/* Snapshots the heatmap.  Unless final is set, the counts are copied
+ * and a thread writes the copy, so the caller only pays for the
+ * memcpy(); if the last snapshot is still being written, this one is
+ * skipped.
+ */
+void heat_snapshot(int final)
+{
+        int res;
+
+        if (heatmap_joinable) {
+                if (!final && __atomic_load_n(&heatmap_running, __ATOMIC_ACQUIRE)) {
+                        return;
+                }
+                pthread_join(heatmap_writer, NULL);
+                heatmap_joinable = 0;
+        }
+        if (final) {
+                if (heat_write(heatmap, heatmap_prefix) < 0) {
+                        fprintf(stderr, "Unable to write heatmap %s: %s\n", heatmap_prefix, strerror(errno));
+                }
+                return;
+        }
+        memcpy(heatmap_copy, heatmap, sizeof(heatmap_copy));
+        heatmap_running = 1;
+        res = pthread_create(&heatmap_writer, NULL, heat_main, NULL);
+        if (res != 0) {
+                heatmap_running = 0;
+                fprintf(stderr, "Unable to start heatmap writer: %s\n", strerror(res));
+                return;
+        }
+        heatmap_joinable = 1;
+}
+
+/* Adds a decoded report to a device's summary. */
+void summarize(struct summary *sum, const struct frame *f)
+{
+        int ii;
+
+        sum->reports++;
+        if (f->r.type == FRAME_NONE) {
+                return;
+        }
+        sum->buttons = f->r.buttons;
+        if (f->r.type != FRAME_TOUCH) {
+                return;
+        }
+        sum->touch_reports++;
+        sum->ntouches = f->r.ntouches;
+        sum->x = sum->y = 0;
+        for (ii = 0; ii < f->r.ntouches; ii++) {
+                sum->x += f->r.touch[ii].x;
+                sum->y += f->r.touch[ii].y;
+        }
+        if (f->r.ntouches > 0) {
+                sum->x /= f->r.ntouches;
+                sum->y /= f->r.ntouches;
+        }
+}
+
+/* Prints one --summary line per device, covering the last seconds
+ * seconds, and starts the next interval.
+ */
+void print_summary(double seconds)
+{
+        static const char *const btns[] = { "none", "left", "right", "both" };
+        struct summary *sum;
+        struct output *o;
+        unsigned int ii;
+
+        for (ii = 0; ii < device_count; ii++) {
+                sum = &devices[ii].summary;
+                o = devices[ii].out;
+                out_reserve(o, 256);
+                out_str(o, devices[ii].name);
+                out_str(o, ": ");
+                out_int(o, (long)(sum->reports / seconds + 0.5), 5, 0);
+                out_str(o, " reports/s, ");
+                out_int(o, (long)(sum->touch_reports / seconds + 0.5), 5, 0);
+                out_str(o, " touch/s, ");
+                out_int(o, sum->ntouches, 2, 0);
+                out_str(o, " touches");
+                if (sum->ntouches > 0) {
+                        out_str(o, " at (");
+                        out_int(o, sum->x, 5, OUT_SIGN);
+                        out_str(o, ", ");
+                        out_int(o, sum->y, 5, OUT_SIGN);
+                        out_str(o, ")");
+                }
+                out_str(o, ", buttons ");
+                out_str(o, btns[sum->buttons & 3]);
+                out_str(o, "\n");
+                sum->reports = sum->touch_reports = 0;
+        }
+}
+
+/* Somewhere for packets to go once they are decoded.  Each sink gets
+ * every packet, raw and (if it is a motion or touch report) decoded.
+ */
+struct sink {
+        const char *name;
+        void (*packet)(struct device *d, int chan, const unsigned char data[], int len,
+                       const struct timespec *ts, const struct frame *f);
+};
+
+/* Appends the packet to the session log. */
+void log_packet(struct device *d, int chan, const unsigned char data[], int len,
+                const struct timespec *ts, const struct frame *f)
+{
+        (void)f;
+        if (record_file != NULL
+            && mtalk_log_append(&record_log, timespec_ns(ts) - realtime_offset, chan,
+                                d - devices, data, len) < 0) {
+                fprintf(stderr, "Unable to extend %s: %s\n", record_file, strerror(errno));
+                mtalk_log_close(&record_log);
+                record_file = NULL;
+        }
+}
+
+/* Grows the session log ahead of the records, so that appending one
+ * from the read path seldom has to.
+ */
+void reserve_log(void)
+{
+        if (record_file != NULL && mtalk_log_reserve(&record_log, record_log.grow / 2) < 0) {
+                fprintf(stderr, "Unable to extend %s: %s\n", record_file, strerror(errno));
+                mtalk_log_close(&record_log);
+                record_file = NULL;
+        }
+}
+
+/* Publishes the frame in the shared memory ring. */
+void shm_packet(struct device *d, int chan, const unsigned char data[], int len,
+                const struct timespec *ts, const struct frame *f)
+{
+        (void)chan;
+        (void)data;
+        (void)len;
+        if (f->r.type != FRAME_NONE) {
+                publish_frame(d, f, ts);
+        }
+}
+
+/* Sends the frame to the device's uinput device. */
+void uinput_packet(struct device *d, int chan, const unsigned char data[], int len,
+                   const struct timespec *ts, const struct frame *f)
+{
+        (void)chan;
+        (void)data;
+        (void)len;
+        (void)ts;
+        if (d->uinput.fd >= 0 && f->r.type != FRAME_NONE) {
+                uinput_emit(&d->uinput, f);
+        }
+}
+
+/* Prints the packet as text. */
+void text_packet(struct device *d, int chan, const unsigned char data[], int len,
+                 const struct timespec *ts, const struct frame *f)
+{
+        static const char *const names[2] = { "control", "interrupt" };
+        const char *prefix = d->out == &std_output && device_count > 1 ? d->name : NULL;
+        const struct hid_layout *l = __atomic_load_n(&d->layout, __ATOMIC_ACQUIRE);
+
+        if (l == NULL || print_declared(d->out, prefix, l, data, len, ts) < 0) {
+                print_report(d->out, prefix, data, len, names[chan], ts);
+        }
+        if (f->tracked) {
+                print_track(d->out, prefix, f);
+        }
+}
+
+/* Prints the packet as one line of JSON: decoded if it is a motion or
+ * touch report, otherwise as hex.
+ */
+void json_packet(struct device *d, int chan, const unsigned char data[], int len,
+                 const struct timespec *ts, const struct frame *f)
+{
+        static const char *const names[2] = { "control", "interrupt" };
+        static const char *const types[3] = { NULL, "motion", "touch" };
+        struct output *o = d->out;
+        int ii;
+
+        out_reserve(o, 256 + 2 * MAX_PACKET + 256 * MAX_TOUCHES);
+        out_str(o, "{\"time\":");
+        out_int(o, ts->tv_sec, 0, 0);
+        o->buf[o->len++] = '.';
+        out_int(o, ts->tv_nsec, 9, OUT_ZERO);
+        out_str(o, ",\"device\":\"");
+        out_str(o, d->name);
+        out_str(o, "\",\"channel\":\"");
+        out_str(o, names[chan]);
+        if (f->r.type == FRAME_NONE) {
+                out_str(o, "\",\"data\":\"");
+                for (ii = 0; ii < len; ii++) {
+                        out_hex(o, data[ii]);
+                }
+                out_str(o, "\"}\n");
+                return;
+        }
+        out_str(o, "\",\"type\":\"");
+        out_str(o, types[f->r.type]);
+        out_str(o, "\",\"buttons\":");
+        out_int(o, f->r.buttons, 0, 0);
+        out_str(o, ",\"dx\":");
+        out_int(o, f->r.dx, 0, 0);
+        out_str(o, ",\"dy\":");
+        out_int(o, f->r.dy, 0, 0);
+        if (f->r.type == FRAME_TOUCH) {
+                out_str(o, ",\"timestamp\":");
+                out_int(o, f->r.timestamp, 0, 0);
+                out_str(o, ",\"touches\":[");
+                for (ii = 0; ii < f->r.ntouches; ii++) {
+                        out_str(o, ii ? ",{\"id\":" : "{\"id\":");
+                        out_int(o, f->r.touch[ii].id, 0, 0);
+                        out_str(o, ",\"x\":");
+                        out_int(o, f->r.touch[ii].x, 0, 0);
+                        out_str(o, ",\"y\":");
+                        out_int(o, f->r.touch[ii].y, 0, 0);
+                        out_str(o, ",\"major\":");
+                        out_int(o, f->r.touch[ii].major, 0, 0);
+                        out_str(o, ",\"minor\":");
+                        out_int(o, f->r.touch[ii].minor, 0, 0);
+                        out_str(o, ",\"size\":");
+                        out_int(o, f->r.touch[ii].size, 0, 0);
+                        out_str(o, ",\"orientation\":");
+                        out_int(o, f->r.touch[ii].orientation, 0, 0);
+                        out_str(o, ",\"state\":");
+                        out_int(o, f->r.touch[ii].state, 0, 0);
+                        if (f->tracked) {
+                                out_str(o, ",\"vx\":");
+                                out_int(o, f->motion[ii].vx, 0, 0);
+                                out_str(o, ",\"vy\":");
+                                out_int(o, f->motion[ii].vy, 0, 0);
+                                out_str(o, ",\"ax\":");
+                                out_int(o, f->motion[ii].ax, 0, 0);
+                                out_str(o, ",\"ay\":");
+                                out_int(o, f->motion[ii].ay, 0, 0);
+                        }
+                        out_str(o, "}");
+                }
+                out_str(o, "]");
+        }
+        out_str(o, "}\n");
+}
+
+const struct sink log_sink = { "log", log_packet };
+const struct sink shm_sink = { "shm", shm_packet };
+const struct sink uinput_sink = { "uinput", uinput_packet };
+const struct sink text_sink = { "text", text_packet };
+const struct sink json_sink = { "json", json_packet };
+
+/* The sinks in use, in the order they get each packet. */
+const struct sink *sinks[8];
+unsigned int sink_count;
+
+/* Chooses sinks from the command line options.  The log and shared
+ * memory ring get everything; at most one of uinput, JSON and text
+ * gets the rest, and text only when nothing else is printing.  With
+ * --async, read_socket() feeds the log and ring itself before queuing
+ * each packet, so a full queue never costs them a packet.
+ */
+void choose_sinks(void)
+{
+        if (record_file != NULL && (!async_slots || replay_file != NULL)) {
+                sinks[sink_count++] = &log_sink;
+        }
+        if (shm_name != NULL && (!async_slots || replay_file != NULL)) {
+                sinks[sink_count++] = &shm_sink;
+        }
+        if (use_uinput) {
+                sinks[sink_count++] = &uinput_sink;
+        } else if (print_json) {
+                sinks[sink_count++] = &json_sink;
+        } else if (!summary_rate && !detect_gestures) {
+                sinks[sink_count++] = &text_sink;
+        }
+}
+
+/* Decodes a packet into f, if anything needs it, and tracks its
+ * touches.
+ */
+void decode_packet(struct device *d, int chan, const unsigned char data[], int len, struct frame *f)
+{
+        f->r.type = FRAME_NONE;
+        if (decode_frames || (measure_latency && chan == EV_INTR)) {
+                decode_frame(data, len, f);
+        }
+        f->tracked = 0;
+        if (track_touches && f->r.type == FRAME_TOUCH) {
+                track_frame(d, f);
+        }
+}
+
+/* Handles one packet from a mouse or a log; ts is when it arrived
+ * (CLOCK_REALTIME).  decoded is the packet's frame if the reading
+ * thread has already decoded it, or NULL.
+ */
+void handle_packet(struct device *d, int chan, const unsigned char data[], int len,
+                   const struct timespec *ts, const struct frame *decoded)
+{
+        static struct frame frame;
+        unsigned int ii;
+
+        if (decoded != NULL) {
+                frame = *decoded;
+        } else {
+                decode_packet(d, chan, data, len, &frame);
+        }
+        if (measure_latency && chan == EV_INTR) {
+                measure_report(d, ts, &frame);
+        }
+        if (detect_gestures && frame.r.type == FRAME_TOUCH) {
+                recognize_gestures(d, &frame, ts);
+        }
+        if (summary_rate) {
+                summarize(&d->summary, &frame);
+        }
+        if (heatmap_prefix != NULL && frame.r.type == FRAME_TOUCH) {
+                heat_add(&frame);
+        }
+        for (ii = 0; ii < sink_count; ii++) {
+                sinks[ii]->packet(d, chan, data, len, ts, &frame);
+        }
+}
+
+/* Returns the kernel's receive timestamp for msg, or the current
+ * time if there is none.
+ */
+void packet_time(struct msghdr *msg, struct timespec *ts)
+{
+        struct cmsghdr *cmsg;
+
+        for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                        memcpy(ts, CMSG_DATA(cmsg), sizeof(*ts));
+                        return;
+                }
+        }
+        clock_gettime(CLOCK_REALTIME, ts);
+}
+
+/* What goes through the queue to the writer thread: a packet, or
+ * a timer tick for something that prints.
+ */
+#define QUEUE_PACKET  0
+#define QUEUE_SUMMARY 1
+#define QUEUE_HEATMAP 2
+#define QUEUE_LATENCY 3
+#define QUEUE_STOP    4
+struct queued {
+        int kind;
+        int device;
+        int chan;
+        int len;
+        struct timespec ts;
+        /* For QUEUE_SUMMARY, the seconds since the last summary. */
+        double seconds;
+        unsigned char data[MAX_PACKET];
+        /* Non-zero if the reading thread decoded the packet into
+         * frame.
+         */
+        int decoded;
+        struct frame frame;
+};
+
+struct mtalk_queue queue;
+pthread_t writer;
+
+/* Puts a packet (and its frame, if it has been decoded) or tick on
+ * the queue to the writer thread.
+ */
+void queue_item(int kind, struct device *d, int chan, const unsigned char data[], int len,
+                const struct timespec *ts, const struct frame *f, double seconds)
+{
+        struct queued *q;
+
+        q = mtalk_queue_begin(&queue, kind == QUEUE_STOP ? MTALK_QUEUE_BLOCK : queue_policy);
+        if (q == NULL) {
+                return;
+        }
+        q->kind = kind;
+        q->device = d != NULL ? d - devices : 0;
+        q->chan = chan;
+        q->len = len;
+        if (ts != NULL) {
+                q->ts = *ts;
+        }
+        q->seconds = seconds;
+        if (len > 0) {
+                memcpy(q->data, data, len);
+        }
+        q->decoded = f != NULL;
+        if (f != NULL) {
+                q->frame = *f;
+        }
+        mtalk_queue_commit(&queue);
+}
+
+/* The writer thread: does everything with packets after reading
+ * them, and flushes output whenever it catches up.
+ */
+void *writer_main(void *arg)
+{
+        static struct queued q;
+
+        (void)arg;
+        leave_realtime();
+        for (;;) {
+                if (!mtalk_queue_get(&queue, &q, 0)) {
+                        flush_outputs();
+                        mtalk_queue_get(&queue, &q, 1);
+                }
+                switch (q.kind) {
+                case QUEUE_PACKET:
+                        handle_packet(&devices[q.device], q.chan, q.data, q.len, &q.ts,
+                                      q.decoded ? &q.frame : NULL);
+                        break;
+                case QUEUE_SUMMARY:
+                        print_summary(q.seconds);
+                        break;
+                case QUEUE_HEATMAP:
+                        heat_snapshot(0);
+                        break;
+                case QUEUE_LATENCY:
+                        print_latency();
+                        break;
+                case QUEUE_STOP:
+                        flush_outputs();
+                        return NULL;
+                }
+        }
+}
+
+/* Notes that d is sending reports again after a reconnect. */
+void recovered(struct device *d)
+{
+        struct reconnect *r = &d->reconnect;
+        struct timespec now;
+        int64_t down;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        down = timespec_ns(&now) - r->lost_ns;
+        fprintf(stderr, "reconnect: %s recovered after %.3f s and %u attempts\n",
+                d->name, down / 1e9, r->attempts);
+        r->recoveries++;
+        r->down_ns += down;
+        if (down > r->max_down_ns) {
+                r->max_down_ns = down;
+        }
+        r->lost_ns = 0;
+        r->attempts = 0;
+}
+
+/* Reads up to batch_size packets from fd.  Returns 1 if there may be
+ * more to read, 0 if the socket is empty, or -1 if the channel
+ * failed or closed.
+ */
+int read_socket(struct device *d, int chan, const char name[])
+{
+        static unsigned char data[MAX_BATCH][MAX_PACKET];
+        static union {
+                struct cmsghdr align;
+                char buf[CMSG_SPACE(sizeof(struct timespec))];
+        } control[MAX_BATCH];
+        static struct iovec iov[MAX_BATCH];
+        static struct mmsghdr msgs[MAX_BATCH];
+        static struct frame frame;
+        struct timespec ts;
+        int res;
+        int ii;
+
+        for (ii = 0; ii < batch_size; ii++) {
+                iov[ii].iov_base = data[ii];
+                iov[ii].iov_len = sizeof(data[ii]);
+                memset(&msgs[ii], 0, sizeof(msgs[ii]));
+                msgs[ii].msg_hdr.msg_iov = &iov[ii];
+                msgs[ii].msg_hdr.msg_iovlen = 1;
+                msgs[ii].msg_hdr.msg_control = control[ii].buf;
+                msgs[ii].msg_hdr.msg_controllen = sizeof(control[ii].buf);
+        }
+
+        res = recvmmsg(d->fds[chan], msgs, batch_size, MSG_DONTWAIT, NULL);
+        if (res < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        return 0;
+                } else if (errno == EINTR) {
+                        return 1;
+                }
+                fprintf(stderr, "Read error on %s HID %s: %s\n", d->name, name, strerror(errno));
+                return -1;
+        }
+
+        for (ii = 0; ii < res; ii++) {
+                if (msgs[ii].msg_len == 0) {
+                        fprintf(stderr, "%s HID %s channel closed\n", d->name, name);
+                        return -1;
+                }
+                if (msgs[ii].msg_hdr.msg_flags & MSG_TRUNC) {
+                        fprintf(stderr, "Truncated packet on %s HID %s\n", d->name, name);
+                }
+                packet_time(&msgs[ii].msg_hdr, &ts);
+                if (d->reconnect.lost_ns != 0 && chan == EV_INTR) {
+                        recovered(d);
+                }
+                d->stats[chan].packets++;
+                d->stats[chan].bytes += msgs[ii].msg_len;
+                if (async_slots && shm_name != NULL) {
+                        /* The ring needs every frame, so it is fed here. */
+                        decode_packet(d, chan, data[ii], msgs[ii].msg_len, &frame);
+                        log_packet(d, chan, data[ii], msgs[ii].msg_len, &ts, &frame);
+                        shm_packet(d, chan, data[ii], msgs[ii].msg_len, &ts, &frame);
+                        queue_item(QUEUE_PACKET, d, chan, data[ii], msgs[ii].msg_len, &ts, &frame, 0);
+                } else if (async_slots) {
+                        log_packet(d, chan, data[ii], msgs[ii].msg_len, &ts, NULL);
+                        queue_item(QUEUE_PACKET, d, chan, data[ii], msgs[ii].msg_len, &ts, NULL, 0);
+                } else {
+                        handle_packet(d, chan, data[ii], msgs[ii].msg_len, &ts, NULL);
+                }
+        }
+
+        /* A short batch means the queue was empty. */
+        return res == batch_size;
+}
+
+void print_stats(double seconds)
+{
+        struct device *d;
+
+        for (d = devices; d < devices + device_count; d++) {
+                if (d->fds[0] < 0) {
+                        continue;
+                }
+                fprintf(stderr, "stats: %s control %.1f pkt/s %.0f B/s, interrupt %.1f pkt/s %.0f B/s\n",
+                        d->name, d->stats[0].packets / seconds, d->stats[0].bytes / seconds,
+                        d->stats[1].packets / seconds, d->stats[1].bytes / seconds);
+                memset(d->stats, 0, sizeof(d->stats));
+        }
+        if (async_slots) {
+                fprintf(stderr, "stats: writer queue dropped %llu, overwrote %llu\n",
+                        (unsigned long long)queue.dropped, (unsigned long long)__atomic_load_n(&queue.lost, __ATOMIC_RELAXED));
+        }
+}
+
+/* Touches 256 KiB of stack so that mlockall() keeps it resident. */
+void prefault_stack(void)
+{
+        volatile unsigned char stack[256 << 10];
+        size_t ii;
+
+        for (ii = 0; ii < sizeof(stack); ii += 4096) {
+                stack[ii] = 0;
+        }
+}
+
+/* Applies --rt and --cpu: pins us to a CPU, locks and prefaults our
+ * memory, and switches to SCHED_FIFO.  The packet buffers are static,
+ * so after this the read loop should not take page faults.
+ */
+int start_realtime(void)
+{
+        struct sched_param sp;
+        cpu_set_t cpus;
+
+        if (rt_cpu >= 0) {
+                CPU_ZERO(&cpus);
+                CPU_SET(rt_cpu, &cpus);
+                if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {
+                        fprintf(stderr, "Unable to pin to CPU %d: %s\n", rt_cpu, strerror(errno));
+                        return -1;
+                }
+        }
+        if (rt_priority > 0) {
+                prefault_stack();
+                if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+                        fprintf(stderr, "Unable to lock memory: %s\n", strerror(errno));
+                        return -1;
+                }
+                memset(&sp, 0, sizeof(sp));
+                sp.sched_priority = rt_priority;
+                if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0) {
+                        fprintf(stderr, "Unable to use SCHED_FIFO: %s\n", strerror(errno));
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+/* Prints the page faults and context switches between two samples. */
+void print_rusage(const struct rusage *start, const struct rusage *end)
+{
+        fprintf(stderr, "rusage: %ld minor faults, %ld major faults, %ld voluntary and %ld involuntary context switches\n",
+                end->ru_minflt - start->ru_minflt, end->ru_majflt - start->ru_majflt,
+                end->ru_nvcsw - start->ru_nvcsw, end->ru_nivcsw - start->ru_nivcsw);
+}
+
+/* Opens device d's output and, if wanted, its uinput device. */
+int start_device(struct device *d)
+{
+        char path[1024];
+        int fd;
+
+        d->out = &std_output;
+        if (output_prefix != NULL) {
+                snprintf(path, sizeof(path), "%s%s", output_prefix, d->name);
+                fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+                d->out = fd < 0 ? NULL : malloc(sizeof(*d->out));
+                if (d->out == NULL) {
+                        fprintf(stderr, "Unable to create %s: %s\n", path, strerror(errno));
+                        d->out = &std_output;
+                        return -1;
+                }
+                d->out->fd = fd;
+                d->out->len = 0;
+        }
+        if (use_uinput && uinput_open(d) < 0) {
+                return -1;
+        }
+        return 0;
+}
+
+/* Undoes start_device(). */
+void finish_device(struct device *d)
+{
+        if (d->uinput.fd >= 0) {
+                ioctl(d->uinput.fd, UI_DEV_DESTROY);
+                close(d->uinput.fd);
+                d->uinput.fd = -1;
+        }
+        if (d->out != NULL && d->out != &std_output) {
+                out_flush(d->out);
+                close(d->out->fd);
+                free(d->out);
+        }
+        d->out = NULL;
+}
+
+/* Closes device d.  Returns zero if it hung up on purpose. */
+int close_device(struct device *d)
+{
+        int res;
+
+        if (d->fds[0] < 0) {
+                return 0;
+        }
+        res = transports[d->transport].close(d);
+        d->fds[0] = d->fds[1] = -1;
+        d->connecting = -1;
+        return res;
+}
+
+/* Opens d, waiting for any background connect to finish.  Returns
+ * zero or -1.
+ */
+int open_device(struct device *d)
+{
+        struct pollfd pfd;
+        int res;
+
+        res = transports[d->transport].open(d);
+        while (res > 0) {
+                pfd.fd = d->fds[d->connecting];
+                pfd.events = POLLOUT;
+                if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                        fprintf(stderr, "Unable to wait for %s to connect: %s\n", d->name, strerror(errno));
+                        close_device(d);
+                        return -1;
+                }
+                if (pfd.revents != 0) {
+                        res = transports[d->transport].connected(d);
+                }
+        }
+        return res;
+}
+
+/* Watches both of d's channels in epfd. */
+int watch_device(int epfd, struct device *d)
+{
+        uint32_t idx = d - devices;
+
+        return watch_fd(epfd, d->fds[0], idx << 2 | EV_CTRL, EPOLLIN | EPOLLRDHUP | EPOLLET)
+                || watch_fd(epfd, d->fds[1], idx << 2 | EV_INTR, EPOLLIN | EPOLLRDHUP | EPOLLET);
+}
+
+/* How many devices are waiting to reconnect or connecting in the
+ * background, and the earliest retry_ns among them (zero if none is
+ * waiting), kept up to date as devices come and go.
+ */
+unsigned int reconnect_pending;
+int64_t reconnect_next_ns;
+
+/* Sets when d should next try to reconnect. */
+void retry_at(struct device *d, int64_t ns)
+{
+        d->reconnect.retry_ns = ns;
+        if (reconnect_next_ns == 0 || ns < reconnect_next_ns) {
+                reconnect_next_ns = ns;
+        }
+}
+
+/* Schedules a reconnect for d, which went away unexpectedly.  The
+ * first attempt is immediate; after that, each failure doubles the
+ * wait, up to reconnect_max_ms.  An outage lasts until reports flow
+ * again, so a mouse that drops straight back out keeps backing off.
+ */
+void lost_device(struct device *d)
+{
+        struct reconnect *r = &d->reconnect;
+        struct timespec now;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (!r->waiting) {
+                r->waiting = 1;
+                reconnect_pending++;
+        }
+        if (r->lost_ns == 0) {
+                r->lost_ns = timespec_ns(&now);
+                r->backoff_ms = RECONNECT_MIN_MS;
+                retry_at(d, r->lost_ns);
+        } else {
+                retry_at(d, timespec_ns(&now) + r->backoff_ms * (int64_t)1000000);
+                r->backoff_ms = r->backoff_ms * 2 > reconnect_max_ms ? reconnect_max_ms : r->backoff_ms * 2;
+        }
+}
+
+/* Returns how many milliseconds epoll_wait() may sleep before the
+ * next reconnect attempt is due, or -1 for no limit.
+ */
+int reconnect_wait(void)
+{
+        struct timespec now;
+        int64_t next;
+
+        if (reconnect_next_ns == 0) {
+                return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        next = reconnect_next_ns - timespec_ns(&now);
+        return next <= 0 ? 0 : (int)((next + 999999) / 1000000);
+}
+
+/* Finishes reconnecting d once its channels are open: replays the
+ * initialization writes and watches it in epfd again.  Returns zero
+ * or -1.
+ */
+int resume_device(int epfd, struct device *d)
+{
+        fetch_descriptor(d, 0);
+        if (write_mystery(d->fds[0]) < 0 || watch_device(epfd, d)) {
+                return -1;
+        }
+        d->reconnect.waiting = 0;
+        reconnect_pending--;
+        return 0;
+}
+
+/* Watches the socket d is connecting in the background in epfd, so
+ * the loop can hand it to continue_device() when it is writable.
+ */
+int watch_connect(int epfd, struct device *d)
+{
+        return watch_fd(epfd, d->fds[d->connecting], (d - devices) << 2 | d->connecting, EPOLLOUT);
+}
+
+/* Carries on a background reconnect of d, whose connecting socket is
+ * writable.  Returns 1 if d is back, or zero if it is still
+ * connecting or has failed (and will be tried again).
+ */
+int continue_device(int epfd, struct device *d)
+{
+        int res;
+
+        epoll_ctl(epfd, EPOLL_CTL_DEL, d->fds[d->connecting], NULL);
+        res = transports[d->transport].connected(d);
+        if (res > 0 && watch_connect(epfd, d) == 0) {
+                return 0;
+        }
+        if (res == 0 && resume_device(epfd, d) == 0) {
+                return 1;
+        }
+        if (d->fds[0] >= 0) {
+                close_device(d);
+        }
+        lost_device(d);
+        return 0;
+}
+
+/* Tries to reconnect every device that is due, if any are.
+ * Connections that cannot finish at once carry on in the background,
+ * through continue_device(), so a mouse that is out of range never
+ * holds up reading the others.  Session state (logs, statistics,
+ * summaries) carries on untouched.  Returns how many devices came
+ * back at once.
+ */
+int retry_devices(int epfd)
+{
+        struct reconnect *r;
+        struct timespec now;
+        struct device *d;
+        int count;
+        int res;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (reconnect_next_ns == 0 || reconnect_next_ns > timespec_ns(&now)) {
+                return 0;
+        }
+        reconnect_next_ns = 0;
+        for (d = devices, count = 0; d < devices + device_count; d++) {
+                r = &d->reconnect;
+                if (r->retry_ns == 0) {
+                        continue;
+                }
+                if (r->retry_ns > timespec_ns(&now)) {
+                        retry_at(d, r->retry_ns);
+                        continue;
+                }
+                r->retry_ns = 0;
+                r->attempts++;
+                res = transports[d->transport].open(d);
+                if (res > 0 && watch_connect(epfd, d) == 0) {
+                        continue;
+                }
+                if (res == 0 && resume_device(epfd, d) == 0) {
+                        count++;
+                        continue;
+                }
+                if (d->fds[0] >= 0) {
+                        close_device(d);
+                }
+                lost_device(d);
+        }
+        return count;
+}
+
+/* Reports each device's outages at the end of a session. */
+void print_reconnects(void)
+{
+        struct reconnect *r;
+        struct device *d;
+
+        for (d = devices; d < devices + device_count; d++) {
+                r = &d->reconnect;
+                if (r->recoveries > 0) {
+                        fprintf(stderr, "reconnect: %s recovered %u times, down %.3f s in all, longest %.3f s\n",
+                                d->name, r->recoveries, r->down_ns / 1e9, r->max_down_ns / 1e9);
+                }
+                if (r->lost_ns != 0) {
+                        fprintf(stderr, "reconnect: %s still lost after %u attempts\n", d->name, r->attempts);
+                }
+        }
+}
+
+/* Waits for traffic on every device's HID channels until a signal
+ * arrives or every device has gone away.  Sockets are edge-triggered,
+ * so each wakeup drains its socket completely; the work done per
+ * wakeup depends only on how many sockets are ready.  Returns zero if
+ * we stopped for a signal or every device hung up on purpose.
+ */
+int read_data(void)
+{
+        static const char *const names[2] = { "control", "interrupt" };
+        struct epoll_event events[64];
+        struct itimerspec its;
+        struct signalfd_siginfo ssi;
+        struct device *d;
+        sigset_t mask;
+        uint64_t ticks;
+        unsigned int active;
+        unsigned int ii;
+        uint32_t tag;
+        int failed;
+        int running;
+        int epfd;
+        int sigfd;
+        int tfd;
+        int sfd;
+        int hfd;
+        int lfd;
+        int chan;
+        int res;
+        int nn;
+
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGINT);
+        sigaddset(&mask, SIGTERM);
+        sigprocmask(SIG_BLOCK, &mask, NULL);
+        sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (sigfd < 0 || epfd < 0) {
+                fprintf(stderr, "Unable to set up event loop: %s\n", strerror(errno));
+                return -1;
+        }
+        if (watch_fd(epfd, sigfd, EV_SIGNAL, EPOLLIN)) {
+                return -1;
+        }
+        for (ii = 0; ii < HCI_MAX_DEV; ii++) {
+                hci_fds[ii] = -1;
+        }
+        active = 0;
+        for (ii = 0; ii < device_count; ii++) {
+                if (devices[ii].fds[0] < 0) {
+                        /* Lost at startup; retry_devices() has it. */
+                        continue;
+                }
+                if (watch_device(epfd, &devices[ii])) {
+                        return -1;
+                }
+                active++;
+        }
+
+        tfd = -1;
+        if (stats_interval > 0) {
+                tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+                memset(&its, 0, sizeof(its));
+                its.it_interval.tv_sec = its.it_value.tv_sec = stats_interval;
+                if (tfd < 0 || timerfd_settime(tfd, 0, &its, NULL) < 0
+                    || watch_fd(epfd, tfd, EV_TIMER, EPOLLIN)) {
+                        fprintf(stderr, "Unable to start statistics timer: %s\n", strerror(errno));
+                        return -1;
+                }
+        }
+
+        sfd = -1;
+        if (summary_rate > 0) {
+                sfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+                memset(&its, 0, sizeof(its));
+                its.it_interval.tv_nsec = its.it_value.tv_nsec = 1000000000 / summary_rate;
+                if (summary_rate == 1) {
+                        its.it_interval.tv_sec = its.it_value.tv_sec = 1;
+                        its.it_interval.tv_nsec = its.it_value.tv_nsec = 0;
+                }
+                if (sfd < 0 || timerfd_settime(sfd, 0, &its, NULL) < 0
+                    || watch_fd(epfd, sfd, EV_SUMMARY, EPOLLIN)) {
+                        fprintf(stderr, "Unable to start summary timer: %s\n", strerror(errno));
+                        return -1;
+                }
+        }
+
+        hfd = -1;
+        if (heatmap_prefix != NULL) {
+                hfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+                memset(&its, 0, sizeof(its));
+                its.it_interval.tv_sec = its.it_value.tv_sec = heatmap_interval;
+                if (hfd < 0 || timerfd_settime(hfd, 0, &its, NULL) < 0
+                    || watch_fd(epfd, hfd, EV_HEATMAP, EPOLLIN)) {
+                        fprintf(stderr, "Unable to start heatmap timer: %s\n", strerror(errno));
+                        return -1;
+                }
+        }
+
+        lfd = -1;
+        if (record_file != NULL) {
+                /* Once a second leaves plenty of room at any packet rate. */
+                lfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+                memset(&its, 0, sizeof(its));
+                its.it_interval.tv_sec = its.it_value.tv_sec = 1;
+                if (lfd < 0 || timerfd_settime(lfd, 0, &its, NULL) < 0
+                    || watch_fd(epfd, lfd, EV_LOG, EPOLLIN)) {
+                        fprintf(stderr, "Unable to start log timer: %s\n", strerror(errno));
+                        return -1;
+                }
+        }
+
+        if (async_slots) {
+                if (mtalk_queue_init(&queue, async_slots, sizeof(struct queued), queue_policy) < 0) {
+                        fprintf(stderr, "Unable to create writer queue: %s\n", strerror(errno));
+                        return -1;
+                }
+                res = pthread_create(&writer, NULL, writer_main, NULL);
+                if (res != 0) {
+                        fprintf(stderr, "Unable to start writer thread: %s\n", strerror(res));
+                        return -1;
+                }
+        }
+
+        if (measure_latency) {
+                sample_links(epfd);
+        }
+
+        failed = 0;
+        for (running = 1; running && active + reconnect_pending > 0; ) {
+                nn = epoll_wait(epfd, events, sizeof(events) / sizeof(events[0]), reconnect_wait());
+                if (nn < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        fprintf(stderr, "epoll_wait() failed: %s\n", strerror(errno));
+                        failed = 1;
                         break;
-                case 1:
-                        read_socket(pfd[1].fd, "interrupt");
+                }
+
+                for (ii = 0; ii < (unsigned int)nn; ii++) {
+                        tag = events[ii].data.u32;
+                        switch (tag & 3) {
+                        case EV_CTRL:
+                        case EV_INTR:
+                                d = &devices[tag >> 2];
+                                chan = tag & 3;
+                                if (d->fds[0] < 0) {
+                                        /* Closed earlier in this batch. */
+                                        break;
+                                }
+                                if (d->connecting >= 0) {
+                                        if (chan == d->connecting) {
+                                                active += continue_device(epfd, d);
+                                        }
+                                        break;
+                                }
+                                res = 0;
+                                if (events[ii].events & EPOLLIN) {
+                                        while ((res = read_socket(d, chan, names[chan])) > 0) {
+                                                /* keep draining */
+                                        }
+                                }
+                                if (res < 0 || (events[ii].events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR))) {
+                                        /* Keep what the other channel already has. */
+                                        while (read_socket(d, chan ^ 1, names[chan ^ 1]) > 0) {
+                                                /* keep draining */
+                                        }
+                                        if (close_device(d) >= 0) {
+                                                /* It hung up on purpose. */
+                                        } else if (reconnect_max_ms) {
+                                                fprintf(stderr, "Lost %s HID %s channel; reconnecting\n",
+                                                        d->name, names[chan]);
+                                                lost_device(d);
+                                        } else {
+                                                fprintf(stderr, "Lost %s HID %s channel\n", d->name, names[chan]);
+                                                failed = 1;
+                                        }
+                                        active--;
+                                }
+                                break;
+                        case EV_SIGNAL:
+                                if (tag == EV_HCI) {
+                                        hci_events();
+                                        break;
+                                }
+                                while (read(sigfd, &ssi, sizeof(ssi)) == sizeof(ssi)) {
+                                        running = 0;
+                                }
+                                break;
+                        case EV_TIMER:
+                                if (tag == EV_SUMMARY) {
+                                        if (read(sfd, &ticks, sizeof(ticks)) != sizeof(ticks)) {
+                                                /* spurious wakeup */
+                                        } else if (async_slots) {
+                                                queue_item(QUEUE_SUMMARY, NULL, 0, NULL, 0, NULL, NULL,
+                                                           (double)ticks / summary_rate);
+                                        } else {
+                                                print_summary((double)ticks / summary_rate);
+                                        }
+                                } else if (tag == EV_HEATMAP) {
+                                        if (read(hfd, &ticks, sizeof(ticks)) != sizeof(ticks)) {
+                                                /* spurious wakeup */
+                                        } else if (async_slots) {
+                                                queue_item(QUEUE_HEATMAP, NULL, 0, NULL, 0, NULL, NULL, 0);
+                                        } else {
+                                                heat_snapshot(0);
+                                        }
+                                } else if (tag == EV_LOG) {
+                                        if (read(lfd, &ticks, sizeof(ticks)) == sizeof(ticks)) {
+                                                reserve_log();
+                                        }
+                                } else if (read(tfd, &ticks, sizeof(ticks)) == sizeof(ticks)) {
+                                        print_stats((double)stats_interval * ticks);
+                                        if (measure_latency && async_slots) {
+                                                queue_item(QUEUE_LATENCY, NULL, 0, NULL, 0, NULL, NULL, 0);
+                                        } else if (measure_latency) {
+                                                print_latency();
+                                        }
+                                        if (measure_latency) {
+                                                print_links();
+                                                sample_links(epfd);
+                                        }
+                                }
+                                break;
+                        }
+                }
+                if (reconnect_pending > 0) {
+                        active += retry_devices(epfd);
+                }
+                if (!async_slots) {
+                        flush_outputs();
+                }
+        }
+
+        if (async_slots) {
+                queue_item(QUEUE_STOP, NULL, 0, NULL, 0, NULL, NULL, 0);
+                pthread_join(writer, NULL);
+        }
+
+        if (tfd >= 0) {
+                close(tfd);
+        }
+        if (sfd >= 0) {
+                close(sfd);
+        }
+        if (hfd >= 0) {
+                close(hfd);
+        }
+        if (lfd >= 0) {
+                close(lfd);
+        }
+        hci_close();
+        close(sigfd);
+        close(epfd);
+        return failed ? -1 : 0;
+}
+
+/* Discards everything waiting on fd. */
+void probe_drain(int fd)
+{
+        unsigned char buf[MAX_PACKET];
+
+        while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+                /* keep draining */
+        }
+}
+
+/* Sends a request on a control channel and waits up to a second for
+ * the reply.  Returns the reply's HIDP header, or -1 with errno set;
+ * *rtt gets the round trip time in nanoseconds.
+ */
+int probe_request(int ctrl, const unsigned char req[], size_t len, int64_t *rtt)
+{
+        unsigned char reply[MAX_PACKET];
+        struct timespec start;
+        struct timespec end;
+        struct pollfd pfd;
+        ssize_t res;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (send(ctrl, req, len, 0) < 0) {
+                return -1;
+        }
+        pfd.fd = ctrl;
+        pfd.events = POLLIN;
+        do {
+                res = poll(&pfd, 1, 1000);
+        } while (res < 0 && errno == EINTR);
+        if (res == 0) {
+                errno = ETIMEDOUT;
+        }
+        if (res <= 0 || (res = recv(ctrl, reply, sizeof(reply), MSG_DONTWAIT)) < 1) {
+                return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        *rtt = timespec_ns(&end) - timespec_ns(&start);
+        return reply[0];
+}
+
+/* Reads d's interrupt channel for ms milliseconds.  Returns how many
+ * motion and touch reports arrived, adding the gaps between them to
+ * h (if it is not NULL), their sum to *sum and their squares' sum to
+ * *sumsq.
+ */
+unsigned long probe_reports(struct device *d, unsigned int ms, struct histogram *h, double *sum, double *sumsq)
+{
+        unsigned char data[MAX_PACKET];
+        union {
+                struct cmsghdr align;
+                char buf[CMSG_SPACE(sizeof(struct timespec))];
+        } control;
+        struct timespec ts;
+        struct pollfd pfd;
+        struct msghdr msg;
+        struct iovec iov;
+        unsigned long count;
+        int64_t deadline;
+        int64_t last;
+        int64_t now;
+        ssize_t res;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        deadline = timespec_ns(&ts) + ms * (int64_t)1000000;
+        pfd.fd = d->fds[1];
+        pfd.events = POLLIN;
+        count = 0;
+        last = 0;
+        for (;;) {
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                now = timespec_ns(&ts);
+                if (now >= deadline) {
                         break;
-                default:
-                        fprintf(stdout, "poll() failed: %s\n", strerror(errno));
+                }
+                if (poll(&pfd, 1, (deadline - now + 999999) / 1000000) <= 0) {
+                        continue;
+                }
+                iov.iov_base = data;
+                iov.iov_len = sizeof(data);
+                memset(&msg, 0, sizeof(msg));
+                msg.msg_iov = &iov;
+                msg.msg_iovlen = 1;
+                msg.msg_control = control.buf;
+                msg.msg_controllen = sizeof(control.buf);
+                res = recvmsg(d->fds[1], &msg, MSG_DONTWAIT);
+                if (res == 0 || (res < 0 && errno != EAGAIN && errno != EINTR)) {
+                        break;
+                }
+                if (res < 2 || data[0] != 0xa1 || (data[1] != 0x10 && data[1] != 0x29)) {
+                        continue;
+                }
+                packet_time(&msg, &ts);
+                now = timespec_ns(&ts);
+                if (count++ > 0 && h != NULL) {
+                        hist_add(h, now - last);
+                        *sum += now - last;
+                        *sumsq += (double)(now - last) * (now - last);
+                }
+                last = now;
+        }
+        return count;
+}
+
+/* Runs --probe against d: times GET_REPORT and SET_REPORT round trips
+ * on the control channel, then tries each value of the last byte of
+ * the 0xf8 feature write and measures the report rate and jitter
+ * that result.  Leaves the mouse with mtalk's usual 0x32.
+ */
+int probe_device(struct device *d)
+{
+        static const unsigned char get_f8[] = { HIDP_GET_REPORT | HIDP_FEATURE, 0xf8 };
+        static const unsigned char set_d7[] = { HIDP_SET_REPORT | HIDP_FEATURE, 0xd7, 0x01 };
+        static struct histogram get_rtt = { "GET_REPORT 0xf8 round trip", "ns", 0, 0, 0, { 0 } };
+        static struct histogram set_rtt = { "SET_REPORT 0xd7 round trip", "ns", 0, 0, 0, { 0 } };
+        static struct histogram gaps = { "report gap", "ns", 0, 0, 0, { 0 } };
+        unsigned char set_f8[] = { HIDP_SET_REPORT | HIDP_FEATURE, 0xf8, 0x01, 0x32 };
+        unsigned int get_errors;
+        unsigned int set_errors;
+        unsigned int ii;
+        unsigned long count;
+        uint64_t best_p99;
+        uint64_t p99;
+        double sumsq;
+        double sum;
+        double mean;
+        double var;
+        int64_t rtt;
+        int best;
+        int res;
+
+        /* Throw away the replies to write_mystery(). */
+        usleep(100000);
+        probe_drain(d->fds[0]);
+
+        hist_reset(&get_rtt);
+        hist_reset(&set_rtt);
+        get_errors = set_errors = 0;
+        for (ii = 0; ii < probe_params.rounds; ii++) {
+                res = probe_request(d->fds[0], get_f8, sizeof(get_f8), &rtt);
+                if (res < 0) {
+                        fprintf(stderr, "probe: %s: no reply to GET_REPORT: %s\n", d->name, strerror(errno));
+                        return -1;
+                }
+                hist_add(&get_rtt, rtt);
+                get_errors += (res & 0xf0) != HIDP_DATA;
+                res = probe_request(d->fds[0], set_d7, sizeof(set_d7), &rtt);
+                if (res < 0) {
+                        fprintf(stderr, "probe: %s: no reply to SET_REPORT: %s\n", d->name, strerror(errno));
+                        return -1;
+                }
+                hist_add(&set_rtt, rtt);
+                set_errors += res != (HIDP_HANDSHAKE | HIDP_HSHK_SUCCESSFUL);
+        }
+        fprintf(stderr, "probe: %s: %u GET_REPORT errors, %u SET_REPORT errors\n",
+                d->name, get_errors, set_errors);
+        hist_print(&get_rtt);
+        hist_print(&set_rtt);
+
+        best = -1;
+        best_p99 = 0;
+        for (ii = probe_params.from; ii <= probe_params.to; ii += probe_params.step) {
+                set_f8[3] = ii;
+                res = probe_request(d->fds[0], set_f8, sizeof(set_f8), &rtt);
+                if (res != (HIDP_HANDSHAKE | HIDP_HSHK_SUCCESSFUL)) {
+                        fprintf(stderr, "probe: %s: 0xf8 write with 0x%02x refused\n", d->name, ii);
+                        continue;
+                }
+                /* Let the new setting take effect. */
+                probe_reports(d, 200, NULL, NULL, NULL);
+                hist_reset(&gaps);
+                sum = sumsq = 0;
+                count = probe_reports(d, probe_params.dwell, &gaps, &sum, &sumsq);
+                if (count < 3) {
+                        fprintf(stderr, "probe: %s: 0x%02x: %lu reports\n", d->name, ii, count);
+                        continue;
+                }
+                mean = sum / gaps.count;
+                var = sumsq / gaps.count - mean * mean;
+                p99 = hist_percentile(&gaps, 99);
+                fprintf(stderr, "probe: %s: 0x%02x: %.1f reports/s, gap mean %.3f ms stddev %.3f ms p99 %.3f ms\n",
+                        d->name, ii, count * 1000.0 / probe_params.dwell, mean / 1e6,
+                        sqrt(var > 0 ? var : 0) / 1e6, p99 / 1e6);
+                if (best < 0 || p99 < best_p99) {
+                        best = ii;
+                        best_p99 = p99;
+                }
+        }
+        if (best >= 0) {
+                fprintf(stderr, "probe: %s: lowest p99 report gap with 0x%02x (%.3f ms)\n",
+                        d->name, best, best_p99 / 1e6);
+        }
+
+        set_f8[3] = 0x32;
+        probe_request(d->fds[0], set_f8, sizeof(set_f8), &rtt);
+        return 0;
+}
+
+/* Probes every device in turn.  Returns -1 if any probe failed. */
+int probe_devices(void)
+{
+        unsigned int ii;
+        int res;
+
+        for (ii = 0, res = 0; ii < device_count; ii++) {
+                if (probe_device(&devices[ii]) < 0) {
+                        res = -1;
+                }
+        }
+        return res;
+}
+
+/* Starts the session log, if one was requested, with the given
+ * CLOCK_REALTIME and CLOCK_MONOTONIC start times.
+ */
+void start_record(int64_t realtime_ns, int64_t monotonic_ns)
+{
+        realtime_offset = realtime_ns - monotonic_ns;
+        if (record_file != NULL
+            && mtalk_log_create(&record_log, record_file, record_prealloc,
+                                realtime_ns, monotonic_ns) < 0) {
+                fprintf(stderr, "Unable to create %s: %s\n", record_file, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+}
+
+/* Feeds every packet in replay_file through handle_packet(), either
+ * as fast as possible or (if replay_paced) with the original spacing.
+ * Devices named with -r or -S stand for the log's first devices; the
+ * rest are added as needed.  A log written while replaying keeps the
+ * original times.
+ */
+int replay(void)
+{
+        const struct mtalk_log_record *rec;
+        struct mtalk_log_reader rd;
+        struct timespec ts;
+        int64_t next_summary;
+        int64_t next_heatmap;
+        int64_t first;
+        int64_t start;
+        int64_t offset;
+        unsigned int ii;
+
+        if (mtalk_log_open(&rd, replay_file) < 0) {
+                fprintf(stderr, "Unable to read %s: %s\n", replay_file,
+                        errno == EINVAL ? "not an mtalk log" : strerror(errno));
+                return -1;
+        }
+
+        start_record(rd.header->start_realtime_ns, rd.header->start_monotonic_ns);
+        for (ii = 0; ii < device_count; ii++) {
+                if (start_device(&devices[ii]) < 0) {
+                        mtalk_log_unmap(&rd);
+                        return -1;
+                }
+        }
+        offset = realtime_offset;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        start = timespec_ns(&ts);
+        first = -1;
+        next_summary = 0;
+        next_heatmap = 0;
+        replaying = 1;
+        while ((rec = mtalk_log_next(&rd)) != NULL) {
+                /* Skip records mtalk could not have received. */
+                if (rec->channel > 1 || rec->device >= MAX_DEVICES
+                    || rec->length == 0 || rec->length > MAX_PACKET) {
+                        continue;
+                }
+                while (device_count <= rec->device) {
+                        if (start_device(add_device(TRANSPORT_L2CAP)) < 0) {
+                                mtalk_log_unmap(&rd);
+                                return -1;
+                        }
+                }
+                if (replay_paced) {
+                        if (first < 0) {
+                                first = rec->timestamp_ns;
+                        }
+                        ns_timespec(start + (int64_t)rec->timestamp_ns - first, &ts);
+                        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+                                /* keep waiting */
+                        }
+                }
+                if (summary_rate) {
+                        if (next_summary == 0) {
+                                next_summary = rec->timestamp_ns + 1000000000 / summary_rate;
+                        }
+                        while ((int64_t)rec->timestamp_ns >= next_summary) {
+                                print_summary(1.0 / summary_rate);
+                                next_summary += 1000000000 / summary_rate;
+                        }
+                }
+                if (heatmap_prefix != NULL) {
+                        if (next_heatmap == 0) {
+                                next_heatmap = rec->timestamp_ns + heatmap_interval * (int64_t)1000000000;
+                        }
+                        while ((int64_t)rec->timestamp_ns >= next_heatmap) {
+                                heat_snapshot(0);
+                                next_heatmap += heatmap_interval * (int64_t)1000000000;
+                        }
+                }
+                ns_timespec(rec->timestamp_ns + offset, &ts);
+                handle_packet(&devices[rec->device], rec->channel, (const unsigned char *)(rec + 1), rec->length, &ts, NULL);
+        }
+
+        mtalk_log_unmap(&rd);
+        return 0;
+}
+
+/* Writes sim_params.frames generated reports to the session log,
+ * spaced at sim_params.rate (or 1 MHz if that is zero).
+ */
+int generate_log(void)
+{
+        static unsigned char data[MAX_PACKET];
+        struct mtalk_sim sim;
+        struct timespec ts;
+        int64_t start;
+        int64_t step;
+        int len;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        start = timespec_ns(&ts);
+        step = 1000000000 / (sim_params.rate ? sim_params.rate : 1000000);
+        mtalk_sim_init(&sim, &sim_params);
+        while (sim.frame < sim_params.frames) {
+                len = mtalk_sim_next(&sim, data);
+                if (mtalk_log_append(&record_log, start + step * sim.frame, EV_INTR, 0, data, len) < 0) {
+                        fprintf(stderr, "Unable to extend %s: %s\n", record_file, strerror(errno));
+                        return -1;
                 }
         }
+        return 0;
 }
 
 int main(int argc, char *argv[])
 {
+        struct rusage usage[2];
+        struct timespec rt;
+        struct timespec mt;
+        struct device *d;
+        int res;
+
         parse_args(argc, argv);
-        connect_sockets();
-        write_mystery();
-        read_data();
-        return EXIT_SUCCESS;
+        if (run_selftest) {
+                return selftest() ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+        decode_frames = use_uinput || summary_rate || shm_name != NULL || detect_gestures
+                || heatmap_prefix != NULL || track_touches || print_json;
+        choose_sinks();
+        if (shm_name != NULL && (shm = mtalk_shm_create(shm_name, shm_capacity)) == NULL) {
+                fprintf(stderr, "Unable to create shared memory %s: %s\n", shm_name, strerror(errno));
+                return EXIT_FAILURE;
+        }
+        if (replay_file != NULL) {
+                res = replay();
+        } else {
+                clock_gettime(CLOCK_REALTIME, &rt);
+                clock_gettime(CLOCK_MONOTONIC, &mt);
+                start_record(timespec_ns(&rt), timespec_ns(&mt));
+                if (device_count == 0) {
+                        res = generate_log();
+                } else {
+                        for (d = devices; d < devices + device_count; d++) {
+                                if (start_device(d) < 0) {
+                                        return EXIT_FAILURE;
+                                }
+                                if (open_device(d) == 0) {
+                                        fetch_descriptor(d, 1);
+                                        if (write_mystery(d->fds[0]) == 0) {
+                                                continue;
+                                        }
+                                        close_device(d);
+                                }
+                                if (!reconnect_max_ms || probe) {
+                                        return EXIT_FAILURE;
+                                }
+                                /* Keep trying, as if it had gone away. */
+                                fprintf(stderr, "Unable to reach %s; reconnecting\n", d->name);
+                                lost_device(d);
+                        }
+                        if ((rt_priority > 0 || rt_cpu >= 0) && start_realtime() < 0) {
+                                return EXIT_FAILURE;
+                        }
+                        getrusage(RUSAGE_SELF, &usage[0]);
+                        res = probe ? probe_devices() : read_data();
+                        getrusage(RUSAGE_SELF, &usage[1]);
+                        if (reconnect_max_ms) {
+                                print_reconnects();
+                        }
+                        if (rt_priority > 0 || rt_cpu >= 0) {
+                                print_rusage(&usage[0], &usage[1]);
+                        }
+                        for (d = devices; d < devices + device_count; d++) {
+                                close_device(d);
+                        }
+                }
+        }
+        for (d = devices; d < devices + device_count; d++) {
+                finish_device(d);
+        }
+        if (measure_latency) {
+                print_latency();
+                print_links();
+        }
+        if (heatmap_prefix != NULL) {
+                heat_snapshot(1);
+        }
+        mtalk_log_close(&record_log);
+        out_flush(&std_output);
+        return res < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }